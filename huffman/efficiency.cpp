@@ -0,0 +1,625 @@
+﻿// efficiency.cpp - algorithm analysis and throughput measurements of the Huffman core
+
+#include "efficiency.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <ctime>
+
+// Function to generate test data for efficiency analysis
+std::string generateTestData(size_t size, bool randomChars) {
+    std::string data;
+    data.reserve(size);
+
+    if (randomChars) {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<> dis(32, 126); // Printable ASCII
+
+        for (size_t i = 0; i < size; ++i) {
+            data += static_cast<char>(dis(gen));
+        }
+    }
+    else {
+        // Patterned data (for better compression)
+        const std::string pattern = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+        for (size_t i = 0; i < size; ++i) {
+            data += pattern[i % pattern.length()];
+        }
+    }
+
+    return data;
+}
+
+// Block compressor throughput for 1, 2, 4, ... threads up to the hardware thread count
+std::string benchmarkBlockScaling(size_t dataSize, size_t blockSize) {
+    std::string testData = generateTestData(dataSize, true);
+    int hardwareThreads = (int)std::thread::hardware_concurrency();
+    if (hardwareThreads <= 0) hardwareThreads = 1;
+    std::vector<int> threadCounts;
+    for (int t = 1; t < hardwareThreads; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(hardwareThreads);
+
+    std::stringstream curve;
+    curve << "Block compression scaling (" << (dataSize >> 20) << " MB, "
+        << (blockSize >> 10) << " KB blocks):\n";
+    double baseline = 0;
+    for (size_t i = 0; i < threadCounts.size(); i++) {
+        ThreadPool pool(threadCounts[i]);
+        std::vector<uint8_t> packed;
+        auto start = std::chrono::high_resolution_clock::now();
+        compressBlocks(reinterpret_cast<const uint8_t*>(testData.data()), testData.size(), packed, pool, blockSize);
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double mbPerSec = seconds > 0 ? dataSize / 1048576.0 / seconds : 0;
+        if (i == 0) baseline = mbPerSec;
+        curve << threadCounts[i] << " thread(s): " << std::fixed << std::setprecision(1) << mbPerSec << " MB/s";
+        if (baseline > 0) curve << " (x" << std::setprecision(2) << mbPerSec / baseline << ")";
+        curve << "\n";
+    }
+    return curve.str();
+}
+
+// Single-core decode throughput of the same blocks coded as one stream and as four interleaved streams
+std::string benchmarkStreamInterleaving(size_t dataSize, size_t blockSize) {
+    std::string testData = generateTestData(dataSize, true);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(testData.data());
+    std::vector<uint8_t> decoded(blockSize);
+    std::stringstream result;
+    result << "Single-core block decode (" << (dataSize >> 20) << " MB):\n";
+    for (int fourStreams = 0; fourStreams <= 1; fourStreams++) {
+        std::vector<std::vector<uint8_t>> blocks;
+        for (size_t start = 0; start < testData.size(); start += blockSize) {
+            uint64_t freqs[256];
+            blocks.emplace_back();
+            encodeBlock(data + start, std::min(blockSize, testData.size() - start), blocks.back(),
+                MAX_HEADER_CODE_LEN, freqs, fourStreams != 0);
+        }
+        bool ok = true;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t b = 0; b < blocks.size(); b++) {
+            size_t rawSize = std::min(blockSize, testData.size() - b * blockSize);
+            ok = decodeBlock(blocks[b].data(), blocks[b].size(), decoded.data(), rawSize) && ok;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        result << (fourStreams ? "4-way streams: " : "Single stream: ") << std::fixed << std::setprecision(1)
+            << (seconds > 0 ? dataSize / 1048576.0 / seconds : 0) << " MB/s" << (ok ? "" : " (decode FAILED)") << "\n";
+    }
+    return result.str();
+}
+
+// notes when the first coded byte (past the 2-byte signature) reaches the output
+class FirstByteClock : public std::streambuf {
+    std::streamsize written = 0;
+
+    void note(std::streamsize n) {
+        if (written <= 2 && written + n > 2) first = std::chrono::high_resolution_clock::now();
+        written += n;
+    }
+
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override {
+        note(n);
+        return n;
+    }
+    int overflow(int c) override {
+        if (c != EOF) note(1);
+        return c == EOF ? 0 : c;
+    }
+
+public:
+    std::chrono::high_resolution_clock::time_point first;
+};
+
+// static codes need the whole histogram before the first bit, adaptive codes start at once
+std::string benchmarkAdaptive(size_t dataSize) {
+    std::vector<uint8_t> input = generateCorpus(CORPUS_TEXT, dataSize);
+    ByteSpan span{ input.data(), input.size() };
+    std::stringstream result;
+    result << "Static two-pass vs adaptive one-pass (" << (dataSize >> 20) << " MB text):\n";
+    for (int adaptive = 0; adaptive <= 1; adaptive++) {
+        std::vector<uint8_t> packed, decoded;
+        double firstByteMs;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (adaptive) {
+            FirstByteClock clock;
+            std::ostream sink(&clock);
+            std::istringstream in(std::string(input.begin(), input.end()));
+            start = std::chrono::high_resolution_clock::now();
+            compressStreamAdaptive(in, sink);
+            firstByteMs = std::chrono::duration<double, std::milli>(clock.first - start).count();
+            start = std::chrono::high_resolution_clock::now();
+            compressAdaptive(span, packed);
+        }
+        else {
+            // the header can only be written once the counting pass is over
+            uint64_t freqs[256] = { 0 };
+            uint8_t lens[256];
+            countFrequencies(input.data(), input.size(), freqs, 1);
+            buildLengthLimitedCodes(freqs, MAX_HEADER_CODE_LEN, lens);
+            firstByteMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            start = std::chrono::high_resolution_clock::now();
+            compress(span, packed);
+        }
+        auto mid = std::chrono::high_resolution_clock::now();
+        bool ok = decompress(ByteSpan{ packed.data(), packed.size() }, decoded) && decoded == input;
+        auto end = std::chrono::high_resolution_clock::now();
+        double mb = dataSize / 1048576.0;
+        double encodeSec = std::chrono::duration<double>(mid - start).count();
+        double decodeSec = std::chrono::duration<double>(end - mid).count();
+        result << (adaptive ? "Adaptive (v5): " : "Static (v2):   ") << std::fixed << std::setprecision(1)
+            << 100.0 * packed.size() / (dataSize ? dataSize : 1) << "% of input, encode "
+            << (encodeSec > 0 ? mb / encodeSec : 0) << " MB/s, decode " << (decodeSec > 0 ? mb / decodeSec : 0)
+            << " MB/s, first byte after " << std::setprecision(2) << firstByteMs << " ms"
+            << (ok ? "" : " (decode FAILED)") << "\n";
+    }
+    return result.str();
+}
+
+// Run efficiency test for a given data size
+TimeMeasurement runEfficiencyTest(size_t dataSize, bool randomData) {
+    TimeMeasurement measurement;
+    measurement.inputSize = dataSize;
+
+    // Generate test data
+    std::string testData = generateTestData(dataSize, randomData);
+
+    // Measure Build Tree Time
+    auto start = std::chrono::high_resolution_clock::now();
+
+    uint64_t freqs[256] = { 0 };
+    unsigned char bytesList[256];
+
+    countFrequencies(reinterpret_cast<const uint8_t*>(testData.data()), testData.size(), freqs);
+
+    int uniqueCount = 0;
+    for (int i = 0; i < 256; i++)
+        if (freqs[i]) bytesList[uniqueCount++] = (unsigned char)i;
+
+    HuffmanTree tree;
+    buildHuffmanTree(bytesList, freqs, uniqueCount, tree);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    measurement.buildTreeTime = std::chrono::duration<double, std::milli>(end - start).count();
+
+    // Measure Encoding Time: the real v2 encoder (length-limited canonical codes) into memory
+    ByteSpan input{ reinterpret_cast<const uint8_t*>(testData.data()), testData.size() };
+    std::vector<uint8_t> packed;
+    start = std::chrono::high_resolution_clock::now();
+    bool encoded = compress(input, packed);
+    end = std::chrono::high_resolution_clock::now();
+    measurement.encodingTime = std::chrono::duration<double, std::milli>(end - start).count();
+
+    // actual output size, header included
+    measurement.compressionRatio = encoded ? (double)packed.size() / dataSize : 0.0;
+
+    // Measure Decoding Time: decode the packed bytes back and check them
+    std::vector<uint8_t> decoded(testData.size());
+    size_t written = 0;
+    start = std::chrono::high_resolution_clock::now();
+    bool decodedOk = encoded && decompressInto(ByteSpan{ packed.data(), packed.size() }, decoded.data(), decoded.size(), written);
+    end = std::chrono::high_resolution_clock::now();
+    measurement.decodingTime = std::chrono::duration<double, std::milli>(end - start).count();
+    measurement.roundTrip = decodedOk && written == testData.size() &&
+        memcmp(decoded.data(), testData.data(), testData.size()) == 0;
+
+    return measurement;
+}
+
+// Calculate Big-O complexity analysis based on timing data
+std::string calculateBigOAnalysis(const std::vector<TimeMeasurement>& measurements) {
+    if (measurements.size() < 2) return "Insufficient data";
+
+    std::stringstream analysis;
+    analysis << "Big-O Analysis:\n";
+    analysis << "Input Sizes: ";
+    for (const auto& m : measurements) {
+        analysis << m.inputSize << " ";
+    }
+    analysis << "\n";
+
+    // Analyze build tree time (should be O(n log n))
+    double lastSize = measurements.back().inputSize;
+    double lastTime = measurements.back().buildTreeTime;
+    double ratio = lastTime / (lastSize * log2(lastSize));
+
+    analysis << "Build Tree: ~O(n log n) ";
+    if (ratio < 0.001) analysis << "(Efficient)";
+    else if (ratio < 0.01) analysis << "(Good)";
+    else analysis << "(Moderate)";
+    analysis << "\n";
+
+    // Analyze encoding time (should be O(n))
+    ratio = lastTime / lastSize;
+    analysis << "Encoding: ~O(n) ";
+    if (ratio < 0.00001) analysis << "(Very Efficient)";
+    else if (ratio < 0.0001) analysis << "(Efficient)";
+    else analysis << "(Standard)";
+    analysis << "\n";
+
+    // Analyze decoding time (should be O(n))
+    ratio = measurements.back().decodingTime / lastSize;
+    analysis << "Decoding: ~O(n) ";
+    if (ratio < 0.00001) analysis << "(Very Efficient)";
+    else if (ratio < 0.0001) analysis << "(Efficient)";
+    else analysis << "(Standard)";
+
+    return analysis.str();
+}
+
+// ===========================
+// BENCHMARK SUITE
+// ===========================
+const char* corpusName(CorpusKind kind) {
+    switch (kind) {
+    case CORPUS_TEXT: return "text";
+    case CORPUS_ZIPF: return "zipf";
+    case CORPUS_PCM: return "pcm";
+    case CORPUS_VIDEO: return "video";
+    case CORPUS_IMAGE: return "image";
+    default: return "random";
+    }
+}
+
+bool parseCorpusName(const std::string& name, CorpusKind& kind) {
+    const CorpusKind all[] = { CORPUS_TEXT, CORPUS_ZIPF, CORPUS_PCM, CORPUS_RANDOM, CORPUS_VIDEO, CORPUS_IMAGE };
+    for (CorpusKind k : all) {
+        if (name == corpusName(k)) {
+            kind = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void generateText(std::vector<uint8_t>& out, size_t size, std::mt19937_64& gen) {
+    static const char* const words[] = {
+        "the", "of", "and", "to", "a", "in", "is", "it", "that", "was", "for", "on", "are", "with",
+        "as", "be", "at", "this", "have", "from", "or", "one", "had", "by", "word", "but", "not",
+        "what", "all", "were", "when", "we", "there", "can", "an", "your", "which", "their", "said",
+        "if", "do", "will", "each", "about", "how", "up", "out", "them", "then", "she", "many",
+        "some", "so", "these", "would", "other", "into", "has", "more", "her", "two", "like", "him",
+        "see", "time", "could", "no", "make", "than", "first", "been", "its", "who", "now", "people",
+        "my", "made", "over", "did", "down", "only", "way", "find", "use", "may", "water", "long",
+        "little", "very", "after", "called", "just", "where", "most", "know", "huffman", "tree",
+        "compression", "frequency", "symbol", "encoding", "decoder", "priority", "queue"
+    };
+    const size_t wordCount = sizeof(words) / sizeof(words[0]);
+    std::vector<double> weights(wordCount);
+    for (size_t i = 0; i < wordCount; i++) weights[i] = 1.0 / (double)(i + 1);
+    std::discrete_distribution<size_t> pickWord(weights.begin(), weights.end());
+    std::uniform_int_distribution<int> sentenceLength(4, 16);
+
+    int wordsLeft = 0, sentences = 0;
+    while (out.size() < size) {
+        const char* w = words[pickWord(gen)];
+        bool capital = wordsLeft == 0;
+        if (capital) wordsLeft = sentenceLength(gen);
+        for (size_t i = 0; w[i]; i++) out.push_back((uint8_t)(capital && i == 0 ? w[i] - 'a' + 'A' : w[i]));
+        if (--wordsLeft == 0) {
+            out.push_back('.');
+            out.push_back(++sentences % 5 == 0 ? '\n' : ' ');
+        }
+        else out.push_back((gen() & 15) == 0 ? ',' : ' ');
+    }
+}
+
+static void generateZipf(std::vector<uint8_t>& out, size_t size, std::mt19937_64& gen) {
+    uint8_t symbol[256];
+    for (int i = 0; i < 256; i++) symbol[i] = (uint8_t)i;
+    std::shuffle(symbol, symbol + 256, gen);
+    // cumulative weights of rank^-1.1, looked up with a binary search per byte
+    double cumulative[256];
+    double total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += 1.0 / std::pow((double)(i + 1), 1.1);
+        cumulative[i] = total;
+    }
+    std::uniform_real_distribution<double> uniform(0.0, total);
+    out.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        size_t rank = std::upper_bound(cumulative, cumulative + 255, uniform(gen)) - cumulative;
+        out[i] = symbol[rank];
+    }
+}
+
+// a canonical 44-byte WAV header in front of the samples (inputs too small for one are bare samples)
+static void generatePcm(std::vector<uint8_t>& out, size_t size, std::mt19937_64& gen) {
+    const double rate = 44100.0, pi = 3.14159265358979323846;
+    std::normal_distribution<double> noise(0.0, 300.0);
+    out.resize(size);
+    size_t start = 0;
+    if (size >= 48) {
+        uint32_t dataSize = (uint32_t)((size - 44) & ~(size_t)1);
+        auto le = [&out](size_t at, uint32_t v, int bytes) {
+            for (int b = 0; b < bytes; b++) out[at + b] = (uint8_t)(v >> (8 * b));
+        };
+        memcpy(out.data(), "RIFF", 4);
+        le(4, 36 + dataSize, 4);
+        memcpy(out.data() + 8, "WAVEfmt ", 8);
+        le(16, 16, 4);        // fmt chunk size
+        le(20, 1, 2);         // PCM
+        le(22, 2, 2);         // channels
+        le(24, 44100, 4);     // sample rate
+        le(28, 44100 * 4, 4); // byte rate
+        le(32, 4, 2);         // block align
+        le(34, 16, 2);        // bits per sample
+        memcpy(out.data() + 36, "data", 4);
+        le(40, dataSize, 4);
+        start = 44;
+    }
+    double phase[3] = { 0, 0, 0 };
+    for (size_t i = start; i + 1 < size; i += 2) {
+        size_t frame = (i - start) / 4;
+        bool right = ((i - start) / 2) & 1;
+        if (!right) {
+            // a slow vibrato on three partials
+            double base = 220.0 * (1.0 + 0.01 * std::sin(2 * pi * 0.5 * frame / rate));
+            for (int p = 0; p < 3; p++) phase[p] += 2 * pi * base * (p + 1) / rate;
+        }
+        double v = 6000 * std::sin(phase[0]) + 3000 * std::sin(phase[1]) + 1500 * std::sin(phase[2] + (right ? 0.3 : 0.0));
+        int sample = (int)std::lround(v + noise(gen));
+        if (sample > 32767) sample = 32767;
+        if (sample < -32768) sample = -32768;
+        out[i] = (uint8_t)(sample & 0xFF);
+        out[i + 1] = (uint8_t)((sample >> 8) & 0xFF);
+    }
+    if (size & 1) out[size - 1] = 0;
+}
+
+// a smooth tw x th texture: random values on a grid of 16-pixel cells, bilinearly interpolated
+static std::vector<uint8_t> generateTexture(int tw, int th, std::mt19937_64& gen) {
+    const int cell = 16, gw = tw / cell + 1;
+    std::vector<int> grid((size_t)gw * (th / cell + 1));
+    for (int& g : grid) g = 32 + (int)(gen() % 192);
+    std::vector<uint8_t> texture((size_t)tw * th);
+    for (int y = 0; y < th; y++) {
+        for (int x = 0; x < tw; x++) {
+            int gx = x / cell, gy = y / cell, fx = x % cell, fy = y % cell;
+            const int* g = &grid[(size_t)gy * gw + gx];
+            int top = g[0] * (cell - fx) + g[1] * fx, bottom = g[gw] * (cell - fx) + g[gw + 1] * fx;
+            texture[(size_t)y * tw + x] = (uint8_t)((top * (cell - fy) + bottom * fy) / (cell * cell));
+        }
+    }
+    return texture;
+}
+
+// a Y4M file of 4:2:0 frames panning over a smooth texture, with a little sensor noise; the
+// last frame is cut where the size ends
+static void generateVideo(std::vector<uint8_t>& out, size_t size, std::mt19937_64& gen) {
+    const int width = 320, height = 240;
+    const char header[] = "YUV4MPEG2 W320 H240 F30:1 Ip A1:1 C420jpeg\n", frameLine[] = "FRAME\n";
+    // the texture is twice the frame size, so every frame shows a different part of it
+    const int tw = 2 * width;
+    std::vector<uint8_t> texture = generateTexture(tw, 2 * height, gen);
+    std::uniform_int_distribution<int> noise(-2, 2);
+    out.insert(out.end(), header, header + sizeof(header) - 1);
+    for (int t = 0; out.size() < size; t++) {
+        out.insert(out.end(), frameLine, frameLine + sizeof(frameLine) - 1);
+        int ox = t % width, oy = (t / 2) % height;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int v = texture[(size_t)(y + oy) * tw + x + ox] + noise(gen);
+                out.push_back((uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v));
+            }
+        }
+        // chroma follows the luma texture at half resolution
+        for (int plane = 0; plane < 2; plane++) {
+            for (int y = 0; y < height / 2; y++) {
+                for (int x = 0; x < width / 2; x++) {
+                    int v = texture[(size_t)(2 * y + oy) * tw + 2 * x + ox] / 2;
+                    out.push_back((uint8_t)(plane == 0 ? 64 + v : 192 - v));
+                }
+            }
+        }
+    }
+}
+
+// a 24-bit BMP, 512 pixels wide and as tall as the size allows (the rest stays zero), of three
+// smooth textures plus a little noise; inputs too small for one row are bare pixels
+static void generateImage(std::vector<uint8_t>& out, size_t size, std::mt19937_64& gen) {
+    const size_t width = 512, stride = 3 * width, headerSize = 54;
+    size_t height = size >= headerSize + stride ? (size - headerSize) / stride : (size + stride - 1) / stride;
+    std::vector<uint8_t> texture[3];
+    for (int c = 0; c < 3; c++) texture[c] = generateTexture((int)width, (int)std::max<size_t>(height, 1), gen);
+    out.assign(std::max(size, headerSize + height * stride), 0);
+    size_t start = 0;
+    if (size >= headerSize + stride) {
+        auto le = [&out](size_t at, uint32_t v, int bytes) {
+            for (int b = 0; b < bytes; b++) out[at + b] = (uint8_t)(v >> (8 * b));
+        };
+        out[0] = 'B';
+        out[1] = 'M';
+        le(2, (uint32_t)size, 4);
+        le(10, (uint32_t)headerSize, 4);
+        le(14, 40, 4);                            // BITMAPINFOHEADER
+        le(18, (uint32_t)width, 4);
+        le(22, (uint32_t)height, 4);
+        le(26, 1, 2);                             // planes
+        le(28, 24, 2);                            // bits per pixel
+        le(34, (uint32_t)(height * stride), 4);   // image size (compression 0: BI_RGB)
+        start = headerSize;
+    }
+    std::uniform_int_distribution<int> noise(-2, 2);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                int v = texture[c][y * width + x] + noise(gen);
+                out[start + y * stride + 3 * x + c] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+            }
+        }
+    }
+}
+
+std::vector<uint8_t> generateCorpus(CorpusKind kind, size_t size, uint32_t seed) {
+    std::mt19937_64 gen(seed * 0x9E3779B97F4A7C15ULL + (uint64_t)kind);
+    std::vector<uint8_t> out;
+    out.reserve(size);
+    switch (kind) {
+    case CORPUS_TEXT: generateText(out, size, gen); break;
+    case CORPUS_ZIPF: generateZipf(out, size, gen); break;
+    case CORPUS_PCM: generatePcm(out, size, gen); break;
+    case CORPUS_VIDEO: generateVideo(out, size, gen); break;
+    case CORPUS_IMAGE: generateImage(out, size, gen); break;
+    default:
+        out.resize(size);
+        for (size_t i = 0; i < size; i += 8) {
+            uint64_t r = gen();
+            for (size_t k = 0; k < 8 && i + k < size; k++) out[i + k] = (uint8_t)(r >> (8 * k));
+        }
+    }
+    out.resize(size);
+    return out;
+}
+
+uint64_t peakRssBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return (uint64_t)counters.PeakWorkingSetSize;
+    return 0;
+#elif defined(__APPLE__)
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? (uint64_t)usage.ru_maxrss : 0; // bytes on macOS
+#else
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? (uint64_t)usage.ru_maxrss * 1024 : 0; // KB on Linux
+#endif
+}
+
+static LatencyStats summarize(std::vector<double>& ms, uint64_t bytes) {
+    LatencyStats s = {};
+    if (ms.empty()) return s;
+    std::sort(ms.begin(), ms.end());
+    // nearest-rank percentiles
+    s.p50Ms = ms[(ms.size() + 1) / 2 - 1];
+    s.p99Ms = ms[(size_t)std::ceil(0.99 * ms.size()) - 1];
+    double sum = 0;
+    for (double v : ms) sum += v;
+    s.meanMs = sum / ms.size();
+    if (s.p50Ms > 0 && bytes > 0) {
+        s.mbPerSec = bytes / 1048576.0 / (s.p50Ms / 1000.0);
+        s.nsPerByte = s.p50Ms * 1e6 / bytes;
+    }
+    return s;
+}
+
+template <class Run>
+static void timeRuns(int warmups, int reps, std::vector<double>& ms, Run run) {
+    for (int i = 0; i < warmups; i++) run();
+    ms.clear();
+    for (int i = 0; i < reps; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+}
+
+std::vector<BenchResult> runBenchmarkSuite(const BenchConfig& config, std::ostream* progress) {
+    std::vector<BenchResult> results;
+    ThreadPool pool(config.threads);
+    std::vector<double> ms;
+    for (CorpusKind kind : config.corpora) {
+        for (size_t size : config.sizes) {
+            std::vector<uint8_t> input = generateCorpus(kind, size);
+            ByteSpan span{ input.data(), input.size() };
+            std::vector<uint8_t> decoded(size);
+            uint64_t want = (config.minBytes + size - 1) / (size ? size : 1);
+            int reps = (int)std::min<uint64_t>(std::max<uint64_t>((uint64_t)config.reps, want), 10000);
+
+            for (const std::string& codec : config.codecs) {
+                WavLayout wav;
+                Y4mLayout y4m;
+                if (codec == "audio" && !parseWav(span, wav)) continue;
+                ImageLayout image;
+                if (codec == "video" && !parseY4m(span, y4m)) continue;
+                if (codec == "image" && !parseImage(span, image)) continue;
+                BenchResult r;
+                r.corpus = corpusName(kind);
+                r.codec = codec;
+                r.size = size;
+                r.reps = reps;
+
+                // compress: the stream codec writes into a preallocated buffer, the others into
+                // a vector they resize themselves
+                std::vector<uint8_t> packed(codec == "stream" ? compressBound(size) : 0);
+                size_t packedSize = 0;
+                if (codec == "stream") timeRuns(config.warmups, reps, ms, [&] { packedSize = compressInto(span, packed.data(), packed.size()); });
+                else if (codec == "blocks") timeRuns(config.warmups, reps, ms, [&] { compressBlocks(input.data(), size, packed, pool); packedSize = packed.size(); });
+                else if (codec == "audio") timeRuns(config.warmups, reps, ms, [&] { compressAudio(span, packed, pool); packedSize = packed.size(); });
+                else if (codec == "video") timeRuns(config.warmups, reps, ms, [&] { compressVideo(span, packed, pool); packedSize = packed.size(); });
+                else if (codec == "image") timeRuns(config.warmups, reps, ms, [&] { compressImage(span, packed, pool); packedSize = packed.size(); });
+                else if (codec == "bwt") timeRuns(config.warmups, reps, ms, [&] { compressBwt(span, packed, pool); packedSize = packed.size(); });
+                else if (codec == "lz") timeRuns(config.warmups, reps, ms, [&] { compressLz(span, packed, pool); packedSize = packed.size(); });
+                else timeRuns(config.warmups, reps, ms, [&] { compressAdaptive(span, packed); packedSize = packed.size(); });
+                r.compress = summarize(ms, size);
+                r.compressedSize = packedSize;
+
+                bool ok = packedSize > 0;
+                size_t written = 0;
+                ByteSpan coded{ packed.data(), packedSize };
+                timeRuns(config.warmups, reps, ms, [&] { ok = decompressInto(coded, decoded.data(), decoded.size(), written) && ok; });
+                r.decompress = summarize(ms, size);
+                r.roundTrip = ok && written == size && memcmp(decoded.data(), input.data(), size) == 0;
+                r.peakRssBytes = peakRssBytes();
+                results.push_back(r);
+
+                if (progress) {
+                    *progress << std::left << std::setw(7) << r.corpus << std::setw(9) << r.codec << std::right
+                        << std::setw(11) << size << " B  ratio " << std::fixed << std::setprecision(3)
+                        << (size ? (double)r.compressedSize / size : 0.0)
+                        << "  comp " << std::setprecision(1) << std::setw(7) << r.compress.mbPerSec << " MB/s"
+                        << "  dec " << std::setw(7) << r.decompress.mbPerSec << " MB/s"
+                        << "  p99 " << std::setprecision(3) << r.compress.p99Ms << "/" << r.decompress.p99Ms << " ms"
+                        << (r.roundTrip ? "" : "  ROUND TRIP FAILED") << std::endl;
+                }
+            }
+        }
+    }
+    return results;
+}
+
+static void jsonStats(std::ostringstream& out, const char* name, const LatencyStats& s) {
+    out << "\"" << name << "\": {\"mb_per_s\": " << s.mbPerSec << ", \"ns_per_byte\": " << s.nsPerByte
+        << ", \"p50_ms\": " << s.p50Ms << ", \"p99_ms\": " << s.p99Ms << ", \"mean_ms\": " << s.meanMs << "}";
+}
+
+std::string benchmarkJson(const BenchConfig& config, const std::vector<BenchResult>& results) {
+    std::ostringstream out;
+    out << std::setprecision(6);
+    int hardwareThreads = (int)std::thread::hardware_concurrency();
+    out << "{\n  \"tool\": \"huffman_bench\",\n  \"schema\": 1,\n  \"timestamp\": " << (long long)std::time(nullptr) << ",\n";
+    out << "  \"config\": {\"warmups\": " << config.warmups << ", \"reps\": " << config.reps
+        << ", \"min_bytes\": " << config.minBytes << ", \"threads\": " << (config.threads > 0 ? config.threads : hardwareThreads)
+        << ", \"hardware_threads\": " << hardwareThreads << "},\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"corpus\": \"" << r.corpus << "\", \"codec\": \"" << r.codec
+            << "\", \"size\": " << r.size << ", \"compressed_size\": " << r.compressedSize
+            << ", \"ratio\": " << (r.size ? (double)r.compressedSize / r.size : 0.0) << ", \"reps\": " << r.reps << ",\n     ";
+        jsonStats(out, "compress", r.compress);
+        out << ",\n     ";
+        jsonStats(out, "decompress", r.decompress);
+        out << ",\n     \"round_trip\": " << (r.roundTrip ? "true" : "false") << ", \"peak_rss_bytes\": " << r.peakRssBytes << "}";
+    }
+    out << "\n  ],\n  \"peak_rss_bytes\": " << peakRssBytes() << "\n}\n";
+    return out.str();
+}
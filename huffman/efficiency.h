@@ -0,0 +1,107 @@
+﻿// efficiency.h - algorithm analysis and throughput measurements of the Huffman core
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "huffman_core.h"
+
+// ===========================
+// EFFICIENCY TESTING MODULE (Algorithm Analysis)
+// ===========================
+struct TimeMeasurement {
+    double buildTreeTime;
+    double encodingTime;
+    double decodingTime;
+    uint64_t inputSize;
+    double compressionRatio;
+    bool roundTrip; // decoded output matched the input
+
+    TimeMeasurement() : buildTreeTime(0), encodingTime(0),
+        decodingTime(0), inputSize(0), compressionRatio(0), roundTrip(false) {
+    }
+};
+
+struct EfficiencyReport {
+    std::vector<TimeMeasurement> measurements;
+    double avgBuildTreeTime;
+    double avgEncodingTime;
+    double avgDecodingTime;
+    std::string bigOAnalysis;
+    std::string decoderCheck; // table decoder vs tree walk on the sample output.huff
+    std::string scalingCurve; // block compressor throughput per thread count
+    std::string interleaveBench; // single-stream vs 4-way block decode on one core
+    std::string adaptiveBench;   // static two-pass vs adaptive one-pass coding
+
+    EfficiencyReport() : avgBuildTreeTime(0), avgEncodingTime(0),
+        avgDecodingTime(0) {
+    }
+};
+
+std::string generateTestData(size_t size, bool randomChars = true);
+TimeMeasurement runEfficiencyTest(size_t dataSize, bool randomData);
+std::string calculateBigOAnalysis(const std::vector<TimeMeasurement>& measurements);
+std::string benchmarkBlockScaling(size_t dataSize = 16 << 20, size_t blockSize = DEFAULT_BLOCK_SIZE);
+std::string benchmarkStreamInterleaving(size_t dataSize = 16 << 20, size_t blockSize = DEFAULT_BLOCK_SIZE);
+std::string benchmarkAdaptive(size_t dataSize = 16 << 20);
+
+
+/*
+ Benchmark suite
+ Runs the real encoders and decoders over synthetic corpora and reports throughput, latency
+ percentiles and peak memory. Corpora are deterministic for a given seed, so runs are
+ comparable over time.
+*/
+enum CorpusKind {
+    CORPUS_TEXT,   // English-like words with Zipf-distributed frequencies
+    CORPUS_ZIPF,   // independent bytes, Zipf-distributed over all 256 values
+    CORPUS_PCM,    // 16-bit stereo PCM audio (tones plus noise) in a WAV file
+    CORPUS_RANDOM, // uniform random bytes, standing in for already-compressed media
+    CORPUS_VIDEO,  // 8-bit 4:2:0 video (a panning, slightly noisy texture) in a Y4M file
+    CORPUS_IMAGE   // a 24-bit BMP of smooth, slightly noisy textures
+};
+
+const char* corpusName(CorpusKind kind);
+bool parseCorpusName(const std::string& name, CorpusKind& kind);
+std::vector<uint8_t> generateCorpus(CorpusKind kind, size_t size, uint32_t seed = 1);
+
+struct BenchConfig {
+    std::vector<CorpusKind> corpora;
+    std::vector<std::string> codecs; // "stream", "blocks", "adaptive", "audio" (WAV corpora only), "video" (Y4M only),
+                                     // "image" (BMP only), "bwt", "lz"
+    std::vector<size_t> sizes;
+    int warmups;       // untimed runs before measuring
+    int reps;          // minimum timed repetitions
+    uint64_t minBytes; // small inputs repeat until this much data went through (at most 10000 reps)
+    int threads;       // block container workers, 0 = one per hardware thread
+
+    BenchConfig() : codecs({ "stream", "blocks", "adaptive", "audio", "video", "image", "bwt", "lz" }), warmups(1), reps(5), minBytes(64 << 20), threads(0) {
+    }
+};
+
+struct LatencyStats {
+    double p50Ms;
+    double p99Ms;
+    double meanMs;
+    double mbPerSec;  // from the median
+    double nsPerByte; // from the median
+};
+
+struct BenchResult {
+    std::string corpus;
+    std::string codec;  // "stream" (v2, one thread), "blocks" (v3 container), "adaptive" (v5, one pass), "audio" (v6), "video" (v7), "image" (v8), "bwt" (v9) or "lz" (v10, default level)
+    uint64_t size;
+    uint64_t compressedSize;
+    int reps;
+    LatencyStats compress;
+    LatencyStats decompress;
+    bool roundTrip;
+    uint64_t peakRssBytes; // process peak after this measurement
+};
+
+uint64_t peakRssBytes();
+std::vector<BenchResult> runBenchmarkSuite(const BenchConfig& config, std::ostream* progress = nullptr);
+std::string benchmarkJson(const BenchConfig& config, const std::vector<BenchResult>& results);
@@ -1,5 +1,5 @@
 ﻿// main.cpp - Complete Huffman Multi-Module Compressor
-// Build: C++17, SFML 2.6.x (link sfml-graphics, sfml-window, sfml-system)
+// Build: C++17, SFML 2.6.x (link sfml-graphics, sfml-window, sfml-system) + huffman_core.cpp, efficiency.cpp
 ////CLASS: BSCS 14-A
 //Group Members:
 //Syed Abbas Raza (517626)
@@ -16,14 +16,18 @@
 #include <cmath>
 #include <cstring>
 #include <cstdint>
-#include <unordered_map>
 #include <string>
 #include <chrono>
-#include <random>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "huffman_core.h"
+#include "efficiency.h"
 
 using namespace std;
 
@@ -32,7 +36,8 @@ enum ModuleType {
     MODULE_NONE,
     MODULE_TEXT,
     MODULE_AUDIO,
-    MODULE_VIDEO
+    MODULE_VIDEO,
+    MODULE_IMAGE
 };
 
 struct ModuleConfig {
@@ -51,7 +56,7 @@ struct ModuleConfig {
             return buf;
         }
         else {
-            // Audio/Video: show hex
+            // Audio/Video/Image: show hex
             char buf[16];
             sprintf_s(buf, sizeof(buf), "0x%02X", byte);
             return buf;
@@ -59,300 +64,35 @@ struct ModuleConfig {
     }
 };
 
-ModuleConfig modules[3] = {
+ModuleConfig modules[4] = {
     {MODULE_TEXT, "Text Files", "Text Files\0*.txt\0All Files\0*.*\0"},
     {MODULE_AUDIO, "Audio Files", "Audio Files\0*.wav;.mp3;.flac;.aac\0All Files\0.*\0"},
-    {MODULE_VIDEO, "Video Files", "Video Files\0*.mp4;.avi;.mkv;.mov\0All Files\0.*\0"}
-};
-
-
-// HUFFMAN CORE LOGIC
-
-// Huffman node & BinaryHeap
-
-class HuffmanNode {
-public:
-    unsigned char data;
-    uint64_t freq;// using uint64 instead of int because frequencies can be much larger than 2 billion (max int range)
-    HuffmanNode* left;
-    HuffmanNode* right;
-
-    HuffmanNode(unsigned char data, uint64_t freq) {
-        this->data = data;
-        this->freq = freq;
-        left = right = nullptr;
-    }
-
-    HuffmanNode(HuffmanNode* l, HuffmanNode* r) {
-        data = 0; // internal node
-        freq = l->freq + r->freq;
-        left = l;
-        right = r;
-    }
-
-    bool isLeaf()
-    {
-        return left == nullptr && right == nullptr;
-    }
+    {MODULE_VIDEO, "Video Files", "Video Files\0*.y4m;.mp4;.avi;.mkv;.mov\0All Files\0.*\0"},
+    {MODULE_IMAGE, "Image Files", "Image Files\0*.bmp;*.pgm;*.ppm\0All Files\0*.*\0"}
 };
 
-class BinaryHeap {
-    HuffmanNode** arr;//pointer to array of pointers to HuffmanNodes
-    int rear;
-    int capacity;
-    int h;
-
-    void swapNodes(int i, int j) {
-        HuffmanNode* temp = arr[i];
-        arr[i] = arr[j];
-        arr[j] = temp;
-    }
-
-public:
-    BinaryHeap(int capacity) {
-        this->capacity = capacity;
-        arr = new HuffmanNode * [capacity + 2]; // 1-based indexing
-        rear = 0;
-        h = -1;
-    }
-
-    void updateHeight() {
-        if (rear == 0) h = -1;
-        else h = (int)floor(log2((double)rear));
-    }
-
-    bool isEmpty()
-    {
-        return rear == 0;
-    }
-    int size()
-    {
-        return rear;
-    }
-    int getHeight()
-    {
-        return h;
-    }
-
-    HuffmanNode* top() { // min element
-        if (rear == 0) return nullptr;
-        return arr[1];
-    }
-
-    void push(HuffmanNode* node) { //pushing new node into the binary heap
-        if (rear + 1 >= capacity) return;
-        arr[++rear] = node;
-        int i = rear;
-        while (i > 1 && arr[i]->freq < arr[i / 2]->freq) {//heapify up
-            swapNodes(i, i / 2);
-            i /= 2;
-        }
-        updateHeight();
-    }
-
-    HuffmanNode* pop() {
-        if (rear == 0) return nullptr;
-        HuffmanNode* minNode = arr[1]; //root node popped 
-        arr[1] = arr[rear--];// move last node to root
-        int i = 1;
-        while (true) {//heapify down
-            int left = 2 * i, right = 2 * i + 1;
-            int smallest = i;
-            if (left <= rear && arr[left]->freq < arr[smallest]->freq) smallest = left;
-            if (right <= rear && arr[right]->freq < arr[smallest]->freq) smallest = right;
-            if (smallest == i) break;
-            swapNodes(i, smallest);
-            i = smallest;
-        }
-        updateHeight();
-        return minNode;
-    }
-};
-
-/*
-      Fuctional Module 1: Frequency & Tree
-*/
-HuffmanNode* buildHuffmanTree(unsigned char bytes[], uint64_t freqs[], int uniqueCount) {
-    BinaryHeap minHeap(uniqueCount + 5); // create minheap with extra space
-    for (int i = 0; i < uniqueCount; ++i) {
-        if (freqs[bytes[i]] > 0) {
-            minHeap.push(new HuffmanNode(bytes[i], freqs[bytes[i]]));
-        }
-    }
-
-    if (minHeap.size() == 0) return nullptr;
-    // edge-case: only one unique symbol: create dummy sibling
-    if (minHeap.size() == 1) {
-        HuffmanNode* only = minHeap.pop();
-        HuffmanNode* dummy = new HuffmanNode((unsigned char)0, 0);
-        HuffmanNode* parent = new HuffmanNode(only, dummy);
-        minHeap.push(parent);
-    }
-
-    while (minHeap.size() > 1) {
-        HuffmanNode* l = minHeap.pop();
-        HuffmanNode* r = minHeap.pop();
-        HuffmanNode* m = new HuffmanNode(l, r);
-        minHeap.push(m);
-    }
-    return minHeap.pop();
-}
-// storing codes using hashmaps for faster O(1) lookup
-void storeCodesHashMap(HuffmanNode* root, unordered_map<unsigned char, string>& codeMap, string path = "") {
-    if (!root) return;
-
-    if (root->isLeaf()) {
-        codeMap[root->data] = path;// Direct insertion - O(1)
-        return;
-    }
-
-    storeCodesHashMap(root->left, codeMap, path + "0");
-    storeCodesHashMap(root->right, codeMap, path + "1");
-}
-
-/*
- Functional Module 2: Encoding/Decoding & File I/O
- */
-
-void writeCompressedText(const string& text, const string& outPath,
-    unordered_map<unsigned char, string>& codeMap,
-    unsigned char bytesPresent[256], uint64_t freqs[256]) {
-
-    uint64_t totalBits = 0;
-    for (unordered_map<unsigned char, string>::const_iterator it = codeMap.begin(); it != codeMap.end(); ++it) {
-        unsigned char sym = it->first;
-        totalBits += freqs[sym] * it->second.length();
-    }
-
-    ofstream out(outPath, ios::binary);
-    if (!out) { cerr << "Cannot open output file\n"; return; }
-
-    uint16_t uniq = 0;
-    for (int i = 0; i < 256; i++) if (bytesPresent[i]) ++uniq;
-    /* writing header information in output file
-       1. number of unique symbols (2 bytes)
-       2. for each unique symbol: symbol (1 byte) + frequency (8 bytes)
-       3. total bits in compressed data (8 bytes)
-    */
-
-    /*
-    * For small files, the header may take up a significant portion of the compressed file.
-    * This causes the compressed file to be larger than the original.
-    * This is a known limitation of this simple implementation.
-    */
-
-    out.write(reinterpret_cast<const char*>(&uniq), sizeof(uniq));
-    for (int i = 0; i < 256; i++) {
-        if (bytesPresent[i]) {
-            uint8_t s = (uint8_t)i;
-            uint64_t f = freqs[i];
-            out.write(reinterpret_cast<const char*>(&s), sizeof(s));
-            out.write(reinterpret_cast<const char*>(&f), sizeof(f));
-        }
-    }
-    out.write(reinterpret_cast<const char*>(&totalBits), sizeof(totalBits));
-    //writing compressed data in the form of bits packed into bytes in output file
-    // pack bits into bytes (MSB-first) - WITH O(1) LOOKUP using hashmap!
-    uint8_t outByte = 0;
-    int outBits = 0;
-    for (size_t p = 0; p < text.size(); ++p) {
-        unsigned char ch = (unsigned char)text[p];
-
-        unordered_map<unsigned char, string>::const_iterator it = codeMap.find(ch);
-        if (it == codeMap.end()) continue;
-
-        const string& code = it->second;
-        for (size_t k = 0; k < code.length(); ++k) {
-            outByte <<= 1;
-            if (code[k] == '1') outByte |= 1;
-            ++outBits;
-            if (outBits == 8) {
-                out.write(reinterpret_cast<const char*>(&outByte), 1);
-                outByte = 0; outBits = 0;
-            }
-        }
-    }
-    if (outBits > 0) {
-        outByte <<= (8 - outBits);
-        out.write(reinterpret_cast<const char*>(&outByte), 1);
-    }
-    out.close();
-}
-
-bool readCompressedAndDecode(const string& inPath, const string& outPath) {
-    ifstream in(inPath, ios::binary);
-    if (!in) return false;
-
-    uint16_t uniq = 0;
-    in.read(reinterpret_cast<char*>(&uniq), sizeof(uniq));
-    if (!in) return false;
-    /*Reading header information:
-    * including number of unique symbols, their frequencies, and total bits
-    * This information is used to reconstruct the Huffman tree for decoding
-    */
-    uint64_t freqs[256] = { 0 };
-    unsigned char bytesPresent[256] = { 0 };
-    for (int i = 0; i < uniq; i++) {
-        uint8_t s; uint64_t f;
-        in.read(reinterpret_cast<char*>(&s), sizeof(s));
-        in.read(reinterpret_cast<char*>(&f), sizeof(f));
-        bytesPresent[s] = 1;
-        freqs[s] = f;
-    }
-    uint64_t totalBits = 0;
-    in.read(reinterpret_cast<char*>(&totalBits), sizeof(totalBits));
-    // collect bytes list
-    unsigned char bytesList[256];
-    int uniqueCount = 0;
-    for (int i = 0; i < 256; i++) if (bytesPresent[i]) bytesList[uniqueCount++] = (unsigned char)i;
-
-    HuffmanNode* root = buildHuffmanTree(bytesList, freqs, uniqueCount);
-    if (!root) return false;
-
-    ofstream out(outPath, ios::binary);
-    if (!out) return false;
-    // decoding bits into original symbols using the Huffman tree
-    uint64_t bitsRead = 0;
-    HuffmanNode* node = root;
-    char byteBuf;
-    while (bitsRead < totalBits && in.get(byteBuf)) {
-        uint8_t b = (uint8_t)byteBuf;
-        for (int bit = 7; bit >= 0 && bitsRead < totalBits; --bit) {
-            int val = (b >> bit) & 1;
-            if (val == 0) node = node->left; else node = node->right;
-            if (!node) return false;
-            if (node->isLeaf()) {
-                out.put((char)node->data);
-                node = root;
-            }
-            ++bitsRead;
-        }
-    }
-    out.close();
-    return true;
-}
 
 /*
  Functional Module 3: Tree layout & SFML visualization
  */
 struct VizNode {//tree visualization node
-    HuffmanNode* n;
+    uint16_t n; // index into the tree
     int x;
     int depth;
     float screenX, screenY;
 };
 // assigning x positions using inorder traversal
-void assignPositionsInorder(HuffmanNode* root, int& currentX, int depth, VizNode viz[], int& idx) {
-    if (!root) return;
-    assignPositionsInorder(root->left, currentX, depth + 1, viz, idx);
-    viz[idx].n = root;
+void assignPositionsInorder(const HuffmanTree& tree, uint16_t node, int& currentX, int depth, VizNode viz[], int& idx) {
+    if (node == NO_NODE) return;
+    assignPositionsInorder(tree, tree[node].left, currentX, depth + 1, viz, idx);
+    viz[idx].n = node;
     viz[idx].x = currentX++;
     viz[idx].depth = depth;
     ++idx;
-    assignPositionsInorder(root->right, currentX, depth + 1, viz, idx);
+    assignPositionsInorder(tree, tree[node].right, currentX, depth + 1, viz, idx);
 }
 // Draw function with scrollbar support
-void drawTreeSFML(sf::RenderWindow& window, VizNode viz[], int vizCount,
+void drawTreeSFML(sf::RenderWindow& window, const HuffmanTree& tree, VizNode viz[], int vizCount,
     float nodeRadius, sf::Font& font,
     float zoomLevel, float scrollX, float scrollY,
     float maxScrollX, float maxScrollY, const ModuleConfig& module) {
@@ -378,43 +118,28 @@ void drawTreeSFML(sf::RenderWindow& window, VizNode viz[], int vizCount,
 
     window.setView(treeView);
 
-    // Draw edges
+    // Draw edges (viz slot of every tree node, so each child is found directly)
+    int vizOf[MAX_TREE_NODES];
+    for (int i = 0; i < MAX_TREE_NODES; i++) vizOf[i] = -1;
+    for (int i = 0; i < vizCount; i++) vizOf[viz[i].n] = i;
     for (int i = 0; i < vizCount; i++) {
-        HuffmanNode* node = viz[i].n;
-        if (!node) continue;
-
-        if (node->left) {
-            for (int j = 0; j < vizCount; j++) {
-                if (viz[j].n == node->left) {
-                    sf::Vertex line[] = {
-                        sf::Vertex(sf::Vector2f(viz[i].screenX, viz[i].screenY), sf::Color::Black),
-                        sf::Vertex(sf::Vector2f(viz[j].screenX, viz[j].screenY), sf::Color::Black)
-                    };
-                    window.draw(line, 2, sf::Lines);
-                    break;
-                }
-            }
-        }
-
-        if (node->right) {
-            for (int j = 0; j < vizCount; j++) {
-                if (viz[j].n == node->right) {
-                    sf::Vertex line[] = {
-                        sf::Vertex(sf::Vector2f(viz[i].screenX, viz[i].screenY), sf::Color::Black),
-                        sf::Vertex(sf::Vector2f(viz[j].screenX, viz[j].screenY), sf::Color::Black)
-                    };
-                    window.draw(line, 2, sf::Lines);
-                    break;
-                }
-            }
+        const FlatNode& node = tree[viz[i].n];
+        uint16_t children[2] = { node.left, node.right };
+        for (int c = 0; c < 2; c++) {
+            if (children[c] == NO_NODE || vizOf[children[c]] < 0) continue;
+            int j = vizOf[children[c]];
+            sf::Vertex line[] = {
+                sf::Vertex(sf::Vector2f(viz[i].screenX, viz[i].screenY), sf::Color::Black),
+                sf::Vertex(sf::Vector2f(viz[j].screenX, viz[j].screenY), sf::Color::Black)
+            };
+            window.draw(line, 2, sf::Lines);
         }
     }
 
     // Draw nodes
     for (int i = 0; i < vizCount; i++) {
-        if (!viz[i].n) continue;
         // Different colors for leaf vs internal nodes
-        sf::Color nodeColor = viz[i].n->isLeaf() ?
+        sf::Color nodeColor = tree.isLeaf(viz[i].n) ?
             sf::Color(144, 238, 144) : sf::Color(173, 216, 230);
 
         sf::CircleShape circle(nodeRadius);
@@ -427,11 +152,11 @@ void drawTreeSFML(sf::RenderWindow& window, VizNode viz[], int vizCount,
 
         // Use module-specific label
         string label;
-        if (viz[i].n->isLeaf()) {
-            label = module.getUnitLabel(viz[i].n->data);
+        if (tree.isLeaf(viz[i].n)) {
+            label = module.getUnitLabel(tree[viz[i].n].data);
         }
         else {
-            label = to_string((uint32_t)viz[i].n->freq);
+            label = to_string((uint32_t)tree[viz[i].n].freq);
         }
 
         sf::Text txt(label, font, 11);
@@ -441,7 +166,7 @@ void drawTreeSFML(sf::RenderWindow& window, VizNode viz[], int vizCount,
         txt.setPosition(viz[i].screenX, viz[i].screenY - 3.f);
         window.draw(txt);
 
-        sf::Text freqTxt(to_string((uint32_t)viz[i].n->freq), font, 9);
+        sf::Text freqTxt(to_string((uint32_t)tree[viz[i].n].freq), font, 9);
         freqTxt.setFillColor(sf::Color(40, 40, 40));
         sf::FloatRect freqBounds = freqTxt.getLocalBounds();
         freqTxt.setOrigin(freqBounds.width / 2.f, 0);
@@ -490,13 +215,6 @@ string saveFileDialogWin(const char* filter, const char* defaultName = "compress
     return string();
 }
 
-void freeTree(HuffmanNode* root) {
-    if (!root) return;
-    freeTree(root->left);
-    freeTree(root->right);
-    delete root;
-}
-
 // GUI CLASS (Simple Button Helper)
 class Button {
 public:
@@ -559,185 +277,98 @@ public:
     }
 };
 
-// ===========================
-// EFFICIENCY TESTING MODULE (Algorithm Analysis)
-// ===========================
-struct TimeMeasurement {
-    double buildTreeTime;
-    double encodingTime;
-    double decodingTime;
-    uint64_t inputSize;
-    double compressionRatio;
-
-    TimeMeasurement() : buildTreeTime(0), encodingTime(0),
-        decodingTime(0), inputSize(0), compressionRatio(0) {
-    }
-};
-
-struct EfficiencyReport {
-    std::vector<TimeMeasurement> measurements;
-    double avgBuildTreeTime;
-    double avgEncodingTime;
-    double avgDecodingTime;
-    std::string bigOAnalysis;
-
-    EfficiencyReport() : avgBuildTreeTime(0), avgEncodingTime(0),
-        avgDecodingTime(0) {
+// BACKGROUND JOB (compress / decompress / efficiency test run here; the UI thread only polls)
+class BackgroundJob {
+public:
+    JobProgress progress;
+    bool ok;
+
+    BackgroundJob() : ok(false), finished(false) {}
+    ~BackgroundJob() { stop(); }
+
+    bool running() const { return worker.joinable(); }
+
+    void start(std::function<bool(JobProgress&)> task) {
+        stop();
+        progress.begin(JOB_STARTING, 0);
+        progress.cancel = false;
+        ok = false;
+        finished = false;
+        started = std::chrono::steady_clock::now();
+        worker = std::thread([this, task] {
+            ok = task(progress);
+            finished.store(true, std::memory_order_release);
+        });
     }
-};
-
-// Function to generate test data for efficiency analysis
-std::string generateTestData(int size, bool randomChars = true) {
-    std::string data;
-    data.reserve(size);
 
-    if (randomChars) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(32, 126); // Printable ASCII
-
-        for (int i = 0; i < size; ++i) {
-            data += static_cast<char>(dis(gen));
-        }
+    // joins a worker that has returned; true once per job, when its result can be read
+    bool poll() {
+        if (!worker.joinable() || !finished.load(std::memory_order_acquire)) return false;
+        worker.join();
+        return true;
     }
-    else {
-        // Patterned data (for better compression)
-        const std::string pattern = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ";
-        for (int i = 0; i < size; ++i) {
-            data += pattern[i % pattern.length()];
-        }
-    }
-
-    return data;
-}
-
-// Run efficiency test for a given data size
-TimeMeasurement runEfficiencyTest(int dataSize, bool randomData) {
-    TimeMeasurement measurement;
-    measurement.inputSize = dataSize;
-
-    // Generate test data
-    std::string testData = generateTestData(dataSize, randomData);
-
-    // Measure Build Tree Time
-    auto start = std::chrono::high_resolution_clock::now();
-
-    uint64_t freqs[256] = { 0 };
-    unsigned char bytesList[256];
-    unsigned char bytesPresent[256] = { 0 };
-
-    for (size_t i = 0; i < testData.size(); ++i) {
-        unsigned char c = (unsigned char)testData[i];
-        freqs[c]++;
-        bytesPresent[c] = 1;
-    }
-
-    int uniqueCount = 0;
-    for (int i = 0; i < 256; i++)
-        if (bytesPresent[i]) bytesList[uniqueCount++] = (unsigned char)i;
-
-    HuffmanNode* root = buildHuffmanTree(bytesList, freqs, uniqueCount);
-
-    auto end = std::chrono::high_resolution_clock::now();
-    measurement.buildTreeTime = std::chrono::duration<double, std::milli>(end - start).count();
 
-    // Measure Encoding Time
-    start = std::chrono::high_resolution_clock::now();
+    void cancel() { progress.cancel = true; }
 
-    std::unordered_map<unsigned char, std::string> codeMap;
-    storeCodesHashMap(root, codeMap);
-
-    // Simulate encoding (but don't write to file)
-    uint64_t totalBits = 0;
-    for (const auto& pair : codeMap) {
-        totalBits += freqs[pair.first] * pair.second.length();
+    void stop() {
+        cancel();
+        if (worker.joinable()) worker.join();
     }
 
-    // Simulate bit packing
-    uint8_t outByte = 0;
-    int outBits = 0;
-    for (size_t p = 0; p < testData.size(); ++p) {
-        unsigned char ch = (unsigned char)testData[p];
-        const std::string& code = codeMap[ch];
-        for (size_t k = 0; k < code.length(); ++k) {
-            // Just simulate, don't actually store
-            outByte <<= 1;
-            if (code[k] == '1') outByte |= 1;
-            ++outBits;
-            if (outBits == 8) {
-                outByte = 0;
-                outBits = 0;
-            }
-        }
+    double elapsedSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
     }
 
-    end = std::chrono::high_resolution_clock::now();
-    measurement.encodingTime = std::chrono::duration<double, std::milli>(end - start).count();
-
-    // Calculate compressed size (estimate)
-    uint64_t compressedBytes = (totalBits + 7) / 8 + 2 + uniqueCount * 9 + 8; // Header overhead
-    measurement.compressionRatio = (double)compressedBytes / dataSize;
-
-    // Measure Decoding Time
-    start = std::chrono::high_resolution_clock::now();
+private:
+    std::thread worker;
+    std::atomic<bool> finished;
+    std::chrono::steady_clock::time_point started;
+};
 
-    // Simulate decoding
-    if (root) {
-        HuffmanNode* node = root;
-        uint64_t bitsProcessed = 0;
-        // Simulate processing all bits
-        bitsProcessed = totalBits; // Just for timing
-        (void)bitsProcessed; // Avoid unused warning
+const char* jobPhaseName(int phase) {
+    switch (phase) {
+    case JOB_COUNTING: return "Counting frequencies";
+    case JOB_ENCODING: return "Encoding";
+    case JOB_DECODING: return "Decoding";
+    case JOB_TESTING: return "Running tests";
+    case JOB_DONE: return "Finishing";
+    default: return "Starting";
     }
-
-    end = std::chrono::high_resolution_clock::now();
-    measurement.decodingTime = std::chrono::duration<double, std::milli>(end - start).count();
-
-    // Cleanup
-    if (root) freeTree(root);
-
-    return measurement;
 }
 
-// Calculate Big-O complexity analysis based on timing data
-std::string calculateBigOAnalysis(const std::vector<TimeMeasurement>& measurements) {
-    if (measurements.size() < 2) return "Insufficient data";
-
-    std::stringstream analysis;
-    analysis << "Big-O Analysis:\n";
-    analysis << "Input Sizes: ";
-    for (const auto& m : measurements) {
-        analysis << m.inputSize << " ";
+// phase, bar and throughput of a running job (unknown totals draw an empty bar)
+void drawJobProgress(sf::RenderWindow& window, sf::Font& font, const BackgroundJob& job, float x, float y) {
+    int phase = job.progress.phase.load(std::memory_order_acquire);
+    uint64_t done = job.progress.done.load(std::memory_order_relaxed);
+    uint64_t total = job.progress.total.load(std::memory_order_relaxed);
+    float fraction = total > 0 ? (float)min<double>(1.0, (double)done / (double)total) : 0.f;
+
+    std::stringstream label;
+    label << jobPhaseName(phase) << "...";
+    if (job.progress.cancelled()) label << " (cancelling)";
+    label << "\n";
+    if (phase == JOB_TESTING) label << done << " / " << total << " tests";
+    else {
+        double mb = done / 1048576.0;
+        double seconds = job.elapsedSeconds();
+        label << std::fixed << std::setprecision(1) << mb << " MB";
+        if (total > 0) label << " / " << total / 1048576.0 << " MB";
+        if (seconds > 0) label << "   " << mb / seconds << " MB/s";
     }
-    analysis << "\n";
-
-    // Analyze build tree time (should be O(n log n))
-    double lastSize = measurements.back().inputSize;
-    double lastTime = measurements.back().buildTreeTime;
-    double ratio = lastTime / (lastSize * log2(lastSize));
-
-    analysis << "Build Tree: ~O(n log n) ";
-    if (ratio < 0.001) analysis << "(Efficient)";
-    else if (ratio < 0.01) analysis << "(Good)";
-    else analysis << "(Moderate)";
-    analysis << "\n";
-
-    // Analyze encoding time (should be O(n))
-    ratio = lastTime / lastSize;
-    analysis << "Encoding: ~O(n) ";
-    if (ratio < 0.00001) analysis << "(Very Efficient)";
-    else if (ratio < 0.0001) analysis << "(Efficient)";
-    else analysis << "(Standard)";
-    analysis << "\n";
-
-    // Analyze decoding time (should be O(n))
-    ratio = measurements.back().decodingTime / lastSize;
-    analysis << "Decoding: ~O(n) ";
-    if (ratio < 0.00001) analysis << "(Very Efficient)";
-    else if (ratio < 0.0001) analysis << "(Efficient)";
-    else analysis << "(Standard)";
-
-    return analysis.str();
+    sf::Text labelTxt(label.str(), font, 16);
+    labelTxt.setFillColor(sf::Color::White);
+    labelTxt.setPosition(x, y);
+    window.draw(labelTxt);
+
+    sf::RectangleShape progressBg(sf::Vector2f(400, 20));
+    progressBg.setFillColor(sf::Color(60, 60, 65));
+    progressBg.setPosition(x, y + 50);
+    window.draw(progressBg);
+
+    sf::RectangleShape progressBar(sf::Vector2f(400 * fraction, 20));
+    progressBar.setFillColor(sf::Color(100, 200, 100));
+    progressBar.setPosition(x, y + 50);
+    window.draw(progressBar);
 }
 
 /*
@@ -788,9 +419,10 @@ int main() {
     Button efficiencyBtn({ 280, 60 }, { 360, 380 }, "Algorithm Efficiency Test", font, sf::Color(150, 100, 200), sf::Color(180, 130, 230)); // Added for efficiency testing
 
     // Module Selection
-    Button textModuleBtn({ 200, 80 }, { 150, 250 }, "Text Files", font, primaryCol, primaryHover);
-    Button audioModuleBtn({ 200, 80 }, { 400, 250 }, "Audio Files", font, dangerCol, dangerHover);
-    Button videoModuleBtn({ 200, 80 }, { 650, 250 }, "Video Files", font, successCol, successHover);
+    Button textModuleBtn({ 180, 80 }, { 80, 250 }, "Text Files", font, primaryCol, primaryHover);
+    Button audioModuleBtn({ 180, 80 }, { 300, 250 }, "Audio Files", font, dangerCol, dangerHover);
+    Button videoModuleBtn({ 180, 80 }, { 520, 250 }, "Video Files", font, successCol, successHover);
+    Button imageModuleBtn({ 180, 80 }, { 740, 250 }, "Image Files", font, sf::Color(214, 120, 20), sf::Color(240, 146, 46));
 
     // Navigation
     Button backBtn({ 150, 40 }, { 425, 450 }, "Back", font, neutralCol, neutralHover);
@@ -805,6 +437,9 @@ int main() {
     Button saveDecompressedBtn({ 220, 40 }, { 220, 550 }, "Save Output", font, successCol, successHover);
     Button backToMenuSmallBtn({ 180, 40 }, { 460, 550 }, "Back to Menu", font, neutralCol, neutralHover);
 
+    // Shown while a background job runs
+    Button cancelBtn({ 180, 40 }, { 410, 480 }, "Cancel", font, dangerCol, dangerHover);
+
     // Zoom Controls
     Button zoomInBtn({ 40, 30 }, { 15, 660 }, "+", font, neutralCol, neutralHover);
     Button zoomOutBtn({ 40, 30 }, { 65, 660 }, "-", font, neutralCol, neutralHover);
@@ -823,9 +458,13 @@ int main() {
     // Compression/decompression storage
     std::string inputPath;
     std::string compressedPath = "output.huff";
+    std::vector<uint8_t> compressedData; // single-block inputs are compressed in memory (saved from here)
+    uint64_t compressFreqs[256] = { 0 };
     uint64_t origBytes = 0, compBytes = 0;
     double ratio = 0.0;
     bool processed = false;
+    int maxCodeLength = MAX_HEADER_CODE_LEN; // code length cap for v2 output (e.g. 11, 12 or 15)
+    LengthLimitReport lengthLimit = {};
 
     std::string decompressInputPath;
     std::string decompressOutputPath = "decompressed.txt";
@@ -837,11 +476,11 @@ int main() {
     VizNode viz[1024];
     int vizCount = 0;
     float nodeRadius = 22.f;
-    HuffmanNode* savedRoot = nullptr;
+    HuffmanTree savedTree; // arenas reused by every compress / decompress preview
 
     VizNode decompressViz[1024];
     int decompressVizCount = 0;
-    HuffmanNode* decompressRoot = nullptr;
+    HuffmanTree decompressTree;
 
     // Camera controls
     float zoomLevel = 1.0f;
@@ -889,14 +528,12 @@ int main() {
     // Efficiency testing variables
     EfficiencyReport efficiencyReport;
     std::vector<int> testSizes = { 1000, 10000, 100000 }; // N = 10³, 10⁴, 10⁵
-    int currentTestSizeIndex = 0;
-    int currentTestRun = 0;
     const int NUM_TEST_RUNS = 3;
-    bool isTestingRandomData = true;
-    bool testingInProgress = false;
-    sf::Text efficiencyStatusTxt("", font, 16);
-    efficiencyStatusTxt.setFillColor(sf::Color::White);
-    efficiencyStatusTxt.setPosition(100, 200);
+    const int NUM_BENCH_STEPS = 4; // decoder check, block scaling, stream interleaving, adaptive coding
+
+    // Worker for the long operations; the window keeps drawing and can cancel it.
+    // Declared after everything its tasks reference, so it is joined before they go away.
+    BackgroundJob job;
 
     // Main event loop
     while (window.isOpen()) {
@@ -910,6 +547,7 @@ int main() {
         textModuleBtn.update(mousePos);
         audioModuleBtn.update(mousePos);
         videoModuleBtn.update(mousePos);
+        imageModuleBtn.update(mousePos);
         backBtn.update(mousePos);
         selectBtn.update(mousePos);
         saveCompressedBtn.update(mousePos);
@@ -917,6 +555,7 @@ int main() {
         showTreeBtn.update(mousePos);
         saveDecompressedBtn.update(mousePos);
         backToMenuSmallBtn.update(mousePos);
+        cancelBtn.update(mousePos);
         zoomInBtn.update(mousePos);
         zoomOutBtn.update(mousePos);
         resetViewBtn.update(mousePos);
@@ -924,8 +563,7 @@ int main() {
         sf::Event event;
         while (window.pollEvent(event)) {
             if (event.type == sf::Event::Closed) {
-                if (savedRoot) { freeTree(savedRoot); savedRoot = nullptr; }
-                if (decompressRoot) { freeTree(decompressRoot); decompressRoot = nullptr; }
+                job.cancel(); // joined when job goes out of scope
                 window.close();
             }
 
@@ -981,15 +619,58 @@ int main() {
                     continue;
                 }
 
+                if ((state == PROCESSING || state == DECOMPRESSING || state == EFFICIENCY_TEST) && cancelBtn.isClicked(mousePos)) {
+                    job.cancel(); // the worker stops at its next chunk; the poll below cleans up
+                    continue;
+                }
+
                 if (state == MENU) {
                     if (startBtn.isClicked(mousePos)) state = MODULE_SELECTION_COMPRESS;
                     else if (decompressBtn.isClicked(mousePos)) state = MODULE_SELECTION_DECOMPRESS;
                     else if (efficiencyBtn.isClicked(mousePos)) { // Added for efficiency testing
                         state = EFFICIENCY_TEST;
-                        efficiencyReport.measurements.clear();
-                        currentTestSizeIndex = 0;
-                        currentTestRun = 0;
-                        testingInProgress = true;
+                        efficiencyReport = EfficiencyReport();
+                        job.start([&](JobProgress& progress) {
+                            // the report is only read by the UI thread after the worker is joined
+                            int totalTests = (int)testSizes.size() * NUM_TEST_RUNS;
+                            progress.begin(JOB_TESTING, totalTests + NUM_BENCH_STEPS);
+                            bool isTestingRandomData = true;
+                            for (int t = 0; t < totalTests; t++) {
+                                if (progress.cancelled()) return false;
+                                efficiencyReport.measurements.push_back(
+                                    runEfficiencyTest(testSizes[t / NUM_TEST_RUNS], isTestingRandomData));
+                                progress.advance(1);
+                                // Switch data type for next size
+                                if ((t + 1) % NUM_TEST_RUNS == 0) isTestingRandomData = !isTestingRandomData;
+                            }
+
+                            // Calculate averages
+                            double totalBuildTime = 0, totalEncodeTime = 0, totalDecodeTime = 0;
+                            for (const auto& m : efficiencyReport.measurements) {
+                                totalBuildTime += m.buildTreeTime;
+                                totalEncodeTime += m.encodingTime;
+                                totalDecodeTime += m.decodingTime;
+                            }
+                            efficiencyReport.avgBuildTreeTime = totalBuildTime / efficiencyReport.measurements.size();
+                            efficiencyReport.avgEncodingTime = totalEncodeTime / efficiencyReport.measurements.size();
+                            efficiencyReport.avgDecodingTime = totalDecodeTime / efficiencyReport.measurements.size();
+
+                            // Calculate Big-O analysis
+                            efficiencyReport.bigOAnalysis = calculateBigOAnalysis(efficiencyReport.measurements);
+
+                            // Cross-check the table decoder against the reference tree walk
+                            efficiencyReport.decoderCheck = decodersAgree(compressedPath) ?
+                                "Table decoder matches tree walk on " + compressedPath :
+                                "Decoder check failed or " + compressedPath + " missing";
+                            if (!progress.advance(1)) return false;
+                            efficiencyReport.scalingCurve = benchmarkBlockScaling();
+                            if (!progress.advance(1)) return false;
+                            efficiencyReport.interleaveBench = benchmarkStreamInterleaving();
+                            if (!progress.advance(1)) return false;
+                            efficiencyReport.adaptiveBench = benchmarkAdaptive();
+                            progress.advance(1);
+                            return true;
+                        });
                     }
                 }
                 else if (state == MODULE_SELECTION_COMPRESS) {
@@ -997,13 +678,16 @@ int main() {
                     else if (textModuleBtn.isClicked(mousePos)) { currentModule = modules[0]; state = SELECTING; statusTxt.setString(""); }
                     else if (audioModuleBtn.isClicked(mousePos)) { currentModule = modules[1]; state = SELECTING; statusTxt.setString(""); }
                     else if (videoModuleBtn.isClicked(mousePos)) { currentModule = modules[2]; state = SELECTING; statusTxt.setString(""); }
+                    else if (imageModuleBtn.isClicked(mousePos)) { currentModule = modules[3]; state = SELECTING; statusTxt.setString(""); }
                 }
                 else if (state == MODULE_SELECTION_DECOMPRESS) {
                     if (backBtn.isClicked(mousePos)) state = MENU;
-                    else if (textModuleBtn.isClicked(mousePos) || audioModuleBtn.isClicked(mousePos) || videoModuleBtn.isClicked(mousePos)) {
+                    else if (textModuleBtn.isClicked(mousePos) || audioModuleBtn.isClicked(mousePos) || videoModuleBtn.isClicked(mousePos) ||
+                        imageModuleBtn.isClicked(mousePos)) {
                         if (textModuleBtn.isClicked(mousePos)) currentModule = modules[0];
                         if (audioModuleBtn.isClicked(mousePos)) currentModule = modules[1];
                         if (videoModuleBtn.isClicked(mousePos)) currentModule = modules[2];
+                        if (imageModuleBtn.isClicked(mousePos)) currentModule = modules[3];
 
                         // Decompression Logic
                         std::string picked = openFileDialogWin("Huffman Compressed\0*.huff\0All Files\0*.*\0");
@@ -1030,27 +714,22 @@ int main() {
                             case MODULE_TEXT: decompressOutputPath = baseName + "_decompressed.txt"; break;
                             case MODULE_AUDIO: decompressOutputPath = baseName + "_decompressed.wav"; break;
                             case MODULE_VIDEO: decompressOutputPath = baseName + "_decompressed.mp4"; break;
+                            case MODULE_IMAGE: decompressOutputPath = baseName + "_decompressed.bmp"; break;
                             default: decompressOutputPath = baseName + "_decompressed"; break;
                             }
 
                             std::ifstream in(decompressInputPath, std::ios::binary);
-                            if (in) {
-                                uint16_t uniq = 0; in.read(reinterpret_cast<char*>(&uniq), sizeof(uniq));
-                                uint64_t decompressFreqs[256] = { 0 };
-                                unsigned char decompressBytesPresent[256] = { 0 };
-                                for (int i = 0; i < uniq; i++) {
-                                    uint8_t s; uint64_t f;
-                                    in.read(reinterpret_cast<char*>(&s), sizeof(s)); in.read(reinterpret_cast<char*>(&f), sizeof(f));
-                                    decompressBytesPresent[s] = 1; decompressFreqs[s] = f;
-                                }
+                            HuffHeader header;
+                            if (in && readHuffHeader(in, header)) {
                                 in.close();
-                                unsigned char bytesList[256]; int uniqueCount = 0;
-                                for (int i = 0; i < 256; i++) if (decompressBytesPresent[i]) bytesList[uniqueCount++] = (unsigned char)i;
-                                if (decompressRoot) { freeTree(decompressRoot); decompressRoot = nullptr; }
-                                decompressRoot = buildHuffmanTree(bytesList, decompressFreqs, uniqueCount);
-                                if (decompressRoot) {
+                                // raw video decodes back to a Y4M file, not a container
+                                if (header.version == HUFF_FORMAT_VIDEO) decompressOutputPath = baseName + "_decompressed.y4m";
+                                // images keep the extension of the format they came from
+                                if (header.version == HUFF_FORMAT_IMAGE && header.imageKind == IMAGE_PNM)
+                                    decompressOutputPath = baseName + (header.channels == 1 ? "_decompressed.pgm" : "_decompressed.ppm");
+                                if (treeFromHeader(header, decompressTree)) {
                                     decompressVizCount = 0; int curX = 0;
-                                    assignPositionsInorder(decompressRoot, curX, 0, decompressViz, decompressVizCount);
+                                    assignPositionsInorder(decompressTree, decompressTree.root, curX, 0, decompressViz, decompressVizCount);
                                     int maxDepth = 0, maxX = 0;
                                     for (int i = 0; i < decompressVizCount; i++) {
                                         if (decompressViz[i].depth > maxDepth) maxDepth = decompressViz[i].depth;
@@ -1069,16 +748,9 @@ int main() {
                                     scrollX = scrollY = 0.0f; zoomLevel = 1.0f;
                                 }
                             }
-                            decompressSuccess = readCompressedAndDecode(decompressInputPath, decompressOutputPath);
-                            if (decompressSuccess) {
-                                std::ifstream fin(decompressOutputPath, std::ios::binary | std::ios::ate);
-                                if (fin) { decompressedBytes = (uint64_t)fin.tellg(); fin.close(); }
-                                state = DECOMPRESS_RESULT;
-                            }
-                            else {
-                                statusTxt.setString("Decompression failed!");
-                                state = MENU;
-                            }
+                            job.start([&](JobProgress& progress) {
+                                return readCompressedAndDecode(decompressInputPath, decompressOutputPath, false, &progress);
+                            });
                         }
                     }
                 }
@@ -1090,56 +762,46 @@ int main() {
                             inputPath = picked;
                             state = PROCESSING; // Logic continues in main loop update
 
-                            std::ifstream fin(inputPath, std::ios::binary);
-                            if (!fin) { statusTxt.setString("Error reading file."); state = SELECTING; }
-                            else {
-                                std::string text((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
-                                fin.close();
-                                origBytes = text.size();
-                                uint64_t freqs[256] = { 0 };
-                                unsigned char bytesList[256];
-                                unsigned char bytesPresent[256] = { 0 };
-                                for (size_t i = 0; i < text.size(); ++i) {
-                                    unsigned char c = (unsigned char)text[i];
-                                    freqs[c]++; bytesPresent[c] = 1;
+                            // files larger than one block go through the multithreaded block container
+                            // in compressedPath; smaller ones become a one-block container in memory
+                            // (blocks pick the order-1 context model when it pays off). The text
+                            // module block-sorts its files first (v9), the audio module codes PCM
+                            // WAV files as predicted samples instead (v6), the video module Y4M
+                            // files as predicted planes (v7) and the image module BMP/PGM/PPM
+                            // files as filtered rows (v8).
+                            compressedData.clear();
+                            job.start([&](JobProgress& progress) {
+                                if (currentModule.type == MODULE_TEXT)
+                                    return compressFileBwt(inputPath, compressedPath, compressFreqs, origBytes,
+                                        BWT_BLOCK_SIZE, 0, &progress);
+                                if (currentModule.type == MODULE_AUDIO && isPcmWavFile(inputPath))
+                                    return compressFileAudio(inputPath, compressedPath, compressFreqs, origBytes, 0, &progress);
+                                if (currentModule.type == MODULE_VIDEO && isY4mFile(inputPath))
+                                    return compressFileVideo(inputPath, compressedPath, compressFreqs, origBytes, 0, &progress);
+                                if (currentModule.type == MODULE_IMAGE && isImageFile(inputPath))
+                                    return compressFileImage(inputPath, compressedPath, compressFreqs, origBytes, 0, &progress);
+                                uint64_t inputSize = 0;
+                                {
+                                    std::ifstream probe(inputPath, std::ios::binary | std::ios::ate);
+                                    if (probe) inputSize = (uint64_t)probe.tellg();
                                 }
-                                int uniqueCount = 0;
-                                for (int i = 0; i < 256; i++) if (bytesPresent[i]) bytesList[uniqueCount++] = (unsigned char)i;
-                                HuffmanNode* root = buildHuffmanTree(bytesList, freqs, uniqueCount);
-                                if (!root) { statusTxt.setString("File empty or unreadable."); state = SELECTING; }
-                                else {
-                                    if (savedRoot) freeTree(savedRoot);
-                                    savedRoot = root;
-                                    std::unordered_map<unsigned char, std::string> codeMap;
-                                    storeCodesHashMap(root, codeMap);
-                                    writeCompressedText(text, compressedPath, codeMap, bytesPresent, freqs);
-
-                                    // Viz setup
-                                    vizCount = 0; int curX = 0;
-                                    assignPositionsInorder(root, curX, 0, viz, vizCount);
-                                    int maxDepth = 0, maxX = 0;
-                                    for (int i = 0; i < vizCount; i++) {
-                                        if (viz[i].depth > maxDepth) maxDepth = viz[i].depth;
-                                        if (viz[i].x > maxX) maxX = viz[i].x;
-                                    }
-                                    float minSpacingX = 30.f, minSpacingY = 120.f;
-                                    totalTreeWidth = (maxX + 1) * minSpacingX;
-                                    totalTreeHeight = (maxDepth + 1) * minSpacingY;
-                                    float offsetX = 50.f, offsetY = 50.f;
-                                    for (int i = 0; i < vizCount; i++) {
-                                        viz[i].screenX = offsetX + viz[i].x * minSpacingX;
-                                        viz[i].screenY = offsetY + viz[i].depth * minSpacingY;
-                                    }
-                                    maxScrollX = max(0.0f, totalTreeWidth - 760.f / zoomLevel);
-                                    maxScrollY = max(0.0f, totalTreeHeight - 640.f / zoomLevel);
-                                    scrollX = scrollY = 0.0f; zoomLevel = 1.0f;
-
-                                    std::ifstream cfin(compressedPath, std::ios::binary | std::ios::ate);
-                                    compBytes = (uint64_t)cfin.tellg(); cfin.close();
-                                    ratio = 100.0 * (1.0 - (double)compBytes / (double)origBytes);
-                                    state = SHOW_RESULT;
-                                }
-                            }
+                                if (inputSize > DEFAULT_BLOCK_SIZE)
+                                    return compressFileBlocks(inputPath, compressedPath, compressFreqs, origBytes,
+                                        DEFAULT_BLOCK_SIZE, 0, maxCodeLength, true, &progress);
+
+                                memset(compressFreqs, 0, sizeof(compressFreqs));
+                                std::vector<uint8_t> input((size_t)inputSize);
+                                std::ifstream in(inputPath, std::ios::binary);
+                                progress.begin(JOB_ENCODING, inputSize);
+                                if (!in || !in.read(reinterpret_cast<char*>(input.data()), input.size()) || progress.cancelled())
+                                    return false;
+                                ThreadPool pool(1);
+                                compressBlocks(input.data(), input.size(), compressedData, pool, DEFAULT_BLOCK_SIZE, maxCodeLength);
+                                countFrequencies(input.data(), input.size(), compressFreqs);
+                                origBytes = input.size();
+                                progress.advance(inputSize);
+                                return true;
+                            });
                         }
                     }
                 }
@@ -1148,10 +810,14 @@ int main() {
                     else if (saveCompressedBtn.isClicked(mousePos)) {
                         std::string savePath = saveFileDialogWin("Huffman Compressed\0*.huff\0All Files\0*.*\0");
                         if (savePath.size()) {
-                            // Copy file
-                            std::ifstream src(compressedPath, std::ios::binary);
                             std::ofstream dst(savePath, std::ios::binary);
-                            dst << src.rdbuf();
+                            if (!compressedData.empty())
+                                dst.write(reinterpret_cast<const char*>(compressedData.data()), compressedData.size());
+                            else {
+                                // Copy file
+                                std::ifstream src(compressedPath, std::ios::binary);
+                                dst << src.rdbuf();
+                            }
                             saveStatusTxt.setString("Saved to " + savePath);
                         }
                     }
@@ -1202,55 +868,72 @@ int main() {
             }
         }
 
-        // Efficiency test auto-running logic
-        if (state == EFFICIENCY_TEST && testingInProgress) {
-            // Run current test
-            if (currentTestSizeIndex < testSizes.size()) {
-                int currentSize = testSizes[currentTestSizeIndex];
-
-                // Update status
-                std::stringstream status;
-                status << "Running Efficiency Test...\n";
-                status << "Size: " << currentSize << " bytes\n";
-                status << "Run: " << (currentTestRun + 1) << "/" << NUM_TEST_RUNS << "\n";
-                status << "Data Type: " << (isTestingRandomData ? "Random" : "Patterned");
-                efficiencyStatusTxt.setString(status.str());
-
-                // Run the test
-                TimeMeasurement result = runEfficiencyTest(currentSize, isTestingRandomData);
-                efficiencyReport.measurements.push_back(result);
-
-                // Move to next run/size
-                currentTestRun++;
-                if (currentTestRun >= NUM_TEST_RUNS) {
-                    currentTestRun = 0;
-                    currentTestSizeIndex++;
-
-                    // Switch data type for next size
-                    isTestingRandomData = !isTestingRandomData;
+        // Results of a finished background job (the worker has been joined)
+        if (job.poll()) {
+            if (state == PROCESSING) {
+                if (job.progress.cancelled()) {
+                    std::remove(compressedPath.c_str());
+                    compressedData.clear();
+                    statusTxt.setString("Compression cancelled."); state = SELECTING;
                 }
+                else if (!job.ok) {
+                    statusTxt.setString("Error reading file."); state = SELECTING;
+                }
+                else {
+                    unsigned char bytesList[256];
+                    int uniqueCount = 0;
+                    for (int i = 0; i < 256; i++) if (compressFreqs[i]) bytesList[uniqueCount++] = (unsigned char)i;
+                    if (!buildHuffmanTree(bytesList, compressFreqs, uniqueCount, savedTree)) { statusTxt.setString("File empty or unreadable."); state = SELECTING; }
+                    else {
+                        lengthLimit = compareLengthLimit(savedTree, compressFreqs, maxCodeLength);
+
+                        // Viz setup
+                        vizCount = 0; int curX = 0;
+                        assignPositionsInorder(savedTree, savedTree.root, curX, 0, viz, vizCount);
+                        int maxDepth = 0, maxX = 0;
+                        for (int i = 0; i < vizCount; i++) {
+                            if (viz[i].depth > maxDepth) maxDepth = viz[i].depth;
+                            if (viz[i].x > maxX) maxX = viz[i].x;
+                        }
+                        float minSpacingX = 30.f, minSpacingY = 120.f;
+                        totalTreeWidth = (maxX + 1) * minSpacingX;
+                        totalTreeHeight = (maxDepth + 1) * minSpacingY;
+                        float offsetX = 50.f, offsetY = 50.f;
+                        for (int i = 0; i < vizCount; i++) {
+                            viz[i].screenX = offsetX + viz[i].x * minSpacingX;
+                            viz[i].screenY = offsetY + viz[i].depth * minSpacingY;
+                        }
+                        maxScrollX = max(0.0f, totalTreeWidth - 760.f / zoomLevel);
+                        maxScrollY = max(0.0f, totalTreeHeight - 640.f / zoomLevel);
+                        scrollX = scrollY = 0.0f; zoomLevel = 1.0f;
 
-                // If all tests done
-                if (currentTestSizeIndex >= testSizes.size()) {
-                    testingInProgress = false;
-
-                    // Calculate averages
-                    double totalBuildTime = 0, totalEncodeTime = 0, totalDecodeTime = 0;
-                    for (const auto& m : efficiencyReport.measurements) {
-                        totalBuildTime += m.buildTreeTime;
-                        totalEncodeTime += m.encodingTime;
-                        totalDecodeTime += m.decodingTime;
+                        if (!compressedData.empty()) compBytes = compressedData.size();
+                        else {
+                            std::ifstream cfin(compressedPath, std::ios::binary | std::ios::ate);
+                            compBytes = (uint64_t)cfin.tellg(); cfin.close();
+                        }
+                        ratio = 100.0 * (1.0 - (double)compBytes / (double)origBytes);
+                        state = SHOW_RESULT;
                     }
-                    efficiencyReport.avgBuildTreeTime = totalBuildTime / efficiencyReport.measurements.size();
-                    efficiencyReport.avgEncodingTime = totalEncodeTime / efficiencyReport.measurements.size();
-                    efficiencyReport.avgDecodingTime = totalDecodeTime / efficiencyReport.measurements.size();
-
-                    // Calculate Big-O analysis
-                    efficiencyReport.bigOAnalysis = calculateBigOAnalysis(efficiencyReport.measurements);
-
-                    state = SHOW_EFFICIENCY_REPORT;
                 }
             }
+            else if (state == DECOMPRESSING) {
+                decompressSuccess = job.ok;
+                if (decompressSuccess) {
+                    std::ifstream fin(decompressOutputPath, std::ios::binary | std::ios::ate);
+                    if (fin) { decompressedBytes = (uint64_t)fin.tellg(); fin.close(); }
+                    state = DECOMPRESS_RESULT;
+                }
+                else {
+                    // a cancelled or failed decode leaves a partial file behind
+                    std::remove(decompressOutputPath.c_str());
+                    statusTxt.setString(job.progress.cancelled() ? "Decompression cancelled." : "Decompression failed!");
+                    state = MENU;
+                }
+            }
+            else if (state == EFFICIENCY_TEST) {
+                state = job.ok ? SHOW_EFFICIENCY_REPORT : MENU;
+            }
         }
 
         // RENDER
@@ -1271,6 +954,7 @@ int main() {
             textModuleBtn.draw(window);
             audioModuleBtn.draw(window);
             videoModuleBtn.draw(window);
+            imageModuleBtn.draw(window);
             backBtn.draw(window);
         }
         else if (state == SELECTING) {
@@ -1293,7 +977,7 @@ int main() {
             treeArea.setPosition(10, 50);
             window.draw(treeArea);
 
-            drawTreeSFML(window, viz, vizCount, nodeRadius, font, zoomLevel, scrollX, scrollY, maxScrollX, maxScrollY, currentModule);
+            drawTreeSFML(window, savedTree, viz, vizCount, nodeRadius, font, zoomLevel, scrollX, scrollY, maxScrollX, maxScrollY, currentModule);
 
 
             // Side Panel
@@ -1366,6 +1050,15 @@ int main() {
             diffTxt.setPosition(780, 265);
             window.draw(diffTxt);
 
+            // Cost of the code length cap against the unbounded tree
+            std::stringstream capStr;
+            capStr << "Length Cap: " << lengthLimit.maxLen << " bits (+" << std::fixed << std::setprecision(3)
+                << lengthLimit.overheadPercent() << "%)";
+            sf::Text capTxt(capStr.str(), font, 14);
+            capTxt.setFillColor(sf::Color(180, 180, 180));
+            capTxt.setPosition(780, 290);
+            window.draw(capTxt);
+
             // Adjust button positions - moved down to avoid overlapping with stats
             saveCompressedBtn.setPosition(770, 350);  // Changed from 250 to 350
             saveCompressedBtn.draw(window);
@@ -1500,7 +1193,7 @@ int main() {
             treeArea.setPosition(10, 50);
             window.draw(treeArea);
 
-            drawTreeSFML(window, decompressViz, decompressVizCount, nodeRadius, font, zoomLevel, scrollX, scrollY, maxScrollX, maxScrollY, currentModule);
+            drawTreeSFML(window, decompressTree, decompressViz, decompressVizCount, nodeRadius, font, zoomLevel, scrollX, scrollY, maxScrollX, maxScrollY, currentModule);
 
             // Side Panel
             sf::RectangleShape sidePanel(sf::Vector2f(240, 600));
@@ -1541,28 +1234,15 @@ int main() {
                 window.draw(vScrollTrack); window.draw(vScrollThumb);
             }
         }
-        else if (state == EFFICIENCY_TEST) {
-            titleTxt.setString("Algorithm Efficiency Testing");
+        else if (state == PROCESSING || state == DECOMPRESSING || state == EFFICIENCY_TEST) {
+            if (state == PROCESSING) titleTxt.setString("Compressing " + currentModule.name);
+            else if (state == DECOMPRESSING) titleTxt.setString("Decompressing " + currentModule.name);
+            else titleTxt.setString("Algorithm Efficiency Testing");
             titleTxt.setPosition(280, 100);
             window.draw(titleTxt);
 
-            efficiencyStatusTxt.setPosition(350, 250);
-            window.draw(efficiencyStatusTxt);
-
-            // Show progress bar
-            if (testingInProgress) {
-                float progress = (currentTestSizeIndex * NUM_TEST_RUNS + currentTestRun) /
-                    (float)(testSizes.size() * NUM_TEST_RUNS);
-                sf::RectangleShape progressBg(sf::Vector2f(400, 20));
-                progressBg.setFillColor(sf::Color(60, 60, 65));
-                progressBg.setPosition(300, 400);
-                window.draw(progressBg);
-
-                sf::RectangleShape progressBar(sf::Vector2f(400 * progress, 20));
-                progressBar.setFillColor(sf::Color(100, 200, 100));
-                progressBar.setPosition(300, 400);
-                window.draw(progressBar);
-            }
+            drawJobProgress(window, font, job, 300, 330);
+            cancelBtn.draw(window);
         }
         else if (state == SHOW_EFFICIENCY_REPORT) {
             titleTxt.setString("Algorithm Efficiency Report");
@@ -1596,7 +1276,7 @@ int main() {
                 report << std::fixed << std::setprecision(2) << m.buildTreeTime << "\t\t";
                 report << m.encodingTime << "\t\t";
                 report << m.decodingTime << "\t\t";
-                report << std::setprecision(3) << m.compressionRatio << "\n";
+                report << std::setprecision(3) << m.compressionRatio << (m.roundTrip ? "" : "  (decode MISMATCH)") << "\n";
             }
 
             report << "\nAverages:\n";
@@ -1605,6 +1285,10 @@ int main() {
             report << "Decoding: " << efficiencyReport.avgDecodingTime << " ms\n\n";
 
             report << efficiencyReport.bigOAnalysis << "\n\n";
+            report << efficiencyReport.decoderCheck << "\n\n";
+            report << efficiencyReport.scalingCurve << "\n";
+            report << efficiencyReport.interleaveBench << "\n";
+            report << efficiencyReport.adaptiveBench << "\n";
 
             report << "Complexity Summary:\n";
             report << "1. Frequency Counting: O(n)\n";
@@ -1638,8 +1322,5 @@ int main() {
         window.display();
     }
 
-    if (savedRoot) { freeTree(savedRoot); }
-    if (decompressRoot) { freeTree(decompressRoot); }
-
     return 0;
 }
\ No newline at end of file
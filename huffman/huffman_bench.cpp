@@ -0,0 +1,106 @@
+﻿// huffman_bench.cpp - benchmark suite for the Huffman core
+// Build: C++17, links huffman_core (see CMakeLists.txt).
+//
+//   huffman_bench [--corpus text,zipf,pcm,random,video,image] [--codec stream,blocks,adaptive,audio,video,image,bwt,lz] [--sizes 1K,64K,1M,...] [--full]
+//                 [--warmup N] [--reps N] [--min-bytes N] [--threads N] [--json FILE]
+//
+// Progress goes to stderr, the JSON report to stdout (or FILE). --full extends the default
+// sizes up to 1 GB; the largest run needs about three times its size in memory.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "huffman_core.h"
+#include "efficiency.h"
+
+using namespace std;
+
+static void printUsage() {
+    cerr << "usage: huffman_bench [--corpus text,zipf,pcm,random,video,image] [--codec stream,blocks,adaptive,audio,video,image,bwt,lz] [--sizes 1K,64K,1M,...] [--full]\n"
+        << "                     [--warmup N] [--reps N] [--min-bytes N] [--threads N] [--json FILE]\n";
+}
+
+// decimal number with an optional K/M/G suffix
+static bool parseSize(const string& text, uint64_t& value) {
+    char* end = nullptr;
+    unsigned long long v = strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) return false;
+    if (*end == 'k' || *end == 'K') { v <<= 10; end++; }
+    else if (*end == 'm' || *end == 'M') { v <<= 20; end++; }
+    else if (*end == 'g' || *end == 'G') { v <<= 30; end++; }
+    if (*end != '\0') return false;
+    value = v;
+    return true;
+}
+
+static vector<string> splitList(const string& text) {
+    vector<string> items;
+    stringstream in(text);
+    string item;
+    while (getline(in, item, ',')) if (!item.empty()) items.push_back(item);
+    return items;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    config.corpora = { CORPUS_TEXT, CORPUS_ZIPF, CORPUS_PCM, CORPUS_RANDOM, CORPUS_VIDEO, CORPUS_IMAGE };
+    config.sizes = { 1 << 10, 16 << 10, 256 << 10, 4 << 20, 64 << 20 };
+    string jsonPath;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        uint64_t v;
+        if (arg == "--full") {
+            config.sizes.push_back((size_t)256 << 20);
+            config.sizes.push_back((size_t)1 << 30);
+        }
+        else if (arg == "--corpus" && hasValue) {
+            config.corpora.clear();
+            for (const string& name : splitList(argv[++i])) {
+                CorpusKind kind;
+                if (!parseCorpusName(name, kind)) { cerr << "unknown corpus: " << name << "\n"; return 2; }
+                config.corpora.push_back(kind);
+            }
+        }
+        else if (arg == "--codec" && hasValue) {
+            config.codecs.clear();
+            for (const string& name : splitList(argv[++i])) {
+                bool known = name == "stream" || name == "blocks" || name == "adaptive" || name == "audio" ||
+                    name == "video" || name == "image" || name == "bwt" || name == "lz";
+                if (!known) { cerr << "unknown codec: " << name << "\n"; return 2; }
+                config.codecs.push_back(name);
+            }
+        }
+        else if (arg == "--sizes" && hasValue) {
+            config.sizes.clear();
+            for (const string& item : splitList(argv[++i])) {
+                if (!parseSize(item, v) || v == 0) { cerr << "bad size: " << item << "\n"; return 2; }
+                config.sizes.push_back((size_t)v);
+            }
+        }
+        else if (arg == "--warmup" && hasValue && parseSize(argv[++i], v)) config.warmups = (int)v;
+        else if (arg == "--reps" && hasValue && parseSize(argv[++i], v) && v > 0) config.reps = (int)v;
+        else if (arg == "--min-bytes" && hasValue && parseSize(argv[++i], v)) config.minBytes = v;
+        else if (arg == "--threads" && hasValue && parseSize(argv[++i], v)) config.threads = (int)v;
+        else if (arg == "--json" && hasValue) jsonPath = argv[++i];
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    vector<BenchResult> results = runBenchmarkSuite(config, &cerr);
+    string json = benchmarkJson(config, results);
+    if (jsonPath.empty()) cout << json;
+    else {
+        ofstream out(jsonPath, ios::binary);
+        if (!(out << json)) { cerr << "cannot write " << jsonPath << "\n"; return 1; }
+    }
+    for (const BenchResult& r : results) if (!r.roundTrip) return 1;
+    return 0;
+}
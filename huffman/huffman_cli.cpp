@@ -0,0 +1,592 @@
+﻿// huffman_cli.cpp - command-line front end of the Huffman core
+// Build: C++17, links huffman_core (see CMakeLists.txt); no GUI dependencies.
+//
+//   huffman compress   [--blocks | --single | --adaptive | --bwt | --lz [--level N] | --dict FILE] [--block-size N] [--threads N] [--max-code-len N] <in|-> <out|->
+//   huffman decompress [--dict FILE]... <in|-> <out|->
+//   huffman info       [--dict FILE]... <file.huff | file.hdict>
+//   huffman train      [--module text|audio|video|any] [--max-code-len N] <out.hdict> <sample>...
+//   huffman bench      [size]
+//
+// "-" reads stdin / writes stdout. Sizes accept a K or M suffix. PCM WAV input is coded as
+// audio (v6), 8-bit Y4M input as video (v7) and BMP/PGM/PPM input as an image (v8) unless
+// --blocks or --single asks for a byte container. --bwt block-sorts the input first (v9, for
+// text; blocks of 900K unless --block-size says otherwise), --lz codes repeated strings as
+// matches (v10) at --level 1 (fastest) to 9 (smallest; 6 by default).
+//
+// Piped compression streams the block container; --single, --bwt, --lz, --dict and WAV/Y4M/
+// image input hold all of stdin in memory (a warning past 1G). Piped decompression holds the
+// compressed input in memory and writes a block container out block by block.
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "huffman_core.h"
+#include "efficiency.h"
+
+using namespace std;
+
+static void printUsage() {
+    cerr << "usage:\n"
+        << "  huffman compress [--blocks | --single | --adaptive | --bwt | --lz [--level N] | --dict FILE] [--block-size N] [--threads N] [--max-code-len N] <in|-> <out|->\n"
+        << "  huffman decompress [--dict FILE]... <in|-> <out|->\n"
+        << "  huffman info [--dict FILE]... <file.huff | file.hdict>\n"
+        << "  huffman train [--module text|audio|video|any] [--max-code-len N] <out.hdict> <sample>...\n"
+        << "  huffman bench [size]\n"
+        << "\"-\" is stdin/stdout; sizes take an optional K or M suffix\n"
+        << "stdin streams through the block container; the other formats, media input and\n"
+        << "decompress hold the whole (compressed) input in memory (a warning past 1G)\n";
+}
+
+// decimal number with an optional K/M suffix
+static bool parseSize(const char* text, uint64_t& value) {
+    char* end = nullptr;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (end == text) return false;
+    if (*end == 'k' || *end == 'K') { v <<= 10; end++; }
+    else if (*end == 'm' || *end == 'M') { v <<= 20; end++; }
+    if (*end != '\0') return false;
+    value = v;
+    return true;
+}
+
+static void setBinaryStdio() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+// past this much buffered stdin the user is told the input is held in memory
+const uint64_t PIPE_BUFFER_WARNING = 1ull << 30;
+
+// appends the rest of in to data: stdin cannot be rewound for the two-pass compressors
+static bool readRest(istream& in, vector<uint8_t>& data) {
+    bool warned = false;
+    char buf[1 << 16];
+    while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+        data.insert(data.end(), buf, buf + in.gcount());
+        if (!warned && &in == &cin && data.size() > PIPE_BUFFER_WARNING) {
+            cerr << "warning: this mode holds all of stdin in memory (over "
+                << (PIPE_BUFFER_WARNING >> 20) << "M so far); pass a file name to stream it\n";
+            warned = true;
+        }
+    }
+    return !in.bad();
+}
+
+// whole input in memory
+static bool readAll(const string& path, vector<uint8_t>& data) {
+    data.clear();
+    if (path == "-") return readRest(cin, data);
+    ifstream file(path, ios::binary);
+    return file && readRest(file, data);
+}
+
+static bool writeAll(const string& path, const vector<uint8_t>& data) {
+    ostream* out = &cout;
+    ofstream file;
+    if (path != "-") {
+        file.open(path, ios::binary);
+        if (!file) return false;
+        out = &file;
+    }
+    out->write(reinterpret_cast<const char*>(data.data()), data.size());
+    out->flush();
+    return (bool)*out;
+}
+
+// enough leading bytes for every signature looksLikeMedia knows
+const size_t MEDIA_SIGNATURE_SIZE = 12;
+
+// WAV, Y4M, BMP, PGM or PPM by signature alone: pipe input that may need the media coders
+static bool looksLikeMedia(const vector<uint8_t>& head) {
+    auto starts = [&head](const char* text, size_t at = 0) {
+        size_t n = strlen(text);
+        return head.size() >= at + n && memcmp(head.data() + at, text, n) == 0;
+    };
+    return (starts("RIFF") && starts("WAVE", 8)) || starts("YUV4MPEG2") || starts("BM") || starts("P5") || starts("P6");
+}
+
+static uint64_t fileSize(const string& path) {
+    ifstream in(path, ios::binary | ios::ate);
+    return in ? (uint64_t)in.tellg() : 0;
+}
+
+// loads and registers a dictionary named by --dict
+static bool loadDictionaryArg(const string& path, HuffDictionary& dict) {
+    if (loadDictionary(path, dict)) return true;
+    cerr << path << ": not a dictionary file (or damaged)\n";
+    return false;
+}
+
+// v4 frames name their dictionary by ID: tell the user which one is missing
+static bool reportMissingDictionary(const vector<uint8_t>& head) {
+    if (head.size() < 6 || head[0] != HUFF_SIGNATURE || head[1] != HUFF_FORMAT_DICT) return false;
+    uint32_t id = head[2] | (head[3] << 8) | (head[4] << 16) | ((uint32_t)head[5] << 24);
+    if (haveDictionary(id)) return false;
+    cerr << "needs dictionary " << hex << setw(8) << setfill('0') << id << dec << " (pass it with --dict)\n";
+    return true;
+}
+
+// the first bytes of a file, enough for its signature and a v4 dictionary ID
+static void readHead(const string& path, vector<uint8_t>& head) {
+    ifstream in(path, ios::binary);
+    head.resize(6);
+    in.read(reinterpret_cast<char*>(head.data()), head.size());
+    head.resize((size_t)in.gcount());
+}
+
+static int cmdCompress(int argc, char** argv) {
+    bool single = false; // v2 single stream instead of the block container
+    bool bytesOnly = false; // --blocks: the block container even for WAV, Y4M and image files
+    string dictPath;     // v4 frame with this dictionary's table
+    bool adaptive = false; // v5 one-pass stream
+    bool bwt = false;      // v9 block sorting
+    bool lz = false;       // v10 dictionary matches
+    uint64_t level = LZ_DEFAULT_LEVEL;
+    uint64_t blockSize = 0; // DEFAULT_BLOCK_SIZE, or BWT_BLOCK_SIZE with --bwt
+    uint64_t threads = 0;
+    uint64_t maxCodeLen = MAX_HEADER_CODE_LEN;
+    vector<string> paths;
+    // the mode options pick one format: a second, different one is a usage error
+    string mode, modeOption;
+    auto chooseMode = [&](const string& name, const string& option) {
+        if (!mode.empty() && mode != name) {
+            cerr << "conflicting options: " << modeOption << " and " << option << "\n";
+            printUsage();
+            return false;
+        }
+        mode = name;
+        modeOption = option;
+        return true;
+    };
+    for (int i = 0; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--blocks") {
+            if (!chooseMode("blocks", arg)) return 2;
+            bytesOnly = true;
+        }
+        else if (arg == "--single") {
+            if (!chooseMode("single", arg)) return 2;
+            single = true;
+        }
+        else if (arg == "--adaptive") {
+            if (!chooseMode("adaptive", arg)) return 2;
+            adaptive = true;
+        }
+        else if (arg == "--bwt") {
+            if (!chooseMode("bwt", arg)) return 2;
+            bwt = true;
+        }
+        else if (arg == "--lz") {
+            if (!chooseMode("lz", arg)) return 2;
+            lz = true;
+        }
+        else if (arg == "--level" && i + 1 < argc) {
+            if (!chooseMode("lz", arg)) return 2;
+            if (!parseSize(argv[++i], level) || level < 1 || level > (uint64_t)LZ_MAX_LEVEL) {
+                cerr << "level must be 1.." << LZ_MAX_LEVEL << "\n";
+                return 2;
+            }
+            lz = true;
+        }
+        else if (arg == "--dict" && i + 1 < argc) {
+            if (!chooseMode("dict", arg)) return 2;
+            dictPath = argv[++i];
+        }
+        else if (arg == "--block-size" && i + 1 < argc) {
+            if (!parseSize(argv[++i], blockSize)) { cerr << "bad block size: " << argv[i] << "\n"; return 2; }
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            if (!parseSize(argv[++i], threads)) { cerr << "bad thread count: " << argv[i] << "\n"; return 2; }
+        }
+        else if (arg == "--max-code-len" && i + 1 < argc) {
+            if (!parseSize(argv[++i], maxCodeLen) || maxCodeLen < 1 || maxCodeLen > (uint64_t)MAX_HEADER_CODE_LEN) {
+                cerr << "max code length must be 1.." << MAX_HEADER_CODE_LEN << "\n";
+                return 2;
+            }
+        }
+        else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') { cerr << "unknown option: " << arg << "\n"; return 2; }
+        else paths.push_back(arg);
+    }
+    if (paths.size() != 2) { printUsage(); return 2; }
+    const string& inPath = paths[0];
+    const string& outPath = paths[1];
+    if (blockSize == 0) blockSize = bwt ? BWT_BLOCK_SIZE : DEFAULT_BLOCK_SIZE;
+
+    bool ok;
+    if (adaptive) {
+        // one pass straight from input to output, pipes included: nothing is buffered
+        ifstream inFile;
+        ofstream outFile;
+        if (inPath != "-") inFile.open(inPath, ios::binary);
+        if (outPath != "-") outFile.open(outPath, ios::binary);
+        istream& in = inPath == "-" ? cin : inFile;
+        ostream& out = outPath == "-" ? cout : outFile;
+        if (!in) { cerr << "cannot read " << inPath << "\n"; return 1; }
+        ok = out && compressStreamAdaptive(in, out);
+    }
+    else if (!dictPath.empty()) {
+        // dictionary frames are meant for small payloads, built in memory
+        HuffDictionary dict;
+        if (!loadDictionaryArg(dictPath, dict)) return 1;
+        vector<uint8_t> data, packed;
+        if (!readAll(inPath, data)) { cerr << "cannot read " << inPath << "\n"; return 1; }
+        ok = compressWithDictionary(ByteSpan{ data.data(), data.size() }, dict, packed) && writeAll(outPath, packed);
+    }
+    else if (inPath == "-" || outPath == "-") {
+        // pipes: the block container streams a batch of blocks at a time (index at the end);
+        // v2, v9, v10 and WAV/Y4M/image input (known by its first bytes) go through memory
+        ifstream inFile;
+        ofstream outFile;
+        if (inPath != "-") inFile.open(inPath, ios::binary);
+        if (outPath != "-") outFile.open(outPath, ios::binary);
+        istream& in = inPath == "-" ? cin : inFile;
+        ostream& out = outPath == "-" ? cout : outFile;
+        if (!in) { cerr << "cannot read " << inPath << "\n"; return 1; }
+        vector<uint8_t> data(MEDIA_SIGNATURE_SIZE);
+        in.read(reinterpret_cast<char*>(data.data()), data.size());
+        data.resize((size_t)in.gcount());
+        if (!bwt && !lz && !single && (bytesOnly || !looksLikeMedia(data)))
+            ok = out && compressStreamBlocks(in, out, ByteSpan{ data.data(), data.size() }, (size_t)blockSize,
+                (int)threads, (int)maxCodeLen);
+        else {
+            vector<uint8_t> packed;
+            if (!readRest(in, data)) { cerr << "cannot read " << inPath << "\n"; return 1; }
+            ThreadPool pool((int)threads);
+            ByteSpan span{ data.data(), data.size() };
+            ok = true;
+            if (bwt) compressBwt(span, packed, pool, (size_t)blockSize);
+            else if (lz) compressLz(span, packed, pool, (int)level, (size_t)blockSize);
+            else if (single) ok = compress(span, packed, (int)maxCodeLen);
+            else if (!compressAudio(span, packed, pool) && !compressVideo(span, packed, pool) && !compressImage(span, packed, pool))
+                compressBlocks(data.data(), data.size(), packed, pool, (size_t)blockSize, (int)maxCodeLen);
+            if (ok) {
+                out.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+                out.flush();
+                ok = (bool)out;
+            }
+        }
+    }
+    else {
+        uint64_t freqs[256] = { 0 };
+        uint64_t origBytes = 0;
+        // the container even for one block: only its blocks can use the order-1 context model
+        if (bwt) ok = compressFileBwt(inPath, outPath, freqs, origBytes, (size_t)blockSize, (int)threads);
+        else if (lz) ok = compressFileLz(inPath, outPath, freqs, origBytes, (int)level, (size_t)blockSize, (int)threads);
+        else if (single) ok = compressFileStreaming(inPath, outPath, freqs, origBytes, (int)maxCodeLen);
+        else if (!bytesOnly && isPcmWavFile(inPath)) ok = compressFileAudio(inPath, outPath, freqs, origBytes, (int)threads);
+        else if (!bytesOnly && isY4mFile(inPath)) ok = compressFileVideo(inPath, outPath, freqs, origBytes, (int)threads);
+        else if (!bytesOnly && isImageFile(inPath)) ok = compressFileImage(inPath, outPath, freqs, origBytes, (int)threads);
+        else ok = compressFileBlocks(inPath, outPath, freqs, origBytes, (size_t)blockSize, (int)threads, (int)maxCodeLen);
+    }
+    if (!ok) { cerr << "compression failed\n"; return 1; }
+    return 0;
+}
+
+// --dict FILE options (any number) are loaded into the dictionary registry
+static bool takeDictionaries(int& argc, char**& argv) {
+    HuffDictionary dict;
+    while (argc >= 2 && string(argv[0]) == "--dict") {
+        if (!loadDictionaryArg(argv[1], dict)) return false;
+        argc -= 2;
+        argv += 2;
+    }
+    return true;
+}
+
+static int cmdDecompress(int argc, char** argv) {
+    if (!takeDictionaries(argc, argv)) return 1;
+    if (argc != 2) { printUsage(); return 2; }
+    string inPath = argv[0], outPath = argv[1];
+    bool ok;
+    vector<uint8_t> head;
+    if (inPath == "-" || outPath == "-") {
+        // the compressed input is held in memory (a block container's index is at its end);
+        // block containers are written out one block at a time
+        vector<uint8_t> data;
+        if (!readAll(inPath, data)) { cerr << "cannot read " << inPath << "\n"; return 1; }
+        ofstream outFile;
+        if (outPath != "-") outFile.open(outPath, ios::binary);
+        ostream& out = outPath == "-" ? cout : outFile;
+        ok = out && decompressToStream(ByteSpan{ data.data(), data.size() }, out);
+        out.flush();
+        ok = ok && (bool)out;
+        head.assign(data.begin(), data.begin() + min<size_t>(data.size(), 6));
+    }
+    else {
+        ok = readCompressedAndDecode(inPath, outPath);
+        readHead(inPath, head);
+    }
+    if (!ok && reportMissingDictionary(head)) return 1;
+    if (!ok) { cerr << "decompression failed (not a .huff file or truncated)\n"; return 1; }
+    return 0;
+}
+
+static int cmdInfo(int argc, char** argv) {
+    if (!takeDictionaries(argc, argv)) return 1;
+    if (argc != 1) { printUsage(); return 2; }
+    string path = argv[0];
+    uint64_t size = fileSize(path);
+    vector<uint8_t> head;
+    readHead(path, head);
+    if (head.size() >= 2 && head[0] == HUFF_SIGNATURE && head[1] == HUFF_DICTIONARY_FILE) {
+        HuffDictionary dict;
+        if (!loadDictionaryArg(path, dict)) return 1;
+        int shortest = 255, longest = 0;
+        for (int i = 0; i < 256; i++) {
+            shortest = min<int>(shortest, dict.lens[i]);
+            longest = max<int>(longest, dict.lens[i]);
+        }
+        cout << "file:          " << path << " (" << size << " bytes)\n";
+        cout << "format:        dictionary " << hex << setw(8) << setfill('0') << dict.id << dec << setfill(' ')
+            << " (" << dictionaryModuleName(dict.module) << " module)\n";
+        cout << "codes:         " << shortest << "-" << longest << " bits\n";
+        return 0;
+    }
+    ifstream in(path, ios::binary);
+    HuffHeader h;
+    if (!in || !readHuffHeader(in, h)) {
+        if (!reportMissingDictionary(head)) cerr << path << ": not a .huff file\n";
+        return 1;
+    }
+
+    cout << "file:          " << path << " (" << size << " bytes)\n";
+    cout << "format:        v" << h.version;
+    if (h.version == 1) cout << " (frequency table)\n";
+    else if (h.version == HUFF_FORMAT_V2) cout << " (single stream, canonical codes)\n";
+    else if (h.version == HUFF_FORMAT_DICT) cout << " (dictionary frame)\n";
+    else if (h.version == HUFF_FORMAT_ADAPTIVE) cout << " (adaptive, FGK)\n";
+    else if (h.version == HUFF_FORMAT_AUDIO) cout << " (PCM audio, predicted samples)\n";
+    else if (h.version == HUFF_FORMAT_VIDEO) cout << " (raw video, predicted planes)\n";
+    else if (h.version == HUFF_FORMAT_IMAGE) cout << " (raster image, filtered rows)\n";
+    else if (h.version == HUFF_FORMAT_BWT) cout << " (block sorting, BWT + move-to-front)\n";
+    else if (h.version == HUFF_FORMAT_LZ) cout << " (dictionary matches, LZ77)\n";
+    else cout << " (block container)\n";
+
+    int symbols = 0, maxLen = 0;
+    for (int i = 0; i < 256; i++) {
+        if (h.version == 1 ? h.freqs[i] != 0 : h.lens[i] != 0) symbols++;
+        if (h.lens[i] > maxLen) maxLen = h.lens[i];
+    }
+    uint64_t rawSize = 0;
+    if (h.version == 1) {
+        for (int i = 0; i < 256; i++) rawSize += h.freqs[i];
+        cout << "symbols:       " << symbols << " distinct\n";
+        cout << "payload bits:  " << h.totalBits << "\n";
+    }
+    else if (h.version == HUFF_FORMAT_V2 && (h.flags & HUFF_FLAG_STORED)) {
+        rawSize = h.symbolCount;
+        cout << "payload:       stored (incompressible, no code table)\n";
+    }
+    else if (h.version == HUFF_FORMAT_ADAPTIVE) {
+        // the size is only known once the stream is decoded
+        vector<uint8_t> data;
+        if (!readAll(path, data) || !decompressedSize(ByteSpan{ data.data(), data.size() }, rawSize)) {
+            cerr << path << ": truncated adaptive stream\n";
+            return 1;
+        }
+    }
+    else if (h.version == HUFF_FORMAT_AUDIO) {
+        vector<uint8_t> data;
+        AudioSummary audio;
+        if (!readAll(path, data) || !summarizeAudio(ByteSpan{ data.data(), data.size() }, audio)) {
+            cerr << path << ": damaged audio file\n";
+            return 1;
+        }
+        rawSize = audio.rawSize;
+        cout << "audio:         " << audio.channels << " channels, " << 8 * audio.sampleBytes << "-bit samples\n";
+        cout << "blocks:        " << audio.blocks << " x " << audio.blockFrames << " frames (";
+        if (audio.channels == 2)
+            cout << audio.blocksByMode[AUDIO_LEFT_RIGHT] << " left/right, " << audio.blocksByMode[AUDIO_LEFT_SIDE]
+                << " left/side, " << audio.blocksByMode[AUDIO_SIDE_RIGHT] << " side/right, "
+                << audio.blocksByMode[AUDIO_MID_SIDE] << " mid/side, ";
+        cout << audio.storedBlocks << " stored)\n";
+    }
+    else if (h.version == HUFF_FORMAT_VIDEO) {
+        vector<uint8_t> data;
+        VideoSummary video;
+        if (!readAll(path, data) || !summarizeVideo(ByteSpan{ data.data(), data.size() }, video)) {
+            cerr << path << ": damaged video file\n";
+            return 1;
+        }
+        rawSize = video.rawSize;
+        cout << "video:         " << video.width[0] << "x" << video.height[0];
+        if (video.planes > 1) cout << ", chroma " << video.width[1] << "x" << video.height[1];
+        if (video.planes > 3) cout << ", alpha";
+        cout << "\n";
+        cout << "frames:        " << video.frames << " (keyframe every " << video.keyframeInterval << ")\n";
+        cout << "planes:        " << video.planesByPrediction[VIDEO_RAW] << " raw, "
+            << video.planesByPrediction[VIDEO_SPATIAL] << " spatial, " << video.planesByPrediction[VIDEO_TEMPORAL]
+            << " temporal, " << video.planesByPrediction[VIDEO_TEMPORAL_SPATIAL] << " temporal+spatial\n";
+    }
+    else if (h.version == HUFF_FORMAT_IMAGE) {
+        vector<uint8_t> data;
+        ImageSummary image;
+        if (!readAll(path, data) || !summarizeImage(ByteSpan{ data.data(), data.size() }, image)) {
+            cerr << path << ": damaged image file\n";
+            return 1;
+        }
+        rawSize = image.rawSize;
+        const char* kind = image.kind == IMAGE_BMP ? "BMP" : image.channels == 1 ? "PGM" : "PPM";
+        cout << "image:         " << kind << ", " << image.width << "x" << image.height << ", " << image.channels
+            << (image.channels == 1 ? " channel\n" : " channels\n");
+        cout << "rows:          " << image.rowsByFilter[IMAGE_FILTER_NONE] << " none, " << image.rowsByFilter[IMAGE_FILTER_SUB]
+            << " sub, " << image.rowsByFilter[IMAGE_FILTER_UP] << " up, " << image.rowsByFilter[IMAGE_FILTER_AVERAGE]
+            << " average, " << image.rowsByFilter[IMAGE_FILTER_PAETH] << " Paeth (" << image.blocks << " blocks)\n";
+    }
+    else if (h.version == HUFF_FORMAT_BWT) {
+        vector<uint8_t> data;
+        BwtSummary bwt;
+        if (!readAll(path, data) || !summarizeBwt(ByteSpan{ data.data(), data.size() }, bwt)) {
+            cerr << path << ": damaged block index\n";
+            return 1;
+        }
+        rawSize = bwt.rawSize;
+        cout << "blocks:        " << bwt.blocks << " x " << bwt.blockSize << " bytes (" << bwt.untransformed
+            << " untransformed)\n";
+        cout << "symbols:       " << bwt.symbols << " after move-to-front and zero runs\n";
+    }
+    else if (h.version == HUFF_FORMAT_LZ) {
+        vector<uint8_t> data;
+        LzSummary lzInfo;
+        if (!readAll(path, data) || !summarizeLz(ByteSpan{ data.data(), data.size() }, lzInfo)) {
+            cerr << path << ": damaged block index\n";
+            return 1;
+        }
+        rawSize = lzInfo.rawSize;
+        cout << "blocks:        " << lzInfo.blocks << " x " << lzInfo.blockSize << " bytes\n";
+        cout << "sequences:     " << lzInfo.matches << " matches, " << lzInfo.literals << " literal bytes\n";
+    }
+    else if (h.version == HUFF_FORMAT_DICT) {
+        rawSize = h.symbolCount;
+        cout << "dictionary:    " << hex << setw(8) << setfill('0') << h.dictId << dec << setfill(' ') << "\n";
+    }
+    else if (h.version == HUFF_FORMAT_V2) {
+        rawSize = h.symbolCount;
+        cout << "symbols:       " << symbols << " distinct, longest code " << maxLen << " bits\n";
+        cout << "table layout:  " << ((h.flags & HUFF_FLAG_BITMAP_TABLE) ? "bitmap" : "sparse") << "\n";
+    }
+    else {
+        ifstream container;
+        vector<SeekEntry> table;
+        if (!openBlockContainer(path, container, table)) { cerr << path << ": damaged block index\n"; return 1; }
+        uint64_t fourStreamBlocks = 0, contextBlocks = 0, storedBlocks = 0, runsBlocks = 0;
+        for (size_t b = 0; b < table.size(); b++) rawSize += table[b].rawSize;
+        // each block's flags byte is the first byte of its stream header
+        for (size_t b = 0; b < table.size(); b++) {
+            container.seekg((streamoff)table[b].fileOffset);
+            int flags = container.get();
+            if (flags != EOF && (flags & HUFF_FLAG_FOUR_STREAMS)) fourStreamBlocks++;
+            if (flags != EOF && (flags & HUFF_FLAG_CONTEXT)) contextBlocks++;
+            if (flags != EOF && (flags & HUFF_FLAG_STORED)) storedBlocks++;
+            if (flags != EOF && (flags & HUFF_FLAG_RUNS)) runsBlocks++;
+        }
+        cout << "blocks:        " << table.size();
+        if (!table.empty()) cout << " x " << table[0].rawSize << " bytes";
+        cout << " (" << fourStreamBlocks << " with four interleaved streams, " << contextBlocks << " order-1, "
+            << storedBlocks << " stored, " << runsBlocks << " run-length)\n";
+        if (!table.empty()) {
+            if (h.flags & HUFF_FLAG_STORED) cout << "first block:   stored\n";
+            else if (h.flags & HUFF_FLAG_RUNS) cout << "first block:   run-length tokens\n";
+            else cout << "first block:   " << symbols << " distinct symbols, longest code " << maxLen << " bits"
+                << ((h.flags & HUFF_FLAG_CONTEXT) ? " (context group 0)" : "") << "\n";
+        }
+    }
+    cout << "original size: " << rawSize << " bytes\n";
+    if (rawSize > 0)
+        cout << "ratio:         " << fixed << setprecision(2) << 100.0 * size / rawSize << "%\n";
+    return 0;
+}
+
+// one histogram over every sample file
+static int cmdTrain(int argc, char** argv) {
+    uint8_t module = DICT_ANY;
+    uint64_t maxCodeLen = MAX_HEADER_CODE_LEN;
+    vector<string> paths;
+    for (int i = 0; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--module" && i + 1 < argc) {
+            if (!parseDictionaryModule(argv[++i], module)) { cerr << "unknown module: " << argv[i] << "\n"; return 2; }
+        }
+        else if (arg == "--max-code-len" && i + 1 < argc) {
+            if (!parseSize(argv[++i], maxCodeLen) || maxCodeLen < (uint64_t)MIN_DICT_CODE_LEN ||
+                maxCodeLen > (uint64_t)MAX_HEADER_CODE_LEN) {
+                cerr << "max code length must be " << MIN_DICT_CODE_LEN << ".." << MAX_HEADER_CODE_LEN << "\n";
+                return 2;
+            }
+        }
+        else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') { cerr << "unknown option: " << arg << "\n"; return 2; }
+        else paths.push_back(arg);
+    }
+    if (paths.size() < 2) { printUsage(); return 2; }
+
+    vector<vector<uint8_t>> corpus(paths.size() - 1);
+    vector<ByteSpan> samples;
+    uint64_t total = 0;
+    for (size_t i = 1; i < paths.size(); i++) {
+        if (!readAll(paths[i], corpus[i - 1])) { cerr << "cannot read " << paths[i] << "\n"; return 1; }
+        samples.push_back(ByteSpan{ corpus[i - 1].data(), corpus[i - 1].size() });
+        total += corpus[i - 1].size();
+    }
+    HuffDictionary dict;
+    trainDictionary(samples, module, (int)maxCodeLen, dict);
+    if (!saveDictionary(paths[0], dict)) { cerr << "cannot write " << paths[0] << "\n"; return 1; }
+
+    uint64_t bits = 0;
+    for (const ByteSpan& sample : samples)
+        for (size_t i = 0; i < sample.size; i++) bits += dict.lens[sample.data[i]];
+    cout << "dictionary " << hex << setw(8) << setfill('0') << dict.id << dec << setfill(' ') << " ("
+        << dictionaryModuleName(module) << " module) from " << total << " bytes in " << samples.size() << " files";
+    if (total > 0) cout << ", " << fixed << setprecision(2) << (double)bits / total << " bits/byte on the samples";
+    cout << "\n";
+    return 0;
+}
+
+static int cmdBench(int argc, char** argv) {
+    uint64_t size = 16 << 20;
+    if (argc > 1 || (argc == 1 && !parseSize(argv[0], size))) { printUsage(); return 2; }
+    // the benchmarks hold a few copies of the data at once
+    if (size > SIZE_MAX / 4) { cerr << "bench size too large: " << argv[0] << "\n"; return 2; }
+
+    vector<TimeMeasurement> measurements;
+    int testSizes[] = { 1000, 10000, 100000, 1000000 };
+    cout << "Size\tBuild(ms)\tEncode(ms)\tDecode(ms)\tRatio\n";
+    for (int n : testSizes) {
+        TimeMeasurement m = runEfficiencyTest(n, true);
+        measurements.push_back(m);
+        cout << n << "\t" << fixed << setprecision(3) << m.buildTreeTime << "\t\t" << m.encodingTime << "\t\t"
+            << m.decodingTime << "\t\t" << setprecision(2) << m.compressionRatio * 100 << "%"
+            << (m.roundTrip ? "" : " (decode MISMATCH)") << "\n";
+    }
+    cout << "\n" << calculateBigOAnalysis(measurements) << "\n\n";
+    cout << benchmarkBlockScaling((size_t)size) << "\n";
+    cout << benchmarkStreamInterleaving((size_t)size) << "\n";
+    cout << benchmarkAdaptive((size_t)size);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) { printUsage(); return 2; }
+    setBinaryStdio();
+    string cmd = argv[1];
+    if (cmd == "compress" || cmd == "c") return cmdCompress(argc - 2, argv + 2);
+    if (cmd == "decompress" || cmd == "d") return cmdDecompress(argc - 2, argv + 2);
+    if (cmd == "info") return cmdInfo(argc - 2, argv + 2);
+    if (cmd == "train") return cmdTrain(argc - 2, argv + 2);
+    if (cmd == "bench") return cmdBench(argc - 2, argv + 2);
+    printUsage();
+    return 2;
+}
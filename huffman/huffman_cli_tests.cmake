@@ -0,0 +1,80 @@
+# huffman_cli_tests.cmake - command-line regression tests (run by ctest)
+#   cmake -DHUFFMAN=<path to huffman> -DWORK_DIR=<scratch directory> -P huffman_cli_tests.cmake
+
+function(run_huffman input output)
+  execute_process(COMMAND "${HUFFMAN}" ${ARGN}
+    INPUT_FILE "${input}" OUTPUT_FILE "${output}" RESULT_VARIABLE rc)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "huffman ${ARGN} < ${input} failed (${rc})")
+  endif()
+endfunction()
+
+# empty input through the pipe path: compress writes an empty block container, which
+# decompress - - must accept
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(WRITE "${WORK_DIR}/empty" "")
+run_huffman("${WORK_DIR}/empty" "${WORK_DIR}/empty.huff" compress - -)
+run_huffman("${WORK_DIR}/empty.huff" "${WORK_DIR}/empty.out" decompress - -)
+file(SIZE "${WORK_DIR}/empty.out" size)
+if(NOT size EQUAL 0)
+  message(FATAL_ERROR "empty pipe round trip produced ${size} bytes")
+endif()
+
+# --single writes a v2 stream on the pipe path too
+file(WRITE "${WORK_DIR}/text" "the quick brown fox jumps over the lazy dog\n")
+run_huffman("${WORK_DIR}/text" "${WORK_DIR}/text.huff" compress --single - -)
+file(READ "${WORK_DIR}/text.huff" head LIMIT 2 HEX)
+if(NOT head STREQUAL "4802")
+  message(FATAL_ERROR "compress --single - - wrote a file starting with ${head}, not a v2 stream")
+endif()
+run_huffman("${WORK_DIR}/text.huff" "${WORK_DIR}/text.out" decompress - -)
+file(READ "${WORK_DIR}/text" original)
+file(READ "${WORK_DIR}/text.out" decoded)
+if(NOT original STREQUAL decoded)
+  message(FATAL_ERROR "--single pipe round trip differs")
+endif()
+
+# a multi-block input streamed through stdin/stdout gives the same container as the file path
+# (blocks written as they are coded, index at the end) and decompresses back block by block
+string(REPEAT "line of a piped log, block after block; " 8000 lines)
+file(WRITE "${WORK_DIR}/blocks" "${lines}")
+run_huffman("${WORK_DIR}/blocks" "${WORK_DIR}/blocks.pipe.huff" compress --block-size 64K - -)
+execute_process(COMMAND "${HUFFMAN}" compress --block-size 64K "${WORK_DIR}/blocks" "${WORK_DIR}/blocks.file.huff"
+  RESULT_VARIABLE rc)
+file(SHA256 "${WORK_DIR}/blocks.pipe.huff" piped)
+file(SHA256 "${WORK_DIR}/blocks.file.huff" direct)
+if(NOT rc EQUAL 0 OR NOT piped STREQUAL direct)
+  message(FATAL_ERROR "streamed pipe compression differs from the file path")
+endif()
+run_huffman("${WORK_DIR}/blocks.pipe.huff" "${WORK_DIR}/blocks.out" decompress - -)
+file(SHA256 "${WORK_DIR}/blocks.out" blocks_out)
+file(SHA256 "${WORK_DIR}/blocks" blocks_in)
+if(NOT blocks_out STREQUAL blocks_in)
+  message(FATAL_ERROR "multi-block pipe round trip differs")
+endif()
+
+# a v4 frame decodes only with its dictionary: without --dict the error names the missing one
+execute_process(COMMAND "${HUFFMAN}" train "${WORK_DIR}/text.hdict" "${WORK_DIR}/blocks" RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0)
+  message(FATAL_ERROR "train failed (${rc})")
+endif()
+run_huffman("${WORK_DIR}/text" "${WORK_DIR}/text.v4" compress --dict "${WORK_DIR}/text.hdict" - -)
+execute_process(COMMAND "${HUFFMAN}" decompress "${WORK_DIR}/text.v4" "${WORK_DIR}/text.v4.out"
+  RESULT_VARIABLE rc ERROR_VARIABLE err)
+if(NOT rc EQUAL 1 OR NOT err MATCHES "needs dictionary [0-9a-f]+ \\(pass it with --dict\\)")
+  message(FATAL_ERROR "decompress without the dictionary: rc ${rc}, ${err}")
+endif()
+run_huffman("${WORK_DIR}/text.v4" "${WORK_DIR}/text.v4.out" decompress --dict "${WORK_DIR}/text.hdict" - -)
+file(READ "${WORK_DIR}/text.v4.out" decoded)
+if(NOT original STREQUAL decoded)
+  message(FATAL_ERROR "dictionary pipe round trip differs")
+endif()
+
+# two different format options are a usage error
+foreach(options "--bwt;--lz" "--adaptive;--dict;x.hdict" "--single;--lz" "--single;--level;3")
+  execute_process(COMMAND "${HUFFMAN}" compress ${options} "${WORK_DIR}/text" "${WORK_DIR}/conflict.huff"
+    RESULT_VARIABLE rc OUTPUT_QUIET ERROR_QUIET)
+  if(NOT rc EQUAL 2)
+    message(FATAL_ERROR "compress ${options} exited with ${rc}, not a usage error")
+  endif()
+endforeach()
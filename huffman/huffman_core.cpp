@@ -0,0 +1,5109 @@
+﻿// huffman_core.cpp - Huffman compression core: trees, canonical codes, file formats,
+// block container and decoders. No GUI code lives here.
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "huffman_core.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <array>
+#include <map>
+#include <atomic>
+
+using namespace std;
+
+// HUFFMAN CORE LOGIC
+
+// BinaryHeap over the node indices of a HuffmanTree
+class BinaryHeap {
+    const HuffmanTree& tree; // heap entries are node indices, ordered by tree[i].freq
+    uint16_t arr[MAX_TREE_NODES + 2]; // 1-based indexing
+    int rear;
+    int capacity;
+    int h;
+
+    uint64_t freqAt(int i) const { return tree[arr[i]].freq; }
+
+    void swapNodes(int i, int j) {
+        uint16_t temp = arr[i];
+        arr[i] = arr[j];
+        arr[j] = temp;
+    }
+
+public:
+    BinaryHeap(const HuffmanTree& tree, int capacity) : tree(tree) {
+        this->capacity = min(capacity, MAX_TREE_NODES + 2);
+        rear = 0;
+        h = -1;
+    }
+
+    void updateHeight() {
+        if (rear == 0) h = -1;
+        else h = (int)floor(log2((double)rear));
+    }
+
+    bool isEmpty()
+    {
+        return rear == 0;
+    }
+    int size()
+    {
+        return rear;
+    }
+    int getHeight()
+    {
+        return h;
+    }
+
+    uint16_t top() { // min element
+        if (rear == 0) return NO_NODE;
+        return arr[1];
+    }
+
+    void push(uint16_t node) { //pushing new node into the binary heap
+        if (rear + 1 >= capacity) return;
+        arr[++rear] = node;
+        int i = rear;
+        while (i > 1 && freqAt(i) < freqAt(i / 2)) {//heapify up
+            swapNodes(i, i / 2);
+            i /= 2;
+        }
+        updateHeight();
+    }
+
+    uint16_t pop() {
+        if (rear == 0) return NO_NODE;
+        uint16_t minNode = arr[1]; //root node popped 
+        arr[1] = arr[rear--];// move last node to root
+        int i = 1;
+        while (true) {//heapify down
+            int left = 2 * i, right = 2 * i + 1;
+            int smallest = i;
+            if (left <= rear && freqAt(left) < freqAt(smallest)) smallest = left;
+            if (right <= rear && freqAt(right) < freqAt(smallest)) smallest = right;
+            if (smallest == i) break;
+            swapNodes(i, smallest);
+            i = smallest;
+        }
+        updateHeight();
+        return minNode;
+    }
+};
+
+/*
+      Fuctional Module 1: Frequency & Tree
+*/
+
+/*
+ Histogram
+ With a single table, runs of the same byte stall: every increment waits for the store of
+ the previous one to the same counter. Eight sub-histograms with 32-bit counters take
+ consecutive bytes, so repeats land in different tables, and are summed at the end.
+ Large buffers are also split across threads.
+*/
+const int HISTOGRAM_BANKS = 8;
+const size_t HISTOGRAM_RUN = (size_t)1 << 30;     // per-bank counters stay far below 2^32 within a run
+const size_t HISTOGRAM_PARALLEL_MIN = 8 << 20;    // smaller buffers are not worth starting threads
+
+typedef uint32_t HistogramBanks[HISTOGRAM_BANKS][256];
+
+inline void countWord(uint64_t w, HistogramBanks banks) {
+    banks[0][w & 0xFF]++;
+    banks[1][(w >> 8) & 0xFF]++;
+    banks[2][(w >> 16) & 0xFF]++;
+    banks[3][(w >> 24) & 0xFF]++;
+    banks[4][(w >> 32) & 0xFF]++;
+    banks[5][(w >> 40) & 0xFF]++;
+    banks[6][(w >> 48) & 0xFF]++;
+    banks[7][w >> 56]++;
+}
+
+void histogramBanked(const uint8_t* data, size_t n, HistogramBanks banks) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint64_t a, b;
+        memcpy(&a, data + i, 8);
+        memcpy(&b, data + i + 8, 8);
+        countWord(a, banks);
+        countWord(b, banks);
+    }
+    for (; i < n; i++) banks[i & 7][data[i]]++;
+}
+
+// single-threaded count, added to freqs
+void countFrequenciesSerial(const uint8_t* data, size_t n, uint64_t freqs[256]) {
+    HistogramBanks banks;
+    for (size_t start = 0; start < n; start += HISTOGRAM_RUN) {
+        size_t len = min(HISTOGRAM_RUN, n - start);
+        memset(banks, 0, sizeof(banks));
+        histogramBanked(data + start, len, banks);
+        for (int c = 0; c < 256; c++) {
+            uint64_t total = 0;
+            for (int b = 0; b < HISTOGRAM_BANKS; b++) total += banks[b][c];
+            freqs[c] += total;
+        }
+    }
+}
+
+// the one frequency counter: adds the byte counts of data[0, n) to freqs.
+// threads: 0 = one per hardware thread for large buffers, 1 = stay on the calling thread
+void countFrequencies(const uint8_t* data, size_t n, uint64_t freqs[256], int threads) {
+    if (threads <= 0) threads = (int)thread::hardware_concurrency();
+    size_t parts = min((size_t)max(threads, 1), n / (HISTOGRAM_PARALLEL_MIN / 2));
+    if (n < HISTOGRAM_PARALLEL_MIN || parts < 2) {
+        countFrequenciesSerial(data, n, freqs);
+        return;
+    }
+    vector<array<uint64_t, 256>> partial(parts);
+    vector<thread> workers;
+    size_t partSize = (n + parts - 1) / parts;
+    for (size_t p = 0; p < parts; p++) {
+        partial[p].fill(0);
+        size_t start = p * partSize;
+        workers.emplace_back(countFrequenciesSerial, data + start, min(partSize, n - start), partial[p].data());
+    }
+    for (size_t p = 0; p < parts; p++) {
+        workers[p].join();
+        for (int c = 0; c < 256; c++) freqs[c] += partial[p][c];
+    }
+}
+
+// builds into tree (cleared first); false if no symbol occurs
+bool buildHuffmanTree(unsigned char bytes[], uint64_t freqs[], int uniqueCount, HuffmanTree& tree) {
+    tree.clear();
+    BinaryHeap minHeap(tree, uniqueCount + 5); // create minheap with extra space
+    for (int i = 0; i < uniqueCount; ++i) {
+        if (freqs[bytes[i]] > 0) {
+            minHeap.push(tree.addLeaf(bytes[i], freqs[bytes[i]]));
+        }
+    }
+
+    if (minHeap.size() == 0) return false;
+    // edge-case: only one unique symbol: create dummy sibling
+    if (minHeap.size() == 1) {
+        uint16_t only = minHeap.pop();
+        uint16_t dummy = tree.addLeaf((unsigned char)0, 0);
+        minHeap.push(tree.addInternal(only, dummy));
+    }
+
+    while (minHeap.size() > 1) {
+        uint16_t l = minHeap.pop();
+        uint16_t r = minHeap.pop();
+        minHeap.push(tree.addInternal(l, r));
+    }
+    tree.root = minHeap.pop();
+    return true;
+}
+
+/*
+ Canonical codes
+ Only the code length of each symbol is needed: codes of equal length are consecutive
+ binary numbers in symbol order, and shorter codes come first.
+*/
+// storing codes in a flat 256-entry table indexed by byte: O(1) lookup without hashing or strings
+// (codes must be zeroed by the caller; returns false if a path is longer than 64 bits)
+bool storeCodesTable(const HuffmanTree& tree, uint16_t node, HuffCode codes[256], uint64_t bits, int depth) {
+    if (node == NO_NODE) return true;
+
+    if (tree.isLeaf(node)) {
+        codes[tree[node].data].bits = bits;
+        codes[tree[node].data].len = (uint8_t)depth;
+        return true;
+    }
+    if (depth >= 64) return false;
+
+    bool ok = storeCodesTable(tree, tree[node].left, codes, bits << 1, depth + 1);
+    return storeCodesTable(tree, tree[node].right, codes, (bits << 1) | 1, depth + 1) && ok;
+}
+
+// code length of every symbol that occurs (freqs > 0); the dummy sibling gets no length
+void computeCodeLengths(const HuffmanTree& tree, uint16_t node, const uint64_t freqs[256], uint8_t lens[256], int depth) {
+    if (node == NO_NODE) return;
+    if (tree.isLeaf(node)) {
+        if (freqs[tree[node].data] > 0) lens[tree[node].data] = (uint8_t)(depth > 255 ? 255 : depth);
+        return;
+    }
+    computeCodeLengths(tree, tree[node].left, freqs, lens, depth + 1);
+    computeCodeLengths(tree, tree[node].right, freqs, lens, depth + 1);
+}
+
+/*
+ Length-limited codes (package-merge)
+ Optimal code lengths under a maximum length. Level maxLen holds the symbols sorted by
+ frequency; every level above merges the symbols with pairs ("packages") of the level below.
+ Picking the cheapest 2n-2 items of the top level and expanding the chosen packages level
+ by level gives each symbol its code length: the number of levels it was picked on.
+*/
+struct MergeItem {
+    uint64_t weight;
+    int symbol; // -1 for a package
+};
+
+// returns the limit actually used: raised to the smallest length that fits every symbol
+int buildLengthLimitedCodes(const uint64_t freqs[256], int maxLen, uint8_t lens[256]) {
+    memset(lens, 0, 256);
+    MergeItem leaves[256];
+    int n = 0;
+    for (int i = 0; i < 256; i++) if (freqs[i] > 0) leaves[n++] = MergeItem{ freqs[i], i };
+    if (n == 0) return maxLen;
+    if (n == 1) { // same as the dummy-sibling tree: a single 1-bit code
+        lens[leaves[0].symbol] = 1;
+        return maxLen;
+    }
+    while (maxLen < 8 && (1 << maxLen) < n) ++maxLen; // 256 symbols always fit in 8 bits
+    // ties in symbol order (a stable sort, without its scratch buffer)
+    sort(leaves, leaves + n, [](const MergeItem& a, const MergeItem& b) {
+        return a.weight != b.weight ? a.weight < b.weight : a.symbol < b.symbol;
+    });
+
+    // no code needs more than n - 1 bits, so deeper levels would not change the result. A level
+    // holds at most 2n - 1 items; up to MAX_HEADER_CODE_LEN levels live on the stack.
+    int depth = min(maxLen, n - 1);
+    const size_t width = 2 * (size_t)n;
+    MergeItem stackLevels[MAX_HEADER_CODE_LEN * 512];
+    vector<MergeItem> heapLevels;
+    MergeItem* levels = stackLevels;
+    if (depth > MAX_HEADER_CODE_LEN) {
+        heapLevels.resize(depth * width);
+        levels = heapLevels.data();
+    }
+    size_t levelSize[256];
+
+    // level 0 is the top level (code length 1), level depth - 1 holds only the leaves
+    memcpy(levels + (depth - 1) * width, leaves, n * sizeof(MergeItem));
+    levelSize[depth - 1] = n;
+    for (int d = depth - 2; d >= 0; d--) {
+        const MergeItem* below = levels + (d + 1) * width;
+        size_t belowSize = levelSize[d + 1];
+        MergeItem* level = levels + d * width;
+        size_t size = 0;
+        int li = 0;
+        size_t pi = 0;
+        while (li < n || pi + 1 < belowSize) {
+            bool takeLeaf = pi + 1 >= belowSize ||
+                (li < n && leaves[li].weight <= below[pi].weight + below[pi + 1].weight);
+            if (takeLeaf) level[size++] = leaves[li++];
+            else {
+                level[size++] = MergeItem{ below[pi].weight + below[pi + 1].weight, -1 };
+                pi += 2;
+            }
+        }
+        levelSize[d] = size;
+    }
+
+    // the chosen items of each level are a prefix of it, and their packages expand to a prefix below
+    size_t take = 2 * (size_t)n - 2;
+    for (int d = 0; d < depth && take > 0; d++) {
+        size_t packages = 0;
+        const MergeItem* level = levels + d * width;
+        for (size_t i = 0; i < take; i++) {
+            if (level[i].symbol >= 0) lens[level[i].symbol]++;
+            else packages++;
+        }
+        take = 2 * packages;
+    }
+    return maxLen;
+}
+
+// size of the encoded payload in bits for the given code lengths
+uint64_t encodedBitCount(const uint64_t freqs[256], const uint8_t lens[256]) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 256; i++) bits += freqs[i] * lens[i];
+    return bits;
+}
+
+LengthLimitReport compareLengthLimit(const HuffmanTree& tree, const uint64_t freqs[256], int maxLen) {
+    LengthLimitReport report;
+    uint8_t unbounded[256] = { 0 }, limited[256];
+    computeCodeLengths(tree, tree.root, freqs, unbounded);
+    report.maxLen = buildLengthLimitedCodes(freqs, maxLen, limited);
+    report.unboundedMaxLen = 0;
+    for (int i = 0; i < 256; i++) report.unboundedMaxLen = max(report.unboundedMaxLen, (int)unbounded[i]);
+    report.limitedBits = encodedBitCount(freqs, limited);
+    report.unboundedBits = encodedBitCount(freqs, unbounded);
+    return report;
+}
+
+// false if the lengths over-subscribe the code space (more codes than a prefix code can hold)
+bool assignCanonicalCodes(const uint8_t lens[256], HuffCode codes[256]) {
+    uint32_t lenCount[MAX_HEADER_CODE_LEN + 1] = { 0 };
+    for (int i = 0; i < 256; i++) {
+        if (lens[i] > MAX_HEADER_CODE_LEN) return false;
+        if (lens[i]) lenCount[lens[i]]++;
+    }
+    uint32_t nextCode[MAX_HEADER_CODE_LEN + 1] = { 0 };
+    uint32_t code = 0;
+    for (int len = 1; len <= MAX_HEADER_CODE_LEN; len++) {
+        code = (code + lenCount[len - 1]) << 1;
+        nextCode[len] = code;
+        if (code + lenCount[len] > (1u << len)) return false;
+    }
+    for (int i = 0; i < 256; i++) {
+        codes[i].len = lens[i];
+        codes[i].bits = lens[i] ? nextCode[lens[i]]++ : 0;
+    }
+    return true;
+}
+
+// rebuilding a tree from code lengths (v2 files carry no frequencies, so every freq is 0);
+// false for invalid lengths, or incomplete codes too sparse to fit the arena
+bool buildTreeFromLengths(const uint8_t lens[256], HuffmanTree& tree) {
+    tree.clear();
+    HuffCode codes[256];
+    if (!assignCanonicalCodes(lens, codes)) return false;
+    for (int s = 0; s < 256; s++) {
+        if (!codes[s].len) continue;
+        if (tree.empty()) tree.root = tree.addLeaf((unsigned char)0, 0);
+        uint16_t node = tree.root;
+        for (int b = codes[s].len - 1; b >= 0; b--) {
+            uint16_t& next = ((codes[s].bits >> b) & 1) ? tree[node].right : tree[node].left;
+            if (next == NO_NODE) next = tree.addLeaf((unsigned char)0, 0);
+            if (next == NO_NODE) return false;
+            node = next;
+        }
+        tree[node].data = (unsigned char)s;
+    }
+    return !tree.empty();
+}
+
+/*
+ Functional Module 2: Encoding/Decoding & File I/O
+ */
+
+/*
+ File mapping
+ Regular files are mapped into memory and the coders work on one byte span over the
+ mapping: no copy into a string and no per-byte stream calls. Outputs of known size are
+ preallocated and mapped the same way. Pipes and other files that cannot be mapped keep
+ the buffered stream path.
+*/
+// read-only mapping of a whole file, hinted for sequential access
+class MappedInput {
+    const uint8_t* base;
+    size_t length;
+
+public:
+    MappedInput() : base(nullptr), length(0) {}
+    ~MappedInput() { close(); }
+    MappedInput(const MappedInput&) = delete;
+    MappedInput& operator=(const MappedInput&) = delete;
+
+    // false if the file cannot be mapped (pipe, device, ...): the caller streams it instead
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart > SIZE_MAX) {
+            CloseHandle(file);
+            return false;
+        }
+        if (size.QuadPart > 0) {
+            // the view keeps the mapping alive after both handles are closed
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping) {
+                base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+        if (size.QuadPart > 0 && !base) return false;
+        length = (size_t)size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > SIZE_MAX) {
+            ::close(fd);
+            return false;
+        }
+        if (st.st_size > 0) {
+            void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+                base = static_cast<const uint8_t*>(view);
+            }
+        }
+        ::close(fd);
+        if (st.st_size > 0 && !base) return false;
+        length = (size_t)st.st_size;
+#endif
+        return true;
+    }
+
+    void close() {
+        if (base) {
+#ifdef _WIN32
+            UnmapViewOfFile(base);
+#else
+            munmap(const_cast<uint8_t*>(base), length);
+#endif
+        }
+        base = nullptr;
+        length = 0;
+    }
+
+    ByteSpan span() const { return ByteSpan{ base, length }; }
+};
+
+// output whose maximum size is known up front: written in place through a shared mapping
+// and cut to its final size by finish(). create() fails when the file cannot be created,
+// sized or mapped; outputs that are not regular files (see mappableOutput) take the
+// buffered stream path instead, so nothing here is sized by a header.
+class MappedOutput {
+    string path;
+    uint8_t* base;
+    size_t capacity;
+    uint8_t empty; // data() of an empty output
+#ifdef _WIN32
+    HANDLE file;
+#else
+    int fd;
+#endif
+
+    void unmap() {
+        if (!base || capacity == 0) return;
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(base, capacity);
+#endif
+    }
+
+public:
+#ifdef _WIN32
+    MappedOutput() : base(nullptr), capacity(0), empty(0), file(INVALID_HANDLE_VALUE) {}
+#else
+    MappedOutput() : base(nullptr), capacity(0), empty(0), fd(-1) {}
+#endif
+    ~MappedOutput() { finish(0); }
+    MappedOutput(const MappedOutput&) = delete;
+    MappedOutput& operator=(const MappedOutput&) = delete;
+
+    bool create(const string& outPath, uint64_t size) {
+        if (size > SIZE_MAX) return false;
+        capacity = (size_t)size;
+        base = nullptr;
+        if (capacity == 0) {
+            ofstream out(outPath, ios::binary);
+            if (!out) return false;
+            base = &empty;
+            path = outPath;
+            return true;
+        }
+#ifdef _WIN32
+        file = CreateFileA(outPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file != INVALID_HANDLE_VALUE && GetFileType(file) == FILE_TYPE_DISK) {
+            // a mapping larger than the file extends it
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+                (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL);
+            if (mapping) {
+                base = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, capacity));
+                CloseHandle(mapping);
+            }
+        }
+        if (!base) {
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+            return false;
+        }
+#else
+        fd = ::open(outPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && ftruncate(fd, (off_t)capacity) == 0) {
+            void* view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (view != MAP_FAILED) base = static_cast<uint8_t*>(view);
+        }
+        if (!base) {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+            return false;
+        }
+#endif
+        path = outPath;
+        return true;
+    }
+
+    uint8_t* data() { return base; }
+
+    // keeps the first finalSize bytes (<= the size given to create)
+    bool finish(uint64_t finalSize) {
+        if (path.empty()) return false;
+        bool ok = true;
+        if (capacity > 0) {
+            unmap();
+#ifdef _WIN32
+            LARGE_INTEGER end;
+            end.QuadPart = (LONGLONG)finalSize;
+            ok = SetFilePointerEx(file, end, NULL, FILE_BEGIN) && SetEndOfFile(file);
+            ok = CloseHandle(file) && ok;
+            file = INVALID_HANDLE_VALUE;
+#else
+            ok = ftruncate(fd, (off_t)finalSize) == 0;
+            ok = ::close(fd) == 0 && ok;
+            fd = -1;
+#endif
+        }
+        path.clear();
+        base = nullptr;
+        return ok;
+    }
+};
+
+// false for outputs that exist and are not regular files (pipes, devices such as /dev/null
+// or NUL): they cannot be mapped, and are written through a buffered stream instead
+bool mappableOutput(const string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return true; // created as a regular file
+    bool disk = GetFileType(file) == FILE_TYPE_DISK;
+    CloseHandle(file);
+    return disk;
+#else
+    struct stat st;
+    return stat(path.c_str(), &st) != 0 || S_ISREG(st.st_mode);
+#endif
+}
+
+// main encode loop, unrolled by four; pairs of short codes share one accumulator update
+void encodeSymbols(const unsigned char* data, size_t n, const HuffCode codes[256], BitWriter& writer) {
+    int maxLen = 0;
+    for (int i = 0; i < 256; i++) if (codes[i].len > maxLen) maxLen = codes[i].len;
+    size_t i = 0;
+    if (maxLen <= 16) {
+        for (; i + 4 <= n; i += 4) {
+            const HuffCode& a = codes[data[i]];
+            const HuffCode& b = codes[data[i + 1]];
+            const HuffCode& c = codes[data[i + 2]];
+            const HuffCode& d = codes[data[i + 3]];
+            writer.put((a.bits << b.len) | b.bits, a.len + b.len);
+            writer.put((c.bits << d.len) | d.bits, c.len + d.len);
+        }
+    }
+    else if (maxLen <= 32) {
+        for (; i + 4 <= n; i += 4) {
+            writer.put(codes[data[i]].bits, codes[data[i]].len);
+            writer.put(codes[data[i + 1]].bits, codes[data[i + 1]].len);
+            writer.put(codes[data[i + 2]].bits, codes[data[i + 2]].len);
+            writer.put(codes[data[i + 3]].bits, codes[data[i + 3]].len);
+        }
+    }
+    for (; i < n; i++) writer.putLong(codes[data[i]].bits, codes[data[i]].len);
+}
+
+void writeCompressedText(ByteSpan text, const string& outPath, const HuffCode codes[256],
+    unsigned char bytesPresent[256], uint64_t freqs[256]) {
+
+    uint64_t totalBits = 0;
+    for (int i = 0; i < 256; i++) if (bytesPresent[i]) totalBits += freqs[i] * codes[i].len;
+
+    ofstream out(outPath, ios::binary);
+    if (!out) { cerr << "Cannot open output file\n"; return; }
+
+    uint16_t uniq = 0;
+    for (int i = 0; i < 256; i++) if (bytesPresent[i]) ++uniq;
+    /* writing header information in output file
+       1. number of unique symbols (2 bytes)
+       2. for each unique symbol: symbol (1 byte) + frequency (8 bytes)
+       3. total bits in compressed data (8 bytes)
+    */
+
+    /*
+    * For small files, the header may take up a significant portion of the compressed file.
+    * This causes the compressed file to be larger than the original.
+    * This is a known limitation of this simple implementation.
+    */
+
+    out.write(reinterpret_cast<const char*>(&uniq), sizeof(uniq));
+    for (int i = 0; i < 256; i++) {
+        if (bytesPresent[i]) {
+            uint8_t s = (uint8_t)i;
+            uint64_t f = freqs[i];
+            out.write(reinterpret_cast<const char*>(&s), sizeof(s));
+            out.write(reinterpret_cast<const char*>(&f), sizeof(f));
+        }
+    }
+    out.write(reinterpret_cast<const char*>(&totalBits), sizeof(totalBits));
+    //writing compressed data in the form of bits packed into bytes in output file (MSB-first)
+    vector<uint8_t> buf;
+    BitWriter writer(buf, &out);
+    encodeSymbols(text.data, text.size, codes, writer);
+    writer.finish();
+    out.close();
+}
+
+/*
+ Header readers/writers are templates over the byte source or sink: istream/ostream for
+ files, MemoryReader/VectorWriter for blocks that are built or parsed in memory.
+*/
+struct MemoryReader {
+    const uint8_t* cur;
+    const uint8_t* end;
+
+    bool get(char& c) {
+        if (cur == end) return false;
+        c = (char)*cur++;
+        return true;
+    }
+    bool read(char* dst, size_t n) {
+        if ((size_t)(end - cur) < n) return false;
+        memcpy(dst, cur, n);
+        cur += n;
+        return true;
+    }
+};
+
+struct VectorWriter {
+    vector<uint8_t>& v;
+
+    void put(char c) { v.push_back((uint8_t)c); }
+    void write(const char* p, size_t n) { v.insert(v.end(), p, p + n); }
+};
+
+// measures what a header writer would produce
+struct CountingWriter {
+    size_t n;
+
+    void put(char) { n++; }
+    void write(const char*, size_t len) { n += len; }
+};
+
+// 7 bits per byte, low bits first, high bit set on every byte but the last
+template <class Sink>
+void writeVarint(Sink& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.put((char)((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.put((char)v);
+}
+
+template <class Source>
+bool readVarint(Source& in, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        char c;
+        if (!in.get(c)) return false;
+        v |= (uint64_t)((uint8_t)c & 0x7F) << shift;
+        if (!((uint8_t)c & 0x80)) return true;
+    }
+    return false;
+}
+
+template <class Sink>
+void writeLengthTable(Sink& out, const uint8_t lens[256], bool bitmap) {
+    unsigned char syms[256];
+    int count = 0;
+    for (int i = 0; i < 256; i++) if (lens[i]) syms[count++] = (unsigned char)i;
+    if (bitmap) {
+        uint8_t bits[32] = { 0 };
+        for (int i = 0; i < count; i++) bits[syms[i] >> 3] |= (uint8_t)(1 << (syms[i] & 7));
+        out.write(reinterpret_cast<const char*>(bits), sizeof(bits));
+    }
+    else {
+        out.put((char)(count - 1));
+        out.write(reinterpret_cast<const char*>(syms), count);
+    }
+    for (int i = 0; i < count; i += 2) {
+        uint8_t packed = (uint8_t)(lens[syms[i]] << 4);
+        if (i + 1 < count) packed |= lens[syms[i + 1]];
+        out.put((char)packed);
+    }
+}
+
+template <class Source>
+bool readLengthTable(Source& in, uint8_t lens[256], bool bitmap) {
+    unsigned char syms[256];
+    int count = 0;
+    if (bitmap) {
+        uint8_t bits[32];
+        if (!in.read(reinterpret_cast<char*>(bits), sizeof(bits))) return false;
+        for (int i = 0; i < 256; i++) if (bits[i >> 3] & (1 << (i & 7))) syms[count++] = (unsigned char)i;
+    }
+    else {
+        char c;
+        if (!in.get(c)) return false;
+        count = (uint8_t)c + 1;
+        if (!in.read(reinterpret_cast<char*>(syms), count)) return false;
+    }
+    for (int i = 0; i < count; i += 2) {
+        char c;
+        if (!in.get(c)) return false;
+        lens[syms[i]] = (uint8_t)c >> 4;
+        if (i + 1 < count) lens[syms[i + 1]] = (uint8_t)c & 0x0F;
+    }
+    for (int i = 0; i < count; i++) if (!lens[syms[i]]) return false;
+    return true;
+}
+
+// items 2-4 of the layout above: everything a coded stream needs besides its bits
+template <class Sink>
+void writeStreamHeader(Sink& out, uint64_t symbolCount, const uint8_t lens[256], uint8_t flags = 0) {
+    int present = 0;
+    for (int i = 0; i < 256; i++) if (lens[i]) ++present;
+    bool bitmap = present > SPARSE_TABLE_MAX_SYMBOLS;
+    if (bitmap) flags |= HUFF_FLAG_BITMAP_TABLE;
+    out.put((char)flags);
+    writeVarint(out, symbolCount);
+    if (present) writeLengthTable(out, lens, bitmap);
+}
+
+template <class Source>
+bool readStreamHeader(Source& in, uint8_t& flags, uint64_t& symbolCount, uint8_t lens[256]) {
+    char c;
+    if (!in.get(c)) return false;
+    flags = (uint8_t)c;
+    memset(lens, 0, 256);
+    if (!readVarint(in, symbolCount)) return false;
+    if (flags & (HUFF_FLAG_STORED | HUFF_FLAG_RUNS)) return true; // raw bytes or run tokens follow, no table
+    return symbolCount == 0 || readLengthTable(in, lens, (flags & HUFF_FLAG_BITMAP_TABLE) != 0);
+}
+
+template <class Sink>
+void writeStoredHeader(Sink& out, uint64_t symbolCount) {
+    out.put((char)HUFF_FLAG_STORED);
+    writeVarint(out, symbolCount);
+}
+
+/*
+ Incompressible data
+ The histogram gives the exact size of a coded stream before any bit is written, so data
+ that would not shrink (already-compressed audio and video, encrypted or random bytes) is
+ stored instead: no encoding pass, and a plain copy when decoding.
+*/
+uint64_t codedStreamSize(uint64_t symbolCount, const uint64_t freqs[256], const uint8_t lens[256], uint8_t flags = 0) {
+    CountingWriter header{ 0 };
+    writeStreamHeader(header, symbolCount, lens, flags);
+    return header.n + (encodedBitCount(freqs, lens) + 7) / 8;
+}
+
+uint64_t storedStreamSize(uint64_t symbolCount) {
+    CountingWriter header{ 0 };
+    writeStoredHeader(header, symbolCount);
+    return header.n + symbolCount;
+}
+
+void writeV2Header(ostream& out, uint64_t symbolCount, const uint8_t lens[256]) {
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)HUFF_FORMAT_V2);
+    writeStreamHeader(out, symbolCount, lens);
+}
+
+void writeV2StoredHeader(ostream& out, uint64_t symbolCount) {
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)HUFF_FORMAT_V2);
+    writeStoredHeader(out, symbolCount);
+}
+
+// writes the v2 format with codes no longer than maxCodeLen bits (at most MAX_HEADER_CODE_LEN)
+bool writeCompressedTextV2(ByteSpan text, const string& outPath, uint64_t freqs[256],
+    int maxCodeLen, JobProgress* job) {
+    uint8_t lens[256];
+    buildLengthLimitedCodes(freqs, min(maxCodeLen, MAX_HEADER_CODE_LEN), lens);
+    HuffCode codes[256];
+    if (!assignCanonicalCodes(lens, codes)) return false;
+
+    ofstream out(outPath, ios::binary);
+    if (!out) { cerr << "Cannot open output file\n"; return false; }
+    jobBegin(job, JOB_ENCODING, text.size);
+    if (codedStreamSize(text.size, freqs, lens) >= storedStreamSize(text.size)) {
+        writeV2StoredHeader(out, text.size);
+        for (size_t start = 0; start < text.size; start += JOB_CHUNK) {
+            size_t n = min(JOB_CHUNK, text.size - start);
+            out.write(reinterpret_cast<const char*>(text.data + start), n);
+            if (!jobAdvance(job, n)) return false;
+        }
+        out.close();
+        return (bool)out;
+    }
+    writeV2Header(out, text.size, lens);
+
+    vector<uint8_t> buf;
+    BitWriter writer(buf, &out);
+    for (size_t start = 0; start < text.size; start += JOB_CHUNK) {
+        size_t n = min(JOB_CHUNK, text.size - start);
+        encodeSymbols(text.data + start, n, codes, writer);
+        if (!jobAdvance(job, n)) return false;
+    }
+    writer.finish();
+    out.close();
+    return (bool)out;
+}
+
+/*
+ Streaming compression (bounded memory)
+ Pass 1 reads the file in fixed-size chunks to count frequencies, pass 2 reads it again and
+ encodes each chunk straight into the output. Memory use is one input chunk plus the
+ output buffer, whatever the size of the file. Regular files are mapped instead and both
+ passes run over the mapping, paged in and out by the OS.
+*/
+const size_t STREAM_CHUNK_SIZE = 1 << 20;
+
+// fills freqs/origBytes for the caller; false on I/O errors or if the file changed between passes
+bool compressFileStreaming(const string& inPath, const string& outPath, uint64_t freqs[256],
+    uint64_t& origBytes, int maxCodeLen, JobProgress* job) {
+    memset(freqs, 0, 256 * sizeof(uint64_t));
+    origBytes = 0;
+    MappedInput mapped;
+    if (mapped.open(inPath)) {
+        ByteSpan data = mapped.span();
+        // one threaded pass over the mapping, or chunks when a job has to be polled
+        size_t chunk = job ? JOB_CHUNK : max<size_t>(data.size, 1);
+        jobBegin(job, JOB_COUNTING, data.size);
+        for (size_t start = 0; start < data.size; start += chunk) {
+            size_t n = min(chunk, data.size - start);
+            countFrequencies(data.data + start, n, freqs);
+            if (!jobAdvance(job, n)) return false;
+        }
+        origBytes = data.size;
+        return writeCompressedTextV2(data, outPath, freqs, maxCodeLen, job);
+    }
+
+    ifstream in(inPath, ios::binary);
+    if (!in) return false;
+    vector<char> chunk(STREAM_CHUNK_SIZE);
+
+    jobBegin(job, JOB_COUNTING, 0); // size unknown until the pass ends
+    while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0) {
+        size_t n = (size_t)in.gcount();
+        countFrequencies(reinterpret_cast<const uint8_t*>(chunk.data()), n, freqs);
+        origBytes += n;
+        if (!jobAdvance(job, n)) return false;
+    }
+    if (in.bad()) return false;
+
+    uint8_t lens[256];
+    buildLengthLimitedCodes(freqs, min(maxCodeLen, MAX_HEADER_CODE_LEN), lens);
+    HuffCode codes[256];
+    if (!assignCanonicalCodes(lens, codes)) return false;
+
+    ofstream out(outPath, ios::binary);
+    if (!out) { cerr << "Cannot open output file\n"; return false; }
+    bool stored = codedStreamSize(origBytes, freqs, lens) >= storedStreamSize(origBytes);
+    if (stored) writeV2StoredHeader(out, origBytes);
+    else writeV2Header(out, origBytes, lens);
+
+    in.clear();
+    in.seekg(0);
+    vector<uint8_t> buf;
+    BitWriter writer(buf, &out);
+    uint64_t encoded = 0;
+    jobBegin(job, JOB_ENCODING, origBytes);
+    while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0) {
+        size_t n = (size_t)in.gcount();
+        if (stored) out.write(chunk.data(), n);
+        else encodeSymbols(reinterpret_cast<const unsigned char*>(chunk.data()), n, codes, writer);
+        encoded += n;
+        if (!jobAdvance(job, n)) return false;
+    }
+    writer.finish();
+    out.close();
+    return encoded == origBytes && !in.bad() && (bool)out;
+}
+
+/*
+ Table-driven decoding
+ The primary table is indexed by the next DECODE_TABLE_BITS bits of the stream and resolves
+ every code of that length or shorter in one lookup. Longer codes hit a link entry that
+ points to a second-level table indexed by the bits that follow.
+*/
+const int DECODE_TABLE_BITS = 11;
+const int MAX_TABLE_CODE_LEN = 24; // deeper trees fall back to the tree walk
+const size_t DECODE_IN_BUFFER = 1 << 16;
+const size_t DECODE_OUT_BUFFER = 1 << 20;
+
+struct DecodeEntry {
+    uint16_t value;  // decoded symbol, or start of the second-level table for a link entry
+    uint8_t len;     // full code length in bits (0 = no code starts with these bits)
+    uint8_t subBits; // link entries only: index width of the second-level table
+};
+
+// canonical codes of up to MAX_HEADER_CODE_LEN bits need the primary table plus at most one
+// 16-entry second-level table per symbol, so v2/v3 tables always fit the inline storage and
+// decoding them never allocates; only deep v1 trees spill to the heap
+const size_t DECODE_TABLE_INLINE = ((size_t)1 << DECODE_TABLE_BITS) + 256 * ((size_t)1 << (MAX_HEADER_CODE_LEN - DECODE_TABLE_BITS));
+
+// primary table followed by all second-level tables
+struct DecodeTable {
+    DecodeEntry fixed[DECODE_TABLE_INLINE];
+    vector<DecodeEntry> spill; // used instead of fixed once the table outgrows it
+    size_t size;
+    int maxLen;
+
+    DecodeTable() : size(0), maxLen(0) {}
+    DecodeTable(const DecodeTable&) = delete;
+    DecodeTable& operator=(const DecodeTable&) = delete;
+
+    DecodeEntry* entries() { return spill.empty() ? fixed : spill.data(); }
+    const DecodeEntry* entries() const { return spill.empty() ? fixed : spill.data(); }
+
+    // new entries are empty (len 0)
+    void resize(size_t n) {
+        if (n > DECODE_TABLE_INLINE && spill.empty()) spill.assign(fixed, fixed + size);
+        if (!spill.empty()) spill.resize(n, DecodeEntry{ 0, 0, 0 });
+        else for (size_t i = size; i < n; i++) fixed[i] = DecodeEntry{ 0, 0, 0 };
+        size = n;
+    }
+};
+
+// collecting (symbol, code) for every leaf, including the dummy sibling of a one-symbol tree
+void collectLeafCodes(const HuffmanTree& tree, uint16_t node, unsigned char syms[], HuffCode codes[], int& count,
+    uint64_t bits = 0, int depth = 0) {
+    if (node == NO_NODE) return;
+    if (tree.isLeaf(node)) {
+        syms[count] = tree[node].data;
+        codes[count].bits = bits;
+        codes[count].len = (uint8_t)depth;
+        ++count;
+        return;
+    }
+    if (depth >= MAX_TABLE_CODE_LEN) { // too deep for the table, mark and stop descending
+        syms[count] = 0;
+        codes[count].bits = 0;
+        codes[count].len = (uint8_t)(MAX_TABLE_CODE_LEN + 1);
+        ++count;
+        return;
+    }
+    collectLeafCodes(tree, tree[node].left, syms, codes, count, bits << 1, depth + 1);
+    collectLeafCodes(tree, tree[node].right, syms, codes, count, (bits << 1) | 1, depth + 1);
+}
+
+bool buildDecodeTable(const unsigned char syms[], const HuffCode codes[], int count, DecodeTable& table) {
+    const int T = DECODE_TABLE_BITS;
+    table.maxLen = 0;
+    for (int i = 0; i < count; i++) {
+        if (codes[i].len == 0 || codes[i].len > MAX_TABLE_CODE_LEN) return false;
+        if (codes[i].len > table.maxLen) table.maxLen = codes[i].len;
+    }
+    table.spill.clear();
+    table.size = 0;
+    table.resize((size_t)1 << T);
+    DecodeEntry* entries = table.entries();
+
+    // pass 1: short codes fill a run of primary slots, long codes size their prefix's subtable
+    uint8_t subBits[1 << DECODE_TABLE_BITS] = { 0 };
+    for (int i = 0; i < count; i++) {
+        int len = codes[i].len;
+        if (len <= T) {
+            size_t start = (size_t)(codes[i].bits << (T - len));
+            size_t span = (size_t)1 << (T - len);
+            for (size_t k = 0; k < span; k++) entries[start + k] = DecodeEntry{ syms[i], (uint8_t)len, 0 };
+        }
+        else {
+            size_t prefix = (size_t)(codes[i].bits >> (len - T));
+            if (len - T > subBits[prefix]) subBits[prefix] = (uint8_t)(len - T);
+        }
+    }
+    // pass 2: allocate second-level tables behind the primary one
+    for (size_t prefix = 0; prefix < ((size_t)1 << T); prefix++) {
+        if (!subBits[prefix]) continue;
+        size_t offset = table.size;
+        if (offset + ((size_t)1 << subBits[prefix]) > 0xFFFF) return false; // link offsets are 16-bit
+        table.resize(offset + ((size_t)1 << subBits[prefix]));
+        entries = table.entries(); // may have moved to the heap
+        entries[prefix] = DecodeEntry{ (uint16_t)offset, (uint8_t)T, subBits[prefix] };
+    }
+    // pass 3: fill the second-level entries
+    for (int i = 0; i < count; i++) {
+        int len = codes[i].len;
+        if (len <= T) continue;
+        size_t prefix = (size_t)(codes[i].bits >> (len - T));
+        int sub = subBits[prefix];
+        uint64_t suffix = codes[i].bits & ((1ULL << (len - T)) - 1);
+        size_t start = entries[prefix].value + (size_t)(suffix << (sub - (len - T)));
+        size_t span = (size_t)1 << (sub - (len - T));
+        for (size_t k = 0; k < span; k++) entries[start + k] = DecodeEntry{ syms[i], (uint8_t)len, 0 };
+    }
+    return true;
+}
+
+// decode table for canonical codes rebuilt from their lengths
+bool buildDecodeTableFromLengths(const uint8_t lens[256], DecodeTable& table) {
+    HuffCode canonical[256];
+    if (!assignCanonicalCodes(lens, canonical)) return false;
+    unsigned char syms[256];
+    HuffCode codes[256];
+    int count = 0;
+    for (int i = 0; i < 256; i++) {
+        if (!lens[i]) continue;
+        syms[count] = (unsigned char)i;
+        codes[count++] = canonical[i];
+    }
+    return buildDecodeTable(syms, codes, count, table);
+}
+
+// MSB-first bit reader: keeps up to 64 bits left-aligned in bitBuf. Reads either straight
+// from a byte range in memory or from a stream through a large chunk buffer.
+class BitReader {
+    istream* in; // null: reading a memory range
+    vector<uint8_t> buf;
+    const uint8_t* cur;
+    const uint8_t* end;
+
+    bool fillChunk() {
+        if (!in) return false;
+        in->read(reinterpret_cast<char*>(buf.data()), buf.size());
+        cur = buf.data();
+        end = cur + (size_t)in->gcount();
+        return cur < end;
+    }
+
+public:
+    uint64_t bitBuf;
+    int bitCount;
+
+    BitReader(istream& input) : in(&input), buf(DECODE_IN_BUFFER), cur(nullptr), end(nullptr), bitBuf(0), bitCount(0) {
+    }
+
+    BitReader(const uint8_t* data, size_t size) : in(nullptr), cur(data), end(data + size), bitBuf(0), bitCount(0) {
+    }
+
+    // after refill at least 57 bits are buffered; bits past the end of the stream read as zero
+    void refill() {
+        while (bitCount <= 56) {
+            uint8_t b = 0;
+            if (cur < end || fillChunk()) b = *cur++;
+            bitBuf |= (uint64_t)b << (56 - bitCount);
+            bitCount += 8;
+        }
+    }
+
+    void consume(int n) {
+        bitBuf <<= n;
+        bitCount -= n;
+    }
+};
+
+// decodes into out until maxSymbols are written or bitsLeft runs out (a trailing partial
+// code is left unread, same as the tree walk); returns the symbol count or -1 on an invalid code
+int64_t decodeTableRun(BitReader& reader, const DecodeTable& table, uint64_t& bitsLeft, uint8_t* out, size_t maxSymbols) {
+    const int T = DECODE_TABLE_BITS;
+    const DecodeEntry* entries = table.entries();
+    size_t n = 0;
+    while (n < maxSymbols && bitsLeft > 0) {
+        if (reader.bitCount < MAX_TABLE_CODE_LEN) reader.refill();
+        DecodeEntry e = entries[reader.bitBuf >> (64 - T)];
+        if (e.subBits) e = entries[e.value + ((reader.bitBuf << T) >> (64 - e.subBits))];
+        if (e.len == 0) return -1;
+        if (e.len > bitsLeft) break;
+        reader.consume(e.len);
+        bitsLeft -= e.len;
+        out[n++] = (uint8_t)e.value;
+    }
+    return (int64_t)n;
+}
+
+// four interleaved streams: one lookup per stream per step, so the four dependency chains
+// overlap in the CPU. Bits past the end of a stream read as zero; overruns are caught at the end.
+const size_t FOUR_STREAM_JUMP_TABLE = 12;
+
+inline uint8_t decodeStep(BitReader& reader, const DecodeEntry* entries, int64_t& bitsLeft, bool& invalid) {
+    const int T = DECODE_TABLE_BITS;
+    if (reader.bitCount < MAX_TABLE_CODE_LEN) reader.refill();
+    DecodeEntry e = entries[reader.bitBuf >> (64 - T)];
+    if (e.subBits) e = entries[e.value + ((reader.bitBuf << T) >> (64 - e.subBits))];
+    invalid |= e.len == 0;
+    reader.consume(e.len);
+    bitsLeft -= e.len;
+    return (uint8_t)e.value;
+}
+
+// where decodeFourStreams finds the table for the next symbol: the block's only table, or
+// the table of the preceding byte's context group (HUFF_FLAG_CONTEXT blocks)
+struct OneTable {
+    const DecodeEntry* entries;
+    const DecodeEntry* select(uint8_t) const { return entries; }
+};
+
+struct ContextTables {
+    const DecodeEntry* byContext[256];
+    const DecodeEntry* select(uint8_t prev) const { return byContext[prev]; }
+};
+
+// the model is taken by value: output bytes may alias anything the caller owns, so a
+// reference would make the compiler reload the tables after every store
+template <class Model>
+bool decodeFourStreams(const uint8_t* data, size_t size, const Model model, uint8_t* out, size_t n) {
+    if (size < FOUR_STREAM_JUMP_TABLE) return false;
+    size_t streamSize[4], used = FOUR_STREAM_JUMP_TABLE;
+    for (int k = 0; k < 3; k++) {
+        streamSize[k] = 0;
+        for (int i = 0; i < 4; i++) streamSize[k] |= (size_t)data[4 * k + i] << (8 * i);
+        if (streamSize[k] > size - used) return false;
+        used += streamSize[k];
+    }
+    streamSize[3] = size - used;
+
+    BitReader r0(data + FOUR_STREAM_JUMP_TABLE, streamSize[0]);
+    BitReader r1(data + FOUR_STREAM_JUMP_TABLE + streamSize[0], streamSize[1]);
+    BitReader r2(data + FOUR_STREAM_JUMP_TABLE + streamSize[0] + streamSize[1], streamSize[2]);
+    BitReader r3(data + used, streamSize[3]);
+    int64_t b0 = 8 * (int64_t)streamSize[0], b1 = 8 * (int64_t)streamSize[1];
+    int64_t b2 = 8 * (int64_t)streamSize[2], b3 = 8 * (int64_t)streamSize[3];
+
+    size_t quarter = (n + 3) / 4;
+    uint8_t* o0 = out;
+    uint8_t* o1 = out + quarter;
+    uint8_t* o2 = out + min(n, 2 * quarter);
+    uint8_t* o3 = out + min(n, 3 * quarter);
+    size_t last = n - min(n, 3 * quarter); // the fourth quarter is the shortest
+    bool invalid = false;
+    uint8_t p0 = 0, p1 = 0, p2 = 0, p3 = 0; // every quarter starts in context 0
+    for (size_t i = 0; i < last; i++) {
+        o0[i] = p0 = decodeStep(r0, model.select(p0), b0, invalid);
+        o1[i] = p1 = decodeStep(r1, model.select(p1), b1, invalid);
+        o2[i] = p2 = decodeStep(r2, model.select(p2), b2, invalid);
+        o3[i] = p3 = decodeStep(r3, model.select(p3), b3, invalid);
+    }
+    // tails of the longer quarters
+    BitReader* readers[3] = { &r0, &r1, &r2 };
+    int64_t* bits[3] = { &b0, &b1, &b2 };
+    uint8_t* outs[3] = { o0, o1, o2 };
+    uint8_t prev[3] = { p0, p1, p2 };
+    for (int k = 0; k < 3; k++) {
+        size_t len = min(quarter, n - min(n, k * quarter));
+        for (size_t i = last; i < len; i++)
+            outs[k][i] = prev[k] = decodeStep(*readers[k], model.select(prev[k]), *bits[k], invalid);
+    }
+    return !invalid && b0 >= 0 && b1 >= 0 && b2 >= 0 && b3 >= 0;
+}
+
+// stops after totalBits bits or symbolCount symbols, whichever comes first; fails unless all
+// symbolCount symbols were decoded (a truncated stream)
+bool decodeWithTable(istream& in, ostream& out, const DecodeTable& table, uint64_t totalBits, uint64_t symbolCount,
+    JobProgress* job = nullptr) {
+    BitReader reader(in);
+    vector<uint8_t> outBuf(DECODE_OUT_BUFFER);
+    uint64_t bitsLeft = totalBits;
+    uint64_t symbolsLeft = symbolCount;
+    while (symbolsLeft > 0) {
+        int64_t n = decodeTableRun(reader, table, bitsLeft, outBuf.data(), (size_t)min<uint64_t>(symbolsLeft, outBuf.size()));
+        if (n < 0) return false;
+        out.write(reinterpret_cast<const char*>(outBuf.data()), n);
+        symbolsLeft -= (uint64_t)n;
+        if (!jobAdvance(job, (uint64_t)n)) return false;
+        if ((size_t)n < outBuf.size()) break; // bits ran out
+    }
+    return (bool)out && symbolsLeft == 0;
+}
+
+// stored streams: a plain copy, which fails where a truncated file ends
+bool copyStored(istream& in, ostream& out, uint64_t symbolCount, JobProgress* job = nullptr) {
+    vector<char> buf(DECODE_OUT_BUFFER);
+    uint64_t left = symbolCount;
+    while (left > 0 && (in.read(buf.data(), (streamsize)min<uint64_t>(left, buf.size())) || in.gcount() > 0)) {
+        size_t n = (size_t)in.gcount();
+        out.write(buf.data(), n);
+        left -= n;
+        if (!jobAdvance(job, n)) return false;
+    }
+    return (bool)out && left == 0;
+}
+
+// reference decoder: follows the tree one bit at a time
+bool decodeTreeWalk(istream& in, ostream& out, const HuffmanTree& tree, uint64_t totalBits, uint64_t symbolCount,
+    JobProgress* job = nullptr) {
+    uint64_t bitsRead = 0;
+    uint64_t symbolsLeft = symbolCount;
+    uint16_t node = tree.root;
+    char byteBuf;
+    while (bitsRead < totalBits && symbolsLeft > 0 && in.get(byteBuf)) {
+        uint8_t b = (uint8_t)byteBuf;
+        for (int bit = 7; bit >= 0 && bitsRead < totalBits && symbolsLeft > 0; --bit) {
+            int val = (b >> bit) & 1;
+            if (val == 0) node = tree[node].left; else node = tree[node].right;
+            if (node == NO_NODE) return false;
+            if (tree.isLeaf(node)) {
+                out.put((char)tree[node].data);
+                node = tree.root;
+                // progress every JOB_CHUNK symbols
+                if (--symbolsLeft % JOB_CHUNK == 0 && !jobAdvance(job, JOB_CHUNK)) return false;
+            }
+            ++bitsRead;
+        }
+    }
+    return symbolsLeft == 0;
+}
+
+/*
+ Order-1 context model (HUFF_FLAG_CONTEXT blocks, layout in huffman_core.h)
+ The 256 contexts are clustered by their next-byte statistics (k-means, with the cost of
+ coding one context's bytes with a group's distribution as the distance), so a block carries
+ a handful of tables instead of 256. A sample decides first whether the model can help at all.
+*/
+const size_t CONTEXT_MIN_SYMBOLS = 4096;     // below this the extra tables cannot pay off
+const size_t CONTEXT_SAMPLE = 256 << 10;     // bytes used for the quick gain estimate
+const double CONTEXT_MIN_GAIN = 0.03;        // estimated saving needed to try the model
+const size_t CONTEXT_SYMBOLS_PER_GROUP = 16 << 10;
+const int CONTEXT_CLUSTER_ROUNDS = 4;
+
+struct ContextGroups {
+    int groupCount;
+    uint8_t groupOf[256];                    // context (preceding byte) -> group
+    uint8_t lens[MAX_CONTEXT_GROUPS][256];
+};
+
+// order-1 histogram, counts[prev * 256 + next]; each of the streams restarts in context 0
+void countContexts(const uint8_t* data, size_t n, int streams, vector<uint32_t>& counts) {
+    counts.assign(256 * 256, 0);
+    size_t part = (n + streams - 1) / streams;
+    for (size_t start = 0; start < n; start += part) {
+        size_t end = min(n, start + part);
+        uint32_t prev = 0;
+        for (size_t i = start; i < end; i++) {
+            counts[(prev << 8) | data[i]]++;
+            prev = data[i];
+        }
+    }
+}
+
+// f * log2(f); a table covers the small counts that dominate sparse histograms
+double xlog2x(uint64_t f) {
+    static const vector<double> table = [] {
+        vector<double> t(4096, 0.0);
+        for (size_t i = 1; i < t.size(); i++) t[i] = i * log2((double)i);
+        return t;
+    }();
+    return f < table.size() ? table[(size_t)f] : f * log2((double)f);
+}
+
+double entropyBits(const uint32_t* counts, int size, uint64_t total) {
+    double bits = xlog2x(total);
+    for (int i = 0; i < size; i++) bits -= xlog2x(counts[i]);
+    return bits;
+}
+
+// order-0 minus order-1 entropy of a sample, as a fraction of the order-0 bits; the order-1
+// side carries the Miller-Madow correction so sparse contexts do not look predictable
+double estimateContextGain(const uint8_t* data, size_t n) {
+    vector<uint32_t> counts;
+    countContexts(data, n, 1, counts);
+    uint32_t order0[256] = { 0 };
+    double order1 = 0;
+    for (int c = 0; c < 256; c++) {
+        const uint32_t* row = &counts[c << 8];
+        uint64_t total = 0;
+        int used = 0;
+        for (int s = 0; s < 256; s++) {
+            total += row[s];
+            order0[s] += row[s];
+            used += row[s] != 0;
+        }
+        if (total) order1 += entropyBits(row, 256, total) + (used - 1) / (2 * log(2.0));
+    }
+    double bits0 = entropyBits(order0, 256, n);
+    return bits0 > 0 ? (bits0 - order1) / bits0 : 0;
+}
+
+template <class Sink>
+void writeContextHeader(Sink& out, uint64_t symbolCount, const ContextGroups& groups, uint8_t flags) {
+    // group 0 takes the place of an order-0 block's table, so readStreamHeader still parses it
+    writeStreamHeader(out, symbolCount, groups.lens[0], flags | HUFF_FLAG_CONTEXT);
+    out.put((char)(groups.groupCount - 1));
+    for (int c = 0; c < 256; c += 2) out.put((char)((groups.groupOf[c] << 4) | groups.groupOf[c + 1]));
+    for (int g = 1; g < groups.groupCount; g++) {
+        int present = 0;
+        for (int i = 0; i < 256; i++) if (groups.lens[g][i]) ++present;
+        bool bitmap = present > SPARSE_TABLE_MAX_SYMBOLS;
+        out.put((char)(bitmap ? HUFF_FLAG_BITMAP_TABLE : 0));
+        writeLengthTable(out, groups.lens[g], bitmap);
+    }
+}
+
+// the rest of a context block's header; lens0 is the table readStreamHeader returned
+template <class Source>
+bool readContextHeader(Source& in, const uint8_t lens0[256], ContextGroups& groups) {
+    char c;
+    if (!in.get(c) || (uint8_t)c >= MAX_CONTEXT_GROUPS) return false;
+    groups.groupCount = (uint8_t)c + 1;
+    memcpy(groups.lens[0], lens0, 256);
+    for (int i = 0; i < 256; i += 2) {
+        if (!in.get(c)) return false;
+        groups.groupOf[i] = (uint8_t)c >> 4;
+        groups.groupOf[i + 1] = (uint8_t)c & 0x0F;
+        if (groups.groupOf[i] >= groups.groupCount || groups.groupOf[i + 1] >= groups.groupCount) return false;
+    }
+    for (int g = 1; g < groups.groupCount; g++) {
+        memset(groups.lens[g], 0, 256);
+        if (!in.get(c) || !readLengthTable(in, groups.lens[g], ((uint8_t)c & HUFF_FLAG_BITMAP_TABLE) != 0)) return false;
+    }
+    return true;
+}
+
+// clusters the contexts of a block and builds the group tables; false when the model is not
+// worth trying. codedSize receives the exact header size plus the payload bytes.
+bool planContextModel(const uint8_t* data, size_t n, int streams, int maxLen, ContextGroups& groups, size_t& codedSize) {
+    if (n < CONTEXT_MIN_SYMBOLS || estimateContextGain(data, min(n, CONTEXT_SAMPLE)) < CONTEXT_MIN_GAIN) return false;
+
+    vector<uint32_t> counts;
+    countContexts(data, n, streams, counts);
+    int used[256], usedCount = 0;
+    uint64_t contextTotal[256];
+    for (int c = 0; c < 256; c++) {
+        contextTotal[c] = 0;
+        for (int s = 0; s < 256; s++) contextTotal[c] += counts[(c << 8) | s];
+        if (contextTotal[c]) used[usedCount++] = c;
+    }
+    // most frequent contexts seed the groups
+    sort(used, used + usedCount, [&](int a, int b) {
+        return contextTotal[a] != contextTotal[b] ? contextTotal[a] > contextTotal[b] : a < b;
+    });
+    int k = (int)min<size_t>(min<size_t>(MAX_CONTEXT_GROUPS, max<size_t>(2, n / CONTEXT_SYMBOLS_PER_GROUP)), usedCount);
+    memset(groups.groupOf, 0, sizeof(groups.groupOf));
+    for (int i = 0; i < k; i++) groups.groupOf[used[i]] = (uint8_t)i;
+
+    int alphabet = 0;
+    for (int s = 0; s < 256; s++) {
+        uint64_t f = 0;
+        for (int i = 0; i < usedCount; i++) f += counts[(used[i] << 8) | s];
+        alphabet += f != 0;
+    }
+    // nonzero cells of each used context, for the distance loop
+    vector<uint32_t> cellStart(usedCount + 1);
+    vector<uint16_t> cellSym;
+    vector<uint32_t> cellCount;
+    for (int i = 0; i < usedCount; i++) {
+        cellStart[i] = (uint32_t)cellSym.size();
+        for (int s = 0; s < 256; s++) {
+            uint32_t f = counts[(used[i] << 8) | s];
+            if (!f) continue;
+            cellSym.push_back((uint16_t)s);
+            cellCount.push_back(f);
+        }
+    }
+    cellStart[usedCount] = (uint32_t)cellSym.size();
+
+    vector<float> cost(256 * (size_t)k); // symbol-major, so one cell updates all k distances at once
+    vector<uint64_t> groupFreqs((size_t)k * 256);
+    for (int round = 0; round < CONTEXT_CLUSTER_ROUNDS; round++) {
+        // group distributions (seeds only in the first round), smoothed so unseen bytes cost bits
+        fill(groupFreqs.begin(), groupFreqs.end(), 0);
+        int members = round == 0 ? k : usedCount;
+        for (int i = 0; i < members; i++) {
+            uint64_t* g = &groupFreqs[(size_t)groups.groupOf[used[i]] * 256];
+            for (int s = 0; s < 256; s++) g[s] += counts[(used[i] << 8) | s];
+        }
+        for (int g = 0; g < k; g++) {
+            uint64_t total = 0;
+            for (int s = 0; s < 256; s++) total += groupFreqs[(size_t)g * 256 + s];
+            for (int s = 0; s < 256; s++)
+                cost[(size_t)s * k + g] = (float)log2((total + 0.5 * alphabet) / (groupFreqs[(size_t)g * 256 + s] + 0.5));
+        }
+        bool moved = false;
+        for (int i = 0; i < usedCount; i++) {
+            float bits[MAX_CONTEXT_GROUPS] = { 0 };
+            for (uint32_t j = cellStart[i]; j < cellStart[i + 1]; j++) {
+                const float* sc = &cost[(size_t)cellSym[j] * k];
+                float f = (float)cellCount[j];
+                for (int g = 0; g < k; g++) bits[g] += f * sc[g];
+            }
+            int best = 0;
+            for (int g = 1; g < k; g++) if (bits[g] < bits[best]) best = g;
+            moved |= groups.groupOf[used[i]] != best;
+            groups.groupOf[used[i]] = (uint8_t)best;
+        }
+        if (round > 0 && !moved) break;
+    }
+
+    // final histograms; empty groups are dropped and the heaviest becomes group 0
+    fill(groupFreqs.begin(), groupFreqs.end(), 0);
+    for (int i = 0; i < usedCount; i++) {
+        uint64_t* g = &groupFreqs[(size_t)groups.groupOf[used[i]] * 256];
+        for (int s = 0; s < 256; s++) g[s] += counts[(used[i] << 8) | s];
+    }
+    uint64_t weight[MAX_CONTEXT_GROUPS];
+    int order[MAX_CONTEXT_GROUPS], rank[MAX_CONTEXT_GROUPS];
+    for (int g = 0; g < k; g++) {
+        weight[g] = 0;
+        for (int s = 0; s < 256; s++) weight[g] += groupFreqs[(size_t)g * 256 + s];
+        order[g] = g;
+    }
+    sort(order, order + k, [&](int a, int b) { return weight[a] != weight[b] ? weight[a] > weight[b] : a < b; });
+    groups.groupCount = 0;
+    uint64_t bits = 0;
+    for (int i = 0; i < k; i++) {
+        int g = order[i];
+        rank[g] = groups.groupCount;
+        if (!weight[g]) continue;
+        const uint64_t* freqs = &groupFreqs[(size_t)g * 256];
+        buildLengthLimitedCodes(freqs, maxLen, groups.lens[groups.groupCount]);
+        bits += encodedBitCount(freqs, groups.lens[groups.groupCount]);
+        groups.groupCount++;
+    }
+    for (int c = 0; c < 256; c++) groups.groupOf[c] = contextTotal[c] ? (uint8_t)rank[groups.groupOf[c]] : 0;
+
+    CountingWriter header{ 0 };
+    writeContextHeader(header, n, groups, 0);
+    codedSize = header.n + (size_t)((bits + 7) / 8);
+    return true;
+}
+
+void encodeContextSymbols(const unsigned char* data, size_t n, const HuffCode* const byContext[256], BitWriter& writer) {
+    uint8_t prev = 0;
+    size_t i = 0;
+    // codes are at most MAX_HEADER_CODE_LEN bits, so a pair fits one put
+    for (; i + 2 <= n; i += 2) {
+        const HuffCode& a = byContext[prev][data[i]];
+        const HuffCode& b = byContext[data[i]][data[i + 1]];
+        writer.put((a.bits << b.len) | b.bits, a.len + b.len);
+        prev = data[i + 1];
+    }
+    for (; i < n; i++) writer.put(byContext[prev][data[i]].bits, byContext[prev][data[i]].len);
+}
+
+// the payload after the stream header: one bitstream, or four quarters behind a jump table;
+// encode(data, n, writer) codes one of them
+template <class Encode>
+void writeBlockStreams(vector<uint8_t>& out, const uint8_t* data, size_t n, bool fourStreams, Encode encode) {
+    if (!fourStreams) {
+        BitWriter writer(out);
+        encode(data, n, writer);
+        writer.finish();
+        return;
+    }
+
+    // jump table is patched once the first three streams are written
+    size_t jumpTable = out.size();
+    out.resize(out.size() + FOUR_STREAM_JUMP_TABLE);
+    size_t quarter = (n + 3) / 4;
+    for (int k = 0; k < 4; k++) {
+        size_t start = out.size();
+        BitWriter writer(out);
+        encode(data + k * quarter, min(quarter, n - k * quarter), writer);
+        writer.finish();
+        if (k < 3) {
+            uint32_t streamSize = (uint32_t)(out.size() - start);
+            for (int i = 0; i < 4; i++) out[jumpTable + 4 * k + i] = (uint8_t)(streamSize >> (8 * i));
+        }
+    }
+}
+
+// one block with its own histogram and code table(s); freqs receives the block's histogram
+void encodeModelBlock(const uint8_t* data, size_t n, vector<uint8_t>& out, int maxCodeLen, uint64_t freqs[256],
+    bool fourStreams) {
+    memset(freqs, 0, 256 * sizeof(uint64_t));
+    countFrequencies(data, n, freqs, 1); // blocks already run one per worker
+    int maxLen = min(maxCodeLen, MAX_HEADER_CODE_LEN);
+    uint8_t lens[256];
+    buildLengthLimitedCodes(freqs, maxLen, lens);
+    fourStreams = fourStreams && n >= FOUR_STREAM_MIN_SYMBOLS;
+    uint8_t flags = fourStreams ? HUFF_FLAG_FOUR_STREAMS : 0;
+    size_t order0Size = (size_t)codedStreamSize(n, freqs, lens, flags);
+    size_t storedSize = (size_t)storedStreamSize(n);
+    size_t streamsOverhead = fourStreams ? FOUR_STREAM_JUMP_TABLE + 3 : 0; // jump table, padding
+
+    out.clear();
+    VectorWriter header{ out };
+    ContextGroups groups;
+    size_t contextSize;
+    // the order-1 model also decodes slower, so it has to save at least 1%
+    if (planContextModel(data, n, fourStreams ? 4 : 1, maxLen, groups, contextSize) &&
+        contextSize + order0Size / 100 < order0Size && contextSize + streamsOverhead < storedSize) {
+        vector<HuffCode> codes((size_t)groups.groupCount * 256);
+        for (int g = 0; g < groups.groupCount; g++) assignCanonicalCodes(groups.lens[g], &codes[(size_t)g * 256]);
+        const HuffCode* byContext[256];
+        for (int c = 0; c < 256; c++) byContext[c] = &codes[(size_t)groups.groupOf[c] * 256];
+        out.reserve(64 + FOUR_STREAM_JUMP_TABLE + contextSize);
+        writeContextHeader(header, n, groups, flags);
+        writeBlockStreams(out, data, n, fourStreams, [&](const uint8_t* part, size_t len, BitWriter& writer) {
+            encodeContextSymbols(part, len, byContext, writer);
+        });
+        return;
+    }
+
+    // incompressible blocks are copied as they are: no encoding pass, and at most the
+    // stored header more than the raw bytes
+    if (order0Size + streamsOverhead >= storedSize) {
+        out.reserve(storedSize);
+        writeStoredHeader(header, n);
+        header.write(reinterpret_cast<const char*>(data), n);
+        return;
+    }
+
+    HuffCode codes[256];
+    assignCanonicalCodes(lens, codes);
+    out.reserve(64 + FOUR_STREAM_JUMP_TABLE + order0Size);
+    writeStreamHeader(header, n, lens, flags);
+    writeBlockStreams(out, data, n, fourStreams, [&](const uint8_t* part, size_t len, BitWriter& writer) {
+        encodeSymbols(part, len, codes, writer);
+    });
+}
+
+/*
+ Long byte runs
+ A Huffman code spends at least one bit per byte, even on a block of zeros, so sparse binaries
+ (zero-filled sections, padding, bitmaps) pay for every byte of their runs. Runs of at least
+ RLE_MIN_RUN bytes become a three-part token - the block's rarest byte as escape, the run byte,
+ the run length - and the token string is coded as an ordinary block. Decoding copies literal
+ spans and fills runs with memset.
+*/
+const size_t RLE_MIN_RUN = 8;
+
+// bytes of data sitting in runs long enough to become tokens; such a run spans two probes
+// RLE_MIN_RUN / 2 apart, so only probes that match are followed up
+size_t runBytes(const uint8_t* data, size_t n) {
+    const size_t stride = RLE_MIN_RUN / 2;
+    size_t total = 0, covered = 0;
+    for (size_t k = 0; k + stride < n; k += stride) {
+        if (k < covered || data[k] != data[k + stride]) continue;
+        size_t i = k, j = k + 1;
+        while (i > covered && data[i - 1] == data[k]) i--;
+        while (j < n && data[j] == data[k]) j++;
+        if (j - i >= RLE_MIN_RUN) total += j - i;
+        covered = j;
+    }
+    return total;
+}
+
+// escape, run byte, length - 1 for runs and for every escape byte; other bytes as they are
+void buildRunTokens(const uint8_t* data, size_t n, uint8_t escape, vector<uint8_t>& tokens) {
+    tokens.clear();
+    VectorWriter sink{ tokens };
+    for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && data[j] == data[i]) j++;
+        if (j - i >= RLE_MIN_RUN || data[i] == escape) {
+            tokens.push_back(escape);
+            tokens.push_back(data[i]);
+            writeVarint(sink, j - i - 1);
+        }
+        else tokens.insert(tokens.end(), data + i, data + j);
+        i = j;
+    }
+}
+
+// replaces out with a runs block when that comes out smaller
+void tryRunsBlock(const uint8_t* data, size_t n, vector<uint8_t>& out, int maxCodeLen, const uint64_t freqs[256],
+    bool fourStreams) {
+    if (runBytes(data, n) < n / 8) return;
+    int escape = 0;
+    for (int c = 1; c < 256; c++) if (freqs[c] < freqs[escape]) escape = c;
+    vector<uint8_t> tokens, coded;
+    buildRunTokens(data, n, (uint8_t)escape, tokens);
+    uint64_t tokenFreqs[256];
+    encodeModelBlock(tokens.data(), tokens.size(), coded, maxCodeLen, tokenFreqs, fourStreams);
+
+    vector<uint8_t> block;
+    VectorWriter header{ block };
+    header.put((char)HUFF_FLAG_RUNS);
+    writeVarint(header, n);
+    header.put((char)escape);
+    writeVarint(header, tokens.size());
+    if (block.size() + coded.size() >= out.size()) return;
+    block.insert(block.end(), coded.begin(), coded.end());
+    out.swap(block);
+}
+
+void encodeBlock(const uint8_t* data, size_t n, vector<uint8_t>& out, int maxCodeLen, uint64_t freqs[256],
+    bool fourStreams) {
+    encodeModelBlock(data, n, out, maxCodeLen, freqs, fourStreams);
+    tryRunsBlock(data, n, out, maxCodeLen, freqs, fourStreams);
+}
+
+// the token string is a nested block, which may not itself be a runs block
+bool decodeRunsBlock(MemoryReader& in, uint8_t* out, size_t n) {
+    char escapeByte;
+    uint64_t tokenCount;
+    if (!in.get(escapeByte) || !readVarint(in, tokenCount)) return false;
+    if (tokenCount > 3 * (uint64_t)n || in.cur == in.end || (*in.cur & HUFF_FLAG_RUNS)) return false;
+    thread_local vector<uint8_t> tokens;
+    tokens.resize((size_t)tokenCount);
+    if (!decodeBlock(in.cur, (size_t)(in.end - in.cur), tokens.data(), tokenCount)) return false;
+
+    uint8_t escape = (uint8_t)escapeByte;
+    MemoryReader t{ tokens.data(), tokens.data() + tokens.size() };
+    uint8_t* o = out;
+    uint8_t* end = out + n;
+    while (t.cur < t.end) {
+        const uint8_t* next = (const uint8_t*)memchr(t.cur, escape, (size_t)(t.end - t.cur));
+        size_t span = (size_t)((next ? next : t.end) - t.cur);
+        if (span > (size_t)(end - o)) return false;
+        memcpy(o, t.cur, span);
+        o += span;
+        t.cur += span;
+        if (!next) break;
+        char run;
+        uint64_t len;
+        t.cur++;
+        if (!t.get(run) || !readVarint(t, len) || len >= (uint64_t)(end - o)) return false;
+        memset(o, (uint8_t)run, (size_t)len + 1);
+        o += len + 1;
+    }
+    return o == end;
+}
+
+// context blocks: one decode table per group, reused across blocks decoded on the same thread
+bool decodeContextBlock(MemoryReader& in, uint8_t flags, const uint8_t lens0[256], uint8_t* out, size_t n) {
+    ContextGroups groups;
+    if (!readContextHeader(in, lens0, groups)) return false;
+    thread_local unique_ptr<DecodeTable[]> tables(new DecodeTable[MAX_CONTEXT_GROUPS]);
+    for (int g = 0; g < groups.groupCount; g++)
+        if (!buildDecodeTableFromLengths(groups.lens[g], tables[g])) return false;
+    ContextTables model;
+    for (int c = 0; c < 256; c++) model.byContext[c] = tables[groups.groupOf[c]].entries();
+
+    size_t payload = (size_t)(in.end - in.cur);
+    if (flags & HUFF_FLAG_FOUR_STREAMS) return decodeFourStreams(in.cur, payload, model, out, n);
+    BitReader reader(in.cur, payload);
+    int64_t bitsLeft = 8 * (int64_t)payload;
+    bool invalid = false;
+    uint8_t prev = 0;
+    for (size_t i = 0; i < n; i++) out[i] = prev = decodeStep(reader, model.select(prev), bitsLeft, invalid);
+    return !invalid && bitsLeft >= 0;
+}
+
+// out must have room for rawSize bytes
+bool decodeBlock(const uint8_t* data, size_t size, uint8_t* out, uint64_t rawSize) {
+    MemoryReader in{ data, data + size };
+    uint8_t flags, lens[256];
+    uint64_t symbolCount;
+    if (!readStreamHeader(in, flags, symbolCount, lens) || symbolCount != rawSize) return false;
+    if (symbolCount == 0) return true;
+    if (flags & HUFF_FLAG_STORED) {
+        if ((uint64_t)(in.end - in.cur) != rawSize) return false;
+        memcpy(out, in.cur, (size_t)rawSize);
+        return true;
+    }
+    if (flags & HUFF_FLAG_RUNS) return decodeRunsBlock(in, out, (size_t)rawSize);
+    if (flags & HUFF_FLAG_CONTEXT) return decodeContextBlock(in, flags, lens, out, (size_t)rawSize);
+    DecodeTable table;
+    if (!buildDecodeTableFromLengths(lens, table)) return false;
+    size_t payload = (size_t)(in.end - in.cur);
+    if (flags & HUFF_FLAG_FOUR_STREAMS) return decodeFourStreams(in.cur, payload, OneTable{ table.entries() }, out, (size_t)rawSize);
+    BitReader reader(in.cur, payload);
+    uint64_t bitsLeft = 8 * (uint64_t)payload;
+    return decodeTableRun(reader, table, bitsLeft, out, (size_t)rawSize) == (int64_t)rawSize;
+}
+
+template <class Sink>
+void writeBlockIndex(Sink& out, const vector<BlockInfo>& index, uint64_t indexOffset) {
+    writeVarint(out, index.size());
+    for (size_t i = 0; i < index.size(); i++) {
+        writeVarint(out, index[i].rawSize);
+        writeVarint(out, index[i].codedSize);
+    }
+    uint8_t trailer[8];
+    for (int i = 0; i < 8; i++) trailer[i] = (uint8_t)(indexOffset >> (8 * i));
+    out.write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+}
+
+// in-memory compression of a whole buffer into the v3 container
+void compressBlocks(const uint8_t* data, size_t n, vector<uint8_t>& out, ThreadPool& pool,
+    size_t blockSize, int maxCodeLen, bool fourStreams) {
+    blockSize = min(max(blockSize, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE);
+    size_t blockCount = (n + blockSize - 1) / blockSize;
+    vector<vector<uint8_t>> coded(blockCount);
+    vector<future<void>> done;
+    for (size_t b = 0; b < blockCount; b++) {
+        done.push_back(pool.submit([&, b] {
+            uint64_t freqs[256];
+            size_t start = b * blockSize;
+            encodeBlock(data + start, min(blockSize, n - start), coded[b], maxCodeLen, freqs, fourStreams);
+        }));
+    }
+    for (size_t b = 0; b < done.size(); b++) done[b].get();
+
+    out.clear();
+    VectorWriter writer{ out };
+    writer.put((char)HUFF_SIGNATURE);
+    writer.put((char)HUFF_FORMAT_BLOCKS);
+    writeVarint(writer, blockSize);
+    vector<BlockInfo> index(blockCount);
+    for (size_t b = 0; b < blockCount; b++) {
+        index[b].rawSize = min(blockSize, n - b * blockSize);
+        index[b].codedSize = coded[b].size();
+        out.insert(out.end(), coded[b].begin(), coded[b].end());
+    }
+    writeBlockIndex(writer, index, out.size());
+}
+
+// where the container writer takes its blocks from: a mapped file, or a stream read block by
+// block (after head, bytes a caller already took from the stream)
+struct BlockInput {
+    ByteSpan whole;
+    bool isMapped;
+    istream* in;
+    ByteSpan head;
+    uint64_t taken;
+
+    // the next block, at most blockSize bytes (empty at the end); raw is the slot's buffer
+    ByteSpan next(vector<uint8_t>& raw, size_t blockSize) {
+        if (isMapped) {
+            size_t got = (size_t)min<uint64_t>(blockSize, whole.size - taken);
+            ByteSpan block{ whole.data + taken, got };
+            taken += got;
+            return block;
+        }
+        raw.resize(blockSize);
+        size_t got = 0;
+        if (taken < head.size) {
+            got = (size_t)min<uint64_t>(blockSize, head.size - taken);
+            memcpy(raw.data(), head.data + taken, got);
+            taken += got;
+        }
+        if (got < blockSize && *in) {
+            in->read(reinterpret_cast<char*>(raw.data() + got), blockSize - got);
+            got += (size_t)in->gcount();
+        }
+        return ByteSpan{ raw.data(), got };
+    }
+};
+
+// the container writer behind compressFileBlocks and compressStreamBlocks: a batch of blocks
+// per round (two per worker), so memory stays bounded; the output is written front to back
+// (the index offset is counted, not asked of the stream), so it can be a pipe
+bool writeBlockContainer(BlockInput& input, ostream& out, uint64_t freqs[256], uint64_t& origBytes,
+    size_t blockSize, int threads, int maxCodeLen, bool fourStreams, JobProgress* job) {
+    ThreadPool pool(threads);
+    blockSize = min(max(blockSize, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE);
+    CountingWriter header{ 0 };
+    header.put((char)HUFF_SIGNATURE);
+    header.put((char)HUFF_FORMAT_BLOCKS);
+    writeVarint(header, blockSize);
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)HUFF_FORMAT_BLOCKS);
+    writeVarint(out, blockSize);
+    uint64_t written = header.n;
+
+    size_t batch = 2 * (size_t)pool.size();
+    vector<vector<uint8_t>> raw(batch), coded(batch);
+    vector<ByteSpan> blocks(batch);
+    vector<array<uint64_t, 256>> blockFreqs(batch);
+    vector<BlockInfo> index;
+    memset(freqs, 0, 256 * sizeof(uint64_t));
+    origBytes = 0;
+    jobBegin(job, JOB_ENCODING, input.isMapped ? input.whole.size : 0);
+
+    bool more = true;
+    while (more) {
+        size_t filled = 0;
+        while (filled < batch) {
+            blocks[filled] = input.next(raw[filled], blockSize);
+            size_t got = blocks[filled].size;
+            origBytes += got;
+            if (got > 0) filled++;
+            if (got < blockSize) { more = false; break; }
+        }
+        vector<future<void>> done;
+        for (size_t b = 0; b < filled; b++) {
+            done.push_back(pool.submit([&, b] {
+                encodeBlock(blocks[b].data, blocks[b].size, coded[b], maxCodeLen, blockFreqs[b].data(), fourStreams);
+            }));
+        }
+        for (size_t b = 0; b < done.size(); b++) done[b].get();
+        uint64_t batchBytes = 0;
+        for (size_t b = 0; b < filled; b++) {
+            out.write(reinterpret_cast<const char*>(coded[b].data()), coded[b].size());
+            written += coded[b].size();
+            index.push_back(BlockInfo{ blocks[b].size, coded[b].size() });
+            for (int i = 0; i < 256; i++) freqs[i] += blockFreqs[b][i];
+            batchBytes += blocks[b].size;
+        }
+        if (!jobAdvance(job, batchBytes) || !out) return false;
+    }
+    if (!input.isMapped && input.in->bad()) return false;
+    writeBlockIndex(out, index, written);
+    out.flush();
+    return (bool)out;
+}
+
+// file version: blocks come straight from the mapped input, or are read into per-slot
+// buffers when the input cannot be mapped. freqs/origBytes receive the whole-file totals.
+bool compressFileBlocks(const string& inPath, const string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    size_t blockSize, int threads, int maxCodeLen, bool fourStreams, JobProgress* job) {
+    MappedInput mapped;
+    ifstream in;
+    BlockInput input{ ByteSpan{ nullptr, 0 }, mapped.open(inPath), &in, ByteSpan{ nullptr, 0 }, 0 };
+    if (input.isMapped) input.whole = mapped.span();
+    else {
+        in.open(inPath, ios::binary);
+        if (!in) return false;
+    }
+    ofstream out(outPath, ios::binary);
+    if (!out) { cerr << "Cannot open output file\n"; return false; }
+    bool ok = writeBlockContainer(input, out, freqs, origBytes, blockSize, threads, maxCodeLen, fourStreams, job);
+    out.close();
+    return ok && (bool)out;
+}
+
+bool compressStreamBlocks(istream& in, ostream& out, ByteSpan head, size_t blockSize, int threads, int maxCodeLen) {
+    BlockInput input{ ByteSpan{ nullptr, 0 }, false, &in, head, 0 };
+    uint64_t freqs[256], origBytes;
+    return writeBlockContainer(input, out, freqs, origBytes, blockSize, threads, maxCodeLen, true, nullptr);
+}
+
+// walks the block index (index points at its first byte, the trailer excluded), handing
+// every block to visit(const SeekEntry&) in file order; stops early if visit returns false
+template <class Visit>
+bool walkBlockIndex(const uint8_t* index, size_t indexSize, uint64_t dataStart, uint64_t indexOffset,
+    uint64_t& count, Visit visit) {
+    MemoryReader in{ index, index + indexSize };
+    if (!readVarint(in, count) || count > indexSize) return false;
+    SeekEntry e;
+    e.rawOffset = 0;
+    e.fileOffset = dataStart;
+    for (uint64_t b = 0; b < count; b++) {
+        if (!readVarint(in, e.rawSize) || !readVarint(in, e.codedSize)) return false;
+        if (e.rawSize > MAX_BLOCK_SIZE || e.codedSize > indexOffset - e.fileOffset) return false;
+        if (!visit(e)) return false;
+        e.rawOffset += e.rawSize;
+        e.fileOffset += e.codedSize;
+    }
+    return e.fileOffset == indexOffset;
+}
+
+bool parseSeekTable(const uint8_t* index, size_t indexSize, uint64_t dataStart, uint64_t indexOffset,
+    vector<SeekEntry>& table) {
+    table.clear();
+    uint64_t count;
+    return walkBlockIndex(index, indexSize, dataStart, indexOffset, count,
+        [&table](const SeekEntry& e) { table.push_back(e); return true; });
+}
+
+uint64_t loadTrailerOffset(const uint8_t trailer[8]) {
+    uint64_t offset = 0;
+    for (int i = 0; i < 8; i++) offset |= (uint64_t)trailer[i] << (8 * i);
+    return offset;
+}
+
+// builds the seek table from the block index; the stream is positioned just after the signature
+bool readSeekTable(istream& in, vector<SeekEntry>& table) {
+    uint64_t blockSize;
+    if (!readVarint(in, blockSize)) return false;
+    uint64_t dataStart = (uint64_t)in.tellg();
+    in.seekg(0, ios::end);
+    uint64_t fileSize = (uint64_t)in.tellg();
+    if (fileSize < dataStart + 8) return false;
+    uint8_t trailer[8];
+    in.seekg(fileSize - 8);
+    if (!in.read(reinterpret_cast<char*>(trailer), sizeof(trailer))) return false;
+    uint64_t indexOffset = loadTrailerOffset(trailer);
+    if (indexOffset < dataStart || indexOffset > fileSize - 8) return false;
+
+    vector<uint8_t> index((size_t)(fileSize - 8 - indexOffset));
+    in.seekg(indexOffset);
+    if (!in.read(reinterpret_cast<char*>(index.data()), index.size())) return false;
+    return parseSeekTable(index.data(), index.size(), dataStart, indexOffset, table);
+}
+
+// finds the block index of a whole v3 file in memory
+bool locateBlockIndex(ByteSpan file, uint64_t& dataStart, uint64_t& indexOffset) {
+    MemoryReader in{ file.data, file.data + file.size };
+    char sig[2];
+    uint64_t blockSize;
+    if (!in.read(sig, sizeof(sig)) || !readVarint(in, blockSize)) return false;
+    dataStart = (uint64_t)(in.cur - file.data);
+    if (file.size < dataStart + 8) return false;
+    indexOffset = loadTrailerOffset(file.data + file.size - 8);
+    return indexOffset >= dataStart && indexOffset <= file.size - 8;
+}
+
+// same for a whole v3 file in memory
+bool readSeekTable(ByteSpan file, vector<SeekEntry>& table) {
+    uint64_t dataStart, indexOffset;
+    if (!locateBlockIndex(file, dataStart, indexOffset)) return false;
+    return parseSeekTable(file.data + indexOffset, (size_t)(file.size - 8 - indexOffset), dataStart, indexOffset, table);
+}
+
+// opens a .huff file and loads its seek table; false if it is not a block container
+bool openBlockContainer(const string& inPath, ifstream& in, vector<SeekEntry>& table) {
+    in.open(inPath, ios::binary);
+    if (!in) return false;
+    uint8_t sig[2];
+    if (!in.read(reinterpret_cast<char*>(sig), sizeof(sig))) return false;
+    if (sig[0] != HUFF_SIGNATURE || sig[1] != HUFF_FORMAT_BLOCKS) return false;
+    return readSeekTable(in, table);
+}
+
+// reads one block through the seek table and decodes it into raw
+bool decodeBlockAt(istream& in, const SeekEntry& e, vector<uint8_t>& coded, vector<uint8_t>& raw) {
+    coded.resize((size_t)e.codedSize);
+    raw.resize((size_t)e.rawSize);
+    in.seekg(e.fileOffset);
+    if (!in.read(reinterpret_cast<char*>(coded.data()), coded.size())) return false;
+    return decodeBlock(coded.data(), coded.size(), raw.data(), e.rawSize);
+}
+
+// sequential decode of a v3 file; the stream is positioned just after the signature
+bool decodeBlockContainer(istream& in, ostream& out, JobProgress* job = nullptr) {
+    vector<SeekEntry> table;
+    if (!readSeekTable(in, table)) return false;
+    jobBegin(job, JOB_DECODING, table.empty() ? 0 : table.back().rawOffset + table.back().rawSize);
+    vector<uint8_t> coded, raw;
+    for (size_t b = 0; b < table.size(); b++) {
+        if (!decodeBlockAt(in, table[b], coded, raw)) return false;
+        out.write(reinterpret_cast<const char*>(raw.data()), raw.size());
+        if (!jobAdvance(job, raw.size())) return false;
+    }
+    return (bool)out;
+}
+
+// decodes a whole .huff file in memory to a stream; block containers go out block by block,
+// so only one raw block is held at a time
+bool decompressToStream(ByteSpan in, ostream& out) {
+    if (in.size < 2 || in.data[0] != HUFF_SIGNATURE || in.data[1] != HUFF_FORMAT_BLOCKS) {
+        vector<uint8_t> raw;
+        if (!decompress(in, raw)) return false;
+        out.write(reinterpret_cast<const char*>(raw.data()), raw.size());
+        return (bool)out;
+    }
+    vector<SeekEntry> table;
+    if (!readSeekTable(in, table)) return false;
+    vector<uint8_t> raw;
+    for (size_t b = 0; b < table.size(); b++) {
+        const SeekEntry& e = table[b];
+        raw.resize((size_t)e.rawSize);
+        if (!decodeBlock(in.data + e.fileOffset, (size_t)e.codedSize, raw.data(), e.rawSize)) return false;
+        out.write(reinterpret_cast<const char*>(raw.data()), raw.size());
+        if (!out) return false;
+    }
+    return true;
+}
+
+// parallel decode of a mapped v3 file straight into the mapped output
+bool decompressSpanParallel(ByteSpan file, const string& outPath, int threads = 0, JobProgress* job = nullptr) {
+    vector<SeekEntry> table;
+    if (!readSeekTable(file, table)) return false;
+    uint64_t totalSize = table.empty() ? 0 : table.back().rawOffset + table.back().rawSize;
+    MappedOutput out;
+    if (!out.create(outPath, totalSize)) return false;
+
+    ThreadPool pool(threads);
+    atomic<bool> failed(false);
+    vector<future<void>> done;
+    jobBegin(job, JOB_DECODING, totalSize);
+    for (size_t b = 0; b < table.size(); b++) {
+        done.push_back(pool.submit([&, b] {
+            if (failed || jobCancelled(job)) return; // queued blocks drain without work
+            const SeekEntry& e = table[b];
+            if (!decodeBlock(file.data + e.fileOffset, (size_t)e.codedSize, out.data() + e.rawOffset, e.rawSize))
+                failed = true;
+            jobAdvance(job, e.rawSize);
+        }));
+    }
+    for (size_t b = 0; b < done.size(); b++) done[b].get();
+    return out.finish(totalSize) && !failed && !jobCancelled(job);
+}
+
+// parallel decode of a v3 file: the output is preallocated and every worker writes each
+// block it decodes at the block's final offset (through the mappings when both files can
+// be mapped, otherwise with its own file handles)
+bool decompressFileParallel(const string& inPath, const string& outPath, int threads, JobProgress* job) {
+    if (!mappableOutput(outPath)) {
+        // no offsets to write at: blocks are decoded in order through a buffered stream
+        ifstream in(inPath, ios::binary);
+        ofstream out(outPath, ios::binary);
+        uint8_t sig[2];
+        if (!in || !out || !in.read(reinterpret_cast<char*>(sig), sizeof(sig))) return false;
+        if (sig[0] != HUFF_SIGNATURE || sig[1] != HUFF_FORMAT_BLOCKS) return false;
+        return decodeBlockContainer(in, out, job);
+    }
+    MappedInput mapped;
+    if (mapped.open(inPath)) return decompressSpanParallel(mapped.span(), outPath, threads, job);
+
+    ifstream in;
+    vector<SeekEntry> table;
+    if (!openBlockContainer(inPath, in, table)) return false;
+    in.close();
+    uint64_t totalSize = table.empty() ? 0 : table.back().rawOffset + table.back().rawSize;
+    {
+        ofstream out(outPath, ios::binary);
+        if (!out) return false;
+        if (totalSize > 0) {
+            out.seekp(totalSize - 1);
+            out.put(0);
+        }
+        if (!out) return false;
+    }
+
+    ThreadPool pool(threads);
+    atomic<size_t> nextBlock(0);
+    atomic<bool> failed(false);
+    vector<future<void>> done;
+    jobBegin(job, JOB_DECODING, totalSize);
+    for (int w = 0; w < pool.size(); w++) {
+        done.push_back(pool.submit([&] {
+            ifstream src(inPath, ios::binary);
+            fstream dst(outPath, ios::in | ios::out | ios::binary);
+            if (!src || !dst) { failed = true; return; }
+            vector<uint8_t> coded, raw;
+            for (size_t b = nextBlock++; b < table.size() && !failed; b = nextBlock++) {
+                if (!decodeBlockAt(src, table[b], coded, raw)) { failed = true; return; }
+                dst.seekp(table[b].rawOffset);
+                dst.write(reinterpret_cast<const char*>(raw.data()), raw.size());
+                if (!dst) { failed = true; return; }
+                if (!jobAdvance(job, raw.size())) return;
+            }
+        }));
+    }
+    for (size_t w = 0; w < done.size(); w++) done[w].get();
+    return !failed && !jobCancelled(job);
+}
+
+// decodes only the blocks overlapping [offset, offset + length) of the original data;
+// the range is clipped to the end of the data
+bool decompressRange(const string& inPath, uint64_t offset, uint64_t length, vector<uint8_t>& out) {
+    out.clear();
+    ifstream in;
+    vector<SeekEntry> table;
+    if (!openBlockContainer(inPath, in, table)) return false;
+    uint64_t totalSize = table.empty() ? 0 : table.back().rawOffset + table.back().rawSize;
+    if (offset >= totalSize) return length == 0 || offset == totalSize;
+    uint64_t end = offset + min(length, totalSize - offset);
+    out.reserve((size_t)(end - offset));
+
+    // last block starting at or before offset
+    size_t b = upper_bound(table.begin(), table.end(), offset,
+        [](uint64_t pos, const SeekEntry& e) { return pos < e.rawOffset; }) - table.begin() - 1;
+    vector<uint8_t> coded, raw;
+    for (; b < table.size() && table[b].rawOffset < end; b++) {
+        if (!decodeBlockAt(in, table[b], coded, raw)) return false;
+        uint64_t from = max(offset, table[b].rawOffset) - table[b].rawOffset;
+        uint64_t to = min(end, table[b].rawOffset + table[b].rawSize) - table[b].rawOffset;
+        out.insert(out.end(), raw.begin() + (size_t)from, raw.begin() + (size_t)to);
+    }
+    return true;
+}
+
+/*
+ Shared dictionaries (format v4, layout in huffman_core.h)
+ Registered dictionaries live for the rest of the process with their code and decode tables
+ built, so a frame costs a map lookup instead of a table build. IDs are content hashes: a
+ second registration of an ID is the same dictionary and is a no-op.
+*/
+struct DictionaryEntry {
+    HuffDictionary dict;
+    HuffCode codes[256];
+    DecodeTable table;
+};
+
+mutex& dictionaryLock() {
+    static mutex lock;
+    return lock;
+}
+
+map<uint32_t, unique_ptr<DictionaryEntry>>& dictionaryRegistry() {
+    static map<uint32_t, unique_ptr<DictionaryEntry>> registry;
+    return registry;
+}
+
+uint32_t dictionaryHash(uint8_t module, const uint8_t lens[256]) {
+    uint32_t h = 2166136261u;
+    h = (h ^ module) * 16777619u;
+    for (int i = 0; i < 256; i++) h = (h ^ lens[i]) * 16777619u;
+    return h;
+}
+
+uint32_t loadLE32(const uint8_t b[4]) {
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+void storeLE32(uint8_t b[4], uint32_t v) {
+    for (int i = 0; i < 4; i++) b[i] = (uint8_t)(v >> (8 * i));
+}
+
+const DictionaryEntry* findDictionary(uint32_t id) {
+    lock_guard<mutex> hold(dictionaryLock());
+    auto it = dictionaryRegistry().find(id);
+    return it == dictionaryRegistry().end() ? nullptr : it->second.get();
+}
+
+// null if the dictionary is damaged: wrong ID, or a byte value without a code
+const DictionaryEntry* addDictionary(const HuffDictionary& dict) {
+    if (dict.id != dictionaryHash(dict.module, dict.lens)) return nullptr;
+    for (int i = 0; i < 256; i++) if (!dict.lens[i]) return nullptr;
+    lock_guard<mutex> hold(dictionaryLock());
+    unique_ptr<DictionaryEntry>& slot = dictionaryRegistry()[dict.id];
+    if (slot) return slot.get();
+    unique_ptr<DictionaryEntry> entry(new DictionaryEntry);
+    entry->dict = dict;
+    if (!assignCanonicalCodes(dict.lens, entry->codes) || !buildDecodeTableFromLengths(dict.lens, entry->table)) {
+        dictionaryRegistry().erase(dict.id);
+        return nullptr;
+    }
+    slot = move(entry);
+    return slot.get();
+}
+
+const char* dictionaryModuleName(uint8_t module) {
+    switch (module) {
+    case DICT_TEXT: return "text";
+    case DICT_AUDIO: return "audio";
+    case DICT_VIDEO: return "video";
+    default: return "any";
+    }
+}
+
+bool parseDictionaryModule(const string& name, uint8_t& module) {
+    const uint8_t all[] = { DICT_ANY, DICT_TEXT, DICT_AUDIO, DICT_VIDEO };
+    for (uint8_t m : all) {
+        if (name == dictionaryModuleName(m)) {
+            module = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+// one histogram over all samples; byte values the samples never use still get (long) codes
+void trainDictionary(const vector<ByteSpan>& samples, uint8_t module, int maxCodeLen, HuffDictionary& dict) {
+    uint64_t freqs[256] = { 0 };
+    for (const ByteSpan& sample : samples) countFrequencies(sample.data, sample.size, freqs);
+    for (int i = 0; i < 256; i++) freqs[i]++;
+    buildLengthLimitedCodes(freqs, min(max(maxCodeLen, MIN_DICT_CODE_LEN), MAX_HEADER_CODE_LEN), dict.lens);
+    dict.module = module;
+    dict.id = dictionaryHash(module, dict.lens);
+}
+
+bool saveDictionary(const string& path, const HuffDictionary& dict) {
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+    uint8_t id[4];
+    storeLE32(id, dict.id);
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)HUFF_DICTIONARY_FILE);
+    out.put((char)dict.module);
+    out.write(reinterpret_cast<const char*>(id), sizeof(id));
+    writeLengthTable(out, dict.lens, true);
+    out.close();
+    return (bool)out;
+}
+
+bool loadDictionary(const string& path, HuffDictionary& dict) {
+    ifstream in(path, ios::binary);
+    uint8_t head[7];
+    if (!in || !in.read(reinterpret_cast<char*>(head), sizeof(head))) return false;
+    if (head[0] != HUFF_SIGNATURE || head[1] != HUFF_DICTIONARY_FILE) return false;
+    dict.module = head[2];
+    dict.id = loadLE32(head + 3);
+    memset(dict.lens, 0, sizeof(dict.lens));
+    return readLengthTable(in, dict.lens, true) && addDictionary(dict) != nullptr;
+}
+
+bool registerDictionary(const HuffDictionary& dict) {
+    return addDictionary(dict) != nullptr;
+}
+
+bool haveDictionary(uint32_t id) {
+    return findDictionary(id) != nullptr;
+}
+
+/*
+ Adaptive Huffman (format v5, layout in huffman_core.h)
+ FGK tree over the 256 byte values and the NYT leaf: at most 257 leaves and 513 nodes, kept
+ in arrays indexed by node number. Numbers follow weight (sibling property): the root has the
+ highest, children are numbered below their parent, the right child just above the left one.
+ After a symbol, its leaf and then each ancestor first swaps with the highest-numbered node
+ of its weight (its block leader), then gains one, which keeps the property intact.
+*/
+const int ADAPTIVE_NODES = 2 * 257 - 1;
+const uint16_t ADAPTIVE_ROOT = ADAPTIVE_NODES - 1;
+const int16_t ADAPTIVE_INTERNAL = -1;
+const int16_t ADAPTIVE_NYT = 256;
+
+class AdaptiveTree {
+    uint64_t weight[ADAPTIVE_NODES];
+    uint16_t parent[ADAPTIVE_NODES];
+    uint16_t left[ADAPTIVE_NODES];
+    uint16_t right[ADAPTIVE_NODES];
+    int16_t symbol[ADAPTIVE_NODES]; // byte value, ADAPTIVE_NYT or ADAPTIVE_INTERNAL
+    uint16_t leafOf[256];           // NO_NODE until the byte's first occurrence
+    uint16_t nyt;
+    int lastNew;                    // some byte that has a leaf (for the end marker), -1 if none
+
+    // exchanges the subtrees at numbers a and b (equal weights, neither an ancestor of the other)
+    void swapNodes(uint16_t a, uint16_t b) {
+        swap(symbol[a], symbol[b]);
+        swap(left[a], left[b]);
+        swap(right[a], right[b]);
+        for (uint16_t n : { a, b }) {
+            if (symbol[n] == ADAPTIVE_INTERNAL) parent[left[n]] = parent[right[n]] = n;
+            else if (symbol[n] == ADAPTIVE_NYT) nyt = n;
+            else leafOf[symbol[n]] = n;
+        }
+    }
+
+    // the path is collected leaf to root (at most 256 steps), then written root first
+    void writeCode(uint16_t n, BitWriter& writer) const {
+        uint8_t path[ADAPTIVE_NODES];
+        int depth = 0;
+        for (; n != ADAPTIVE_ROOT; n = parent[n]) path[depth++] = right[parent[n]] == n;
+        while (depth > 0) {
+            int len = min(depth, 32);
+            uint64_t bits = 0;
+            for (int i = 0; i < len; i++) bits = (bits << 1) | path[--depth];
+            writer.put(bits, len);
+        }
+    }
+
+public:
+    AdaptiveTree() : nyt(ADAPTIVE_ROOT), lastNew(-1) {
+        weight[ADAPTIVE_ROOT] = 0;
+        parent[ADAPTIVE_ROOT] = NO_NODE;
+        symbol[ADAPTIVE_ROOT] = ADAPTIVE_NYT;
+        for (int i = 0; i < 256; i++) leafOf[i] = NO_NODE;
+    }
+
+    bool known(uint8_t s) const { return leafOf[s] != NO_NODE; }
+
+    void update(uint8_t s) {
+        uint16_t q = leafOf[s];
+        if (q == NO_NODE) {
+            // the NYT leaf becomes the parent of a new NYT (left) and the new leaf (right)
+            uint16_t p = nyt;
+            q = p - 1;
+            nyt = p - 2;
+            symbol[p] = ADAPTIVE_INTERNAL;
+            left[p] = nyt;
+            right[p] = q;
+            symbol[q] = s;
+            weight[q] = 0;
+            parent[q] = p;
+            symbol[nyt] = ADAPTIVE_NYT;
+            weight[nyt] = 0;
+            parent[nyt] = p;
+            leafOf[s] = q;
+            lastNew = s;
+        }
+        for (;;) {
+            // weights never decrease with the node number, so the leader is the last node of the
+            // run of equal weights starting at q (usually q itself or its neighbour)
+            uint16_t leader = q;
+            while (leader < ADAPTIVE_ROOT && weight[leader + 1] == weight[q]) leader++;
+            if (leader != q && leader != parent[q]) {
+                swapNodes(q, leader);
+                q = leader;
+            }
+            weight[q]++;
+            if (q == ADAPTIVE_ROOT) return;
+            q = parent[q];
+        }
+    }
+
+    void encode(uint8_t s, BitWriter& writer) {
+        if (known(s)) writeCode(leafOf[s], writer);
+        else {
+            writeCode(nyt, writer);
+            writer.put(s, 8);
+        }
+        update(s);
+    }
+
+    void encodeEnd(BitWriter& writer) {
+        if (lastNew < 0) return; // empty input, empty payload
+        writeCode(nyt, writer);
+        writer.put((uint64_t)lastNew, 8);
+    }
+
+    // decodes up to the end marker; reading past availBits means the stream is truncated.
+    // emit(byte) returns false to stop early (output full, job cancelled)
+    template <class Emit>
+    bool decode(BitReader& reader, uint64_t availBits, Emit emit) {
+        if (availBits == 0) return true;
+        uint64_t used = 0;
+        for (;;) {
+            uint16_t n = ADAPTIVE_ROOT;
+            while (symbol[n] == ADAPTIVE_INTERNAL) {
+                if (reader.bitCount == 0) reader.refill();
+                n = (reader.bitBuf >> 63) ? right[n] : left[n];
+                reader.consume(1);
+                used++;
+            }
+            uint8_t s;
+            if (n == nyt) {
+                if (reader.bitCount < 8) reader.refill();
+                s = (uint8_t)(reader.bitBuf >> 56);
+                reader.consume(8);
+                used += 8;
+                if (used > availBits) return false;
+                if (known(s)) return true;
+            }
+            else s = (uint8_t)symbol[n];
+            if (used > availBits || !emit(s)) return false;
+            update(s);
+        }
+    }
+};
+
+bool compressStreamAdaptive(istream& in, ostream& out, JobProgress* job) {
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)HUFF_FORMAT_ADAPTIVE);
+    unique_ptr<AdaptiveTree> tree(new AdaptiveTree);
+    vector<char> chunk(ADAPTIVE_CHUNK);
+    vector<uint8_t> buf;
+    BitWriter writer(buf, &out);
+    jobBegin(job, JOB_ENCODING, 0);
+    while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0) {
+        size_t n = (size_t)in.gcount();
+        for (size_t i = 0; i < n; i++) tree->encode((uint8_t)chunk[i], writer);
+        writer.flush(); // the output keeps pace with the input
+        if (!jobAdvance(job, n)) return false;
+    }
+    if (in.bad()) return false;
+    tree->encodeEnd(writer);
+    writer.finish();
+    out.flush();
+    return (bool)out;
+}
+
+bool compressAdaptive(ByteSpan in, vector<uint8_t>& out) {
+    out.assign({ HUFF_SIGNATURE, HUFF_FORMAT_ADAPTIVE });
+    unique_ptr<AdaptiveTree> tree(new AdaptiveTree);
+    BitWriter writer(out);
+    for (size_t i = 0; i < in.size; i++) tree->encode(in.data[i], writer);
+    tree->encodeEnd(writer);
+    writer.finish();
+    return !writer.overflowed();
+}
+
+// the payload of a v5 stream in memory (after the signature); emit as for AdaptiveTree::decode
+template <class Emit>
+bool decodeAdaptive(const uint8_t* data, size_t size, Emit emit) {
+    unique_ptr<AdaptiveTree> tree(new AdaptiveTree);
+    BitReader reader(data, size);
+    return tree->decode(reader, 8 * (uint64_t)size, emit);
+}
+
+// v5 from a stream (positioned after the signature) to a stream, in DECODE_OUT_BUFFER pieces
+bool decodeAdaptiveStream(istream& in, ostream& out, uint64_t availBits, JobProgress* job = nullptr) {
+    unique_ptr<AdaptiveTree> tree(new AdaptiveTree);
+    BitReader reader(in);
+    vector<char> buf(DECODE_OUT_BUFFER);
+    size_t pending = 0;
+    jobBegin(job, JOB_DECODING, 0);
+    bool ok = tree->decode(reader, availBits, [&](uint8_t s) {
+        buf[pending++] = (char)s;
+        if (pending < buf.size()) return true;
+        out.write(buf.data(), pending);
+        pending = 0;
+        return jobAdvance(job, buf.size()) && (bool)out;
+    });
+    out.write(buf.data(), pending);
+    return ok && (bool)out;
+}
+
+/*
+ Embedded streams
+ The sample formats keep the bytes around their samples (file headers, trailing chunks) as
+ plain v2 streams inside the file, each behind its length, so decoding is byte-exact.
+*/
+template <class Sink>
+bool writeEmbeddedStream(Sink& out, ByteSpan part) {
+    vector<uint8_t> packed;
+    if (!compress(part, packed)) return false;
+    writeVarint(out, packed.size());
+    out.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+    return true;
+}
+
+// plain v2 streams only: nothing nests
+bool readEmbeddedStream(MemoryReader& in, ByteSpan& part, uint64_t& rawSize) {
+    uint64_t size;
+    if (!readVarint(in, size) || size < 2 || size > (uint64_t)(in.end - in.cur)) return false;
+    if (in.cur[0] != HUFF_SIGNATURE || in.cur[1] != HUFF_FORMAT_V2) return false;
+    part = ByteSpan{ in.cur, (size_t)size };
+    in.cur += size;
+    return decompressedSize(part, rawSize);
+}
+
+/*
+ PCM audio (format v6, layout in huffman_core.h)
+ Every block tries the fixed polynomial predictors of order 0-4 and LPC predictors of a few
+ orders (Levinson-Durbin on the windowed autocorrelation, coefficients quantized to 15 bits)
+ on each channel signal, and keeps the one whose residuals code smallest. Two-channel files
+ also try side (left - right) and mid signals and code the cheapest pair. Signals stay
+ within AUDIO_SIGNAL_LIMIT (the side of 24-bit samples fits) and predictions are clamped, so
+ all arithmetic fits 32 bits except the LPC sums; decoders reject anything outside.
+*/
+const int32_t AUDIO_SIGNAL_LIMIT = 1 << 25;
+const int64_t AUDIO_PREDICTION_LIMIT = 1 << 28;
+const int AUDIO_MAX_CLASS = 31; // residuals stay below 2^30, so zigzag values below 2^31
+const int AUDIO_FIXED_ORDERS = 5;
+const int AUDIO_LPC_MAX_ORDER = 12; // the encoder's limit
+const int AUDIO_COEF_BITS = 15; // quantized coefficients are stored in 16 bits
+
+struct AudioPredictor {
+    int order;
+    bool lpc;
+    int shift;
+    int32_t coefs[AUDIO_MAX_ORDER]; // coefs[j] weighs the sample j + 1 steps back
+};
+
+inline int bitLength(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long top;
+    return _BitScanReverse(&top, v) ? (int)top + 1 : 0;
+#else
+    return v ? 32 - __builtin_clz(v) : 0;
+#endif
+}
+
+inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t unzigzag(uint32_t u) {
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+inline int32_t loadSample(const uint8_t* p, int bytes) {
+    if (bytes == 1) return (int32_t)p[0] - 128;
+    if (bytes == 2) return (int16_t)(p[0] | (p[1] << 8));
+    return (int32_t)((uint32_t)(p[0] | (p[1] << 8) | (p[2] << 16)) << 8) >> 8;
+}
+
+inline void storeSample(uint8_t* p, int32_t v, int bytes) {
+    if (bytes == 1) {
+        p[0] = (uint8_t)(v + 128);
+        return;
+    }
+    for (int i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+inline int32_t lpcPrediction(const int32_t* x, size_t i, const AudioPredictor& p) {
+    int64_t sum = 0;
+    for (int j = 0; j < p.order; j++) sum += (int64_t)p.coefs[j] * x[i - 1 - j];
+    return (int32_t)min(max(sum >> p.shift, -AUDIO_PREDICTION_LIMIT), AUDIO_PREDICTION_LIMIT);
+}
+
+// residuals of x[0, n) under the predictor
+void audioResiduals(const int32_t* x, size_t n, const AudioPredictor& p, int32_t* r) {
+    size_t warm = min((size_t)p.order, n);
+    for (size_t i = 0; i < warm; i++) r[i] = x[i] - (i ? x[i - 1] : 0);
+    size_t i = warm;
+    if (p.lpc) for (; i < n; i++) r[i] = x[i] - lpcPrediction(x, i, p);
+    else if (p.order == 0) for (; i < n; i++) r[i] = x[i];
+    else if (p.order == 1) for (; i < n; i++) r[i] = x[i] - x[i - 1];
+    else if (p.order == 2) for (; i < n; i++) r[i] = x[i] - 2 * x[i - 1] + x[i - 2];
+    else if (p.order == 3) for (; i < n; i++) r[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+    else for (; i < n; i++) r[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+}
+
+// the inverse, in place: x holds residuals on entry; false if a sample leaves the signal range
+bool audioRestore(int32_t* x, size_t n, const AudioPredictor& p) {
+    for (size_t i = 0; i < n; i++) {
+        int32_t prediction;
+        if (i < (size_t)p.order) prediction = i ? x[i - 1] : 0;
+        else if (p.lpc) prediction = lpcPrediction(x, i, p);
+        else if (p.order == 0) prediction = 0;
+        else if (p.order == 1) prediction = x[i - 1];
+        else if (p.order == 2) prediction = 2 * x[i - 1] - x[i - 2];
+        else if (p.order == 3) prediction = 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+        else prediction = 4 * x[i - 1] - 6 * x[i - 2] + 4 * x[i - 3] - x[i - 4];
+        x[i] += prediction;
+        if (x[i] < -AUDIO_SIGNAL_LIMIT || x[i] > AUDIO_SIGNAL_LIMIT) return false;
+    }
+    return true;
+}
+
+// LPC coefficients of every order up to maxOrder (Levinson-Durbin on the Welch-windowed
+// autocorrelation): lpc[k - 1][j] weighs the sample j + 1 steps back in the order-k predictor,
+// whose prediction error energy is err[k - 1]. Returns the highest order computed (0 for a
+// silent signal).
+int computeLpc(const int32_t* x, size_t n, int maxOrder, double lpc[][AUDIO_MAX_ORDER], double err[]) {
+    vector<double> w(n);
+    double half = (n + 1) / 2.0, mid = (n - 1) / 2.0;
+    for (size_t i = 0; i < n; i++) {
+        double t = (i - mid) / half;
+        w[i] = x[i] * (1.0 - t * t);
+    }
+    double autoc[AUDIO_MAX_ORDER + 1] = { 0 };
+    for (int k = 0; k <= maxOrder; k++) {
+        double sum = 0;
+        for (size_t i = (size_t)k; i < n; i++) sum += w[i] * w[i - k];
+        autoc[k] = sum;
+    }
+    if (!(autoc[0] > 0)) return 0;
+    autoc[0] *= 1.0 + 1e-9; // keeps the recursion stable on pure tones
+
+    double a[AUDIO_MAX_ORDER] = { 0 };
+    double energy = autoc[0];
+    for (int i = 0; i < maxOrder; i++) {
+        double r = -autoc[i + 1];
+        for (int j = 0; j < i; j++) r -= a[j] * autoc[i - j];
+        r /= energy;
+        a[i] = r;
+        for (int j = 0; j < i / 2; j++) {
+            double tmp = a[j];
+            a[j] += r * a[i - 1 - j];
+            a[i - 1 - j] += r * tmp;
+        }
+        if (i & 1) a[i / 2] += a[i / 2] * r;
+        energy *= 1.0 - r * r;
+        err[i] = energy;
+        for (int j = 0; j <= i; j++) lpc[i][j] = -a[j];
+        if (!(energy > 0)) return i + 1;
+    }
+    return maxOrder;
+}
+
+// quantizes with error feedback, so rounding errors do not add up along the coefficients
+bool quantizeLpc(const double* coefs, int order, AudioPredictor& p) {
+    double maxAbs = 0;
+    for (int j = 0; j < order; j++) maxAbs = max(maxAbs, fabs(coefs[j]));
+    if (!(maxAbs > 0) || maxAbs >= 1 << (AUDIO_COEF_BITS - 2)) return false;
+    int exponent;
+    frexp(maxAbs, &exponent); // maxAbs < 2^exponent
+    p.order = order;
+    p.lpc = true;
+    p.shift = min(AUDIO_COEF_BITS - 1 - exponent, AUDIO_COEF_BITS);
+    if (p.shift < 0) return false;
+    double carry = 0;
+    for (int j = 0; j < order; j++) {
+        double v = ldexp(coefs[j], p.shift) + carry;
+        long q = lround(v);
+        q = min(max(q, -32768L), 32767L);
+        p.coefs[j] = (int32_t)q;
+        carry = v - q;
+    }
+    return true;
+}
+
+// class histogram of the residuals (in freqs[0, AUDIO_MAX_CLASS]); returns the raw bits that follow the codes
+uint64_t residualClasses(const int32_t* r, size_t n, uint64_t freqs[256]) {
+    memset(freqs, 0, 256 * sizeof(uint64_t));
+    uint64_t extra = 0;
+    for (size_t i = 0; i < n; i++) {
+        int c = bitLength(zigzag(r[i]));
+        freqs[c]++;
+        extra += c > 1 ? c - 1 : 0;
+    }
+    return extra;
+}
+
+// bytes of a channel header for the predictor and classes; lens receives the class codes
+size_t channelHeaderSize(const AudioPredictor& p, const uint64_t freqs[256], uint8_t lens[256], int& classes) {
+    classes = 0;
+    for (int c = 0; c <= AUDIO_MAX_CLASS; c++) classes += freqs[c] != 0;
+    size_t size = 2 + (p.lpc ? 1 + 2 * (size_t)p.order : 0);
+    if (classes <= 1) {
+        memset(lens, 0, 256);
+        return size + 1;
+    }
+    buildLengthLimitedCodes(freqs, MAX_HEADER_CODE_LEN, lens);
+    CountingWriter table{ 0 };
+    writeLengthTable(table, lens, classes > SPARSE_TABLE_MAX_SYMBOLS);
+    return size + table.n;
+}
+
+// exact coded size of a channel in bytes
+uint64_t channelCost(const int32_t* r, size_t n, const AudioPredictor& p) {
+    uint64_t freqs[256];
+    uint8_t lens[256];
+    int classes;
+    uint64_t bits = residualClasses(r, n, freqs);
+    size_t header = channelHeaderSize(p, freqs, lens, classes);
+    if (classes > 1) bits += encodedBitCount(freqs, lens);
+    return header + (bits + 7) / 8;
+}
+
+// the cheapest predictor for x[0, n); r is scratch for n residuals. Returns its cost in bytes.
+uint64_t planChannel(const int32_t* x, size_t n, int32_t* r, AudioPredictor& best) {
+    uint64_t bestCost = UINT64_MAX;
+    AudioPredictor p = {};
+    for (int order = 0; order < AUDIO_FIXED_ORDERS; order++) {
+        p.order = order;
+        audioResiduals(x, n, p, r);
+        uint64_t cost = channelCost(r, n, p);
+        if (cost < bestCost) {
+            bestCost = cost;
+            best = p;
+        }
+    }
+    if (n <= 4 * (size_t)AUDIO_LPC_MAX_ORDER) return bestCost;
+    // the LPC order comes from the error energies (half a bit per halving, plus the
+    // coefficients), so only one LPC predictor is run over the block
+    double lpc[AUDIO_MAX_ORDER][AUDIO_MAX_ORDER], err[AUDIO_MAX_ORDER];
+    int computed = computeLpc(x, n, AUDIO_LPC_MAX_ORDER, lpc, err);
+    int order = 0;
+    double bestBits = 0;
+    for (int k = 1; k <= computed; k++) {
+        double bits = 0.5 * n * log2(max(err[k - 1], 1e-9)) + 16.0 * k;
+        if (order == 0 || bits < bestBits) {
+            order = k;
+            bestBits = bits;
+        }
+    }
+    if (order == 0 || !quantizeLpc(lpc[order - 1], order, p)) return bestCost;
+    audioResiduals(x, n, p, r);
+    uint64_t cost = channelCost(r, n, p);
+    if (cost < bestCost) {
+        bestCost = cost;
+        best = p;
+    }
+    return bestCost;
+}
+
+void writeAudioChannel(vector<uint8_t>& out, const int32_t* x, size_t n, const AudioPredictor& p, int32_t* r) {
+    audioResiduals(x, n, p, r);
+    uint64_t freqs[256];
+    uint8_t lens[256];
+    int classes;
+    residualClasses(r, n, freqs);
+    channelHeaderSize(p, freqs, lens, classes);
+    bool bitmap = classes > SPARSE_TABLE_MAX_SYMBOLS;
+
+    VectorWriter header{ out };
+    header.put((char)(classes <= 1 ? AUDIO_SINGLE_CLASS : bitmap ? HUFF_FLAG_BITMAP_TABLE : 0));
+    header.put((char)(p.lpc ? AUDIO_LPC | p.order : p.order));
+    if (p.lpc) {
+        header.put((char)p.shift);
+        for (int j = 0; j < p.order; j++) {
+            header.put((char)(p.coefs[j] & 0xFF));
+            header.put((char)((p.coefs[j] >> 8) & 0xFF));
+        }
+    }
+    HuffCode codes[256] = {};
+    if (classes <= 1) {
+        int only = 0;
+        while (only < AUDIO_MAX_CLASS && !freqs[only]) only++;
+        header.put((char)only);
+    }
+    else {
+        writeLengthTable(header, lens, bitmap);
+        assignCanonicalCodes(lens, codes);
+    }
+
+    BitWriter writer(out);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t u = zigzag(r[i]);
+        int c = bitLength(u);
+        if (classes > 1) writer.put(codes[c].bits, codes[c].len);
+        if (c > 1) writer.put(u & ((1u << (c - 1)) - 1), c - 1);
+    }
+    writer.finish();
+}
+
+// one block of whole frames; stored when coding would not make it smaller
+void encodeAudioBlock(const uint8_t* data, size_t frames, int channels, int sampleBytes, vector<uint8_t>& out) {
+    // the channel signals, plus side and mid for two channels, and residual scratch
+    int signals = channels == 2 ? 4 : channels;
+    vector<int32_t> x(frames * (signals + 1));
+    int32_t* r = x.data() + frames * signals;
+    size_t frameBytes = (size_t)channels * sampleBytes;
+    for (size_t f = 0; f < frames; f++)
+        for (int c = 0; c < channels; c++) x[c * frames + f] = loadSample(data + f * frameBytes + c * sampleBytes, sampleBytes);
+    if (channels == 2) {
+        for (size_t f = 0; f < frames; f++) {
+            int32_t left = x[f], right = x[frames + f];
+            x[2 * frames + f] = left - right;
+            x[3 * frames + f] = (left + right) >> 1;
+        }
+    }
+
+    AudioPredictor plans[AUDIO_MAX_CHANNELS];
+    uint64_t costs[AUDIO_MAX_CHANNELS];
+    for (int s = 0; s < signals; s++) costs[s] = planChannel(x.data() + s * frames, frames, r, plans[s]);
+    // signal pairs per stereo mode: left/right, left/side, side/right, mid/side
+    int mode = AUDIO_LEFT_RIGHT;
+    const int pairs[4][2] = { { 0, 1 }, { 0, 2 }, { 2, 1 }, { 3, 2 } };
+    if (channels == 2) {
+        for (int m = 1; m < 4; m++)
+            if (costs[pairs[m][0]] + costs[pairs[m][1]] < costs[pairs[mode][0]] + costs[pairs[mode][1]]) mode = m;
+    }
+
+    out.clear();
+    out.push_back((uint8_t)mode);
+    for (int c = 0; c < channels; c++) {
+        int s = channels == 2 ? pairs[mode][c] : c;
+        writeAudioChannel(out, x.data() + s * frames, frames, plans[s], r);
+    }
+    if (out.size() > frames * frameBytes) {
+        out.assign(1, AUDIO_BLOCK_STORED);
+        out.insert(out.end(), data, data + frames * frameBytes);
+    }
+}
+
+// decodes one channel into x[0, n) and advances in past it
+bool readAudioChannel(MemoryReader& in, int32_t* x, size_t n, DecodeTable& table) {
+    char flags, predictor;
+    if (!in.get(flags) || !in.get(predictor)) return false;
+    AudioPredictor p = {};
+    p.lpc = ((uint8_t)predictor & AUDIO_LPC) != 0;
+    p.order = (uint8_t)predictor & ~AUDIO_LPC;
+    if (p.lpc ? p.order < 1 || p.order > AUDIO_MAX_ORDER : p.order >= AUDIO_FIXED_ORDERS) return false;
+    if (p.lpc) {
+        char shift;
+        uint8_t coefs[2 * AUDIO_MAX_ORDER];
+        if (!in.get(shift) || (uint8_t)shift > AUDIO_COEF_BITS) return false;
+        if (!in.read(reinterpret_cast<char*>(coefs), 2 * (size_t)p.order)) return false;
+        p.shift = (uint8_t)shift;
+        for (int j = 0; j < p.order; j++) p.coefs[j] = (int16_t)(coefs[2 * j] | (coefs[2 * j + 1] << 8));
+    }
+    bool single = ((uint8_t)flags & AUDIO_SINGLE_CLASS) != 0;
+    char only = 0;
+    if (single) {
+        if (!in.get(only) || (uint8_t)only > AUDIO_MAX_CLASS) return false;
+    }
+    else {
+        uint8_t lens[256] = { 0 };
+        if (!readLengthTable(in, lens, ((uint8_t)flags & HUFF_FLAG_BITMAP_TABLE) != 0)) return false;
+        for (int c = AUDIO_MAX_CLASS + 1; c < 256; c++) if (lens[c]) return false;
+        if (!buildDecodeTableFromLengths(lens, table)) return false;
+    }
+
+    // a class code is at most 15 bits and its raw bits at most 30: one refill per sample
+    size_t payload = (size_t)(in.end - in.cur);
+    BitReader reader(in.cur, payload);
+    int64_t bitsLeft = 8 * (int64_t)payload;
+    bool invalid = false;
+    const DecodeEntry* entries = table.entries();
+    for (size_t i = 0; i < n; i++) {
+        if (reader.bitCount < 48) reader.refill();
+        int c = single ? only : decodeStep(reader, entries, bitsLeft, invalid);
+        uint32_t u = c > 0;
+        if (c > 1) {
+            u = (1u << (c - 1)) | (uint32_t)(reader.bitBuf >> (65 - c));
+            reader.consume(c - 1);
+            bitsLeft -= c - 1;
+        }
+        x[i] = unzigzag(u);
+    }
+    if (invalid || bitsLeft < 0) return false;
+    in.cur += (size_t)((8 * (int64_t)payload - bitsLeft + 7) / 8);
+    return audioRestore(x, n, p);
+}
+
+bool decodeAudioBlock(const uint8_t* data, size_t size, int channels, int sampleBytes, uint8_t* out, size_t frames) {
+    size_t frameBytes = (size_t)channels * sampleBytes;
+    if (size < 1) return false;
+    if (data[0] == AUDIO_BLOCK_STORED) {
+        if (size - 1 != frames * frameBytes) return false;
+        memcpy(out, data + 1, frames * frameBytes);
+        return true;
+    }
+    int mode = data[0];
+    if (mode > AUDIO_MID_SIDE || (mode != AUDIO_LEFT_RIGHT && channels != 2)) return false;
+    MemoryReader in{ data + 1, data + size };
+    vector<int32_t> x(frames * channels);
+    unique_ptr<DecodeTable> table(new DecodeTable);
+    for (int c = 0; c < channels; c++)
+        if (!readAudioChannel(in, x.data() + c * frames, frames, *table)) return false;
+    if (in.cur != in.end) return false;
+
+    int32_t* a = x.data();
+    int32_t* b = x.data() + (channels == 2 ? frames : 0);
+    for (size_t f = 0; f < frames && channels == 2; f++) {
+        int32_t left = a[f], right = b[f];
+        if (mode == AUDIO_LEFT_SIDE) right = a[f] - b[f];
+        else if (mode == AUDIO_SIDE_RIGHT) left = a[f] + b[f];
+        else if (mode == AUDIO_MID_SIDE) {
+            int32_t sum = 2 * a[f] + (b[f] & 1);
+            left = (sum + b[f]) >> 1;
+            right = (sum - b[f]) >> 1;
+        }
+        a[f] = left;
+        b[f] = right;
+    }
+    int32_t low = sampleBytes == 1 ? -128 : -(1 << (8 * sampleBytes - 1)), high = -low - 1;
+    for (int c = 0; c < channels; c++) {
+        const int32_t* s = x.data() + c * frames;
+        for (size_t f = 0; f < frames; f++) {
+            if (s[f] < low || s[f] > high) return false;
+            storeSample(out + f * frameBytes + c * sampleBytes, s[f], sampleBytes);
+        }
+    }
+    return true;
+}
+
+bool parseWav(ByteSpan file, WavLayout& wav) {
+    if (file.size < 12 || memcmp(file.data, "RIFF", 4) != 0 || memcmp(file.data + 8, "WAVE", 4) != 0) return false;
+    bool haveFormat = false;
+    uint64_t pos = 12;
+    while (pos + 8 <= file.size) {
+        const uint8_t* chunk = file.data + pos;
+        uint64_t size = loadLE32(chunk + 4), body = pos + 8;
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (size < 16 || body + 16 > file.size) return false;
+            const uint8_t* f = file.data + body;
+            int tag = f[0] | (f[1] << 8);
+            if (tag == 0xFFFE) { // WAVE_FORMAT_EXTENSIBLE: the sub-format GUID starts with the real tag
+                if (size < 40 || body + 40 > file.size) return false;
+                tag = f[24] | (f[25] << 8);
+            }
+            int channels = f[2] | (f[3] << 8), blockAlign = f[12] | (f[13] << 8), bits = f[14] | (f[15] << 8);
+            if (tag != 1 || channels < 1 || channels > AUDIO_MAX_CHANNELS || blockAlign % channels != 0) return false;
+            wav.channels = channels;
+            wav.sampleBytes = blockAlign / channels;
+            if (wav.sampleBytes < 1 || wav.sampleBytes > 3 || bits < 1 || bits > 8 * wav.sampleBytes) return false;
+            haveFormat = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) return false;
+            wav.dataOffset = body;
+            wav.frames = min<uint64_t>(size, file.size - body) / ((uint64_t)wav.channels * wav.sampleBytes);
+            return true;
+        }
+        pos = body + size + (size & 1);
+    }
+    return false;
+}
+
+bool isPcmWavFile(const string& path) {
+    MappedInput mapped;
+    WavLayout wav;
+    return mapped.open(path) && parseWav(mapped.span(), wav);
+}
+
+// signature, sample format, block size and the embedded header and tail streams
+template <class Sink>
+bool writeAudioPrologue(Sink& out, ByteSpan file, const WavLayout& wav) {
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)HUFF_FORMAT_AUDIO);
+    out.put((char)wav.channels);
+    out.put((char)wav.sampleBytes);
+    writeVarint(out, AUDIO_BLOCK_FRAMES);
+    uint64_t dataEnd = wav.dataOffset + wav.frames * wav.channels * wav.sampleBytes;
+    return writeEmbeddedStream(out, ByteSpan{ file.data, (size_t)wav.dataOffset }) &&
+        writeEmbeddedStream(out, ByteSpan{ file.data + dataEnd, (size_t)(file.size - dataEnd) });
+}
+
+bool compressAudio(ByteSpan in, vector<uint8_t>& out, ThreadPool& pool) {
+    WavLayout wav;
+    if (!parseWav(in, wav)) return false;
+    out.clear();
+    VectorWriter writer{ out };
+    if (!writeAudioPrologue(writer, in, wav)) return false;
+
+    size_t frameBytes = (size_t)wav.channels * wav.sampleBytes;
+    size_t blockCount = (size_t)((wav.frames + AUDIO_BLOCK_FRAMES - 1) / AUDIO_BLOCK_FRAMES);
+    vector<vector<uint8_t>> coded(blockCount);
+    vector<future<void>> done;
+    for (size_t b = 0; b < blockCount; b++) {
+        done.push_back(pool.submit([&, b] {
+            size_t frames = (size_t)min<uint64_t>(AUDIO_BLOCK_FRAMES, wav.frames - b * AUDIO_BLOCK_FRAMES);
+            encodeAudioBlock(in.data + wav.dataOffset + b * AUDIO_BLOCK_FRAMES * frameBytes, frames, wav.channels,
+                wav.sampleBytes, coded[b]);
+        }));
+    }
+    for (size_t b = 0; b < done.size(); b++) done[b].get();
+
+    vector<BlockInfo> index(blockCount);
+    for (size_t b = 0; b < blockCount; b++) {
+        index[b].rawSize = min<uint64_t>(AUDIO_BLOCK_FRAMES, wav.frames - b * AUDIO_BLOCK_FRAMES) * frameBytes;
+        index[b].codedSize = coded[b].size();
+        out.insert(out.end(), coded[b].begin(), coded[b].end());
+    }
+    writeBlockIndex(writer, index, out.size());
+    return true;
+}
+
+bool compressFileAudio(const string& inPath, const string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    int threads, JobProgress* job) {
+    // the data chunk can sit anywhere in the file: the whole input is needed to find it
+    MappedInput mapped;
+    vector<uint8_t> loaded;
+    ByteSpan file;
+    if (mapped.open(inPath)) file = mapped.span();
+    else {
+        ifstream in(inPath, ios::binary | ios::ate);
+        if (!in) return false;
+        loaded.resize((size_t)in.tellg());
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(loaded.data()), loaded.size())) return false;
+        file = ByteSpan{ loaded.data(), loaded.size() };
+    }
+    WavLayout wav;
+    if (!parseWav(file, wav)) return false;
+    ofstream out(outPath, ios::binary);
+    if (!out) { cerr << "Cannot open output file\n"; return false; }
+    if (!writeAudioPrologue(out, file, wav)) return false;
+
+    ThreadPool pool(threads);
+    size_t frameBytes = (size_t)wav.channels * wav.sampleBytes;
+    uint64_t blockCount = (wav.frames + AUDIO_BLOCK_FRAMES - 1) / AUDIO_BLOCK_FRAMES;
+    size_t batch = 8 * (size_t)pool.size(); // audio blocks are small: more of them per round
+    vector<vector<uint8_t>> coded(batch);
+    vector<BlockInfo> index;
+    memset(freqs, 0, 256 * sizeof(uint64_t));
+    countFrequencies(file.data, file.size, freqs);
+    origBytes = file.size;
+    jobBegin(job, JOB_ENCODING, wav.frames * frameBytes);
+
+    for (uint64_t first = 0; first < blockCount; first += batch) {
+        size_t filled = (size_t)min<uint64_t>(batch, blockCount - first);
+        vector<future<void>> done;
+        for (size_t b = 0; b < filled; b++) {
+            done.push_back(pool.submit([&, b] {
+                uint64_t start = (first + b) * AUDIO_BLOCK_FRAMES;
+                size_t frames = (size_t)min<uint64_t>(AUDIO_BLOCK_FRAMES, wav.frames - start);
+                encodeAudioBlock(file.data + wav.dataOffset + start * frameBytes, frames, wav.channels, wav.sampleBytes,
+                    coded[b]);
+            }));
+        }
+        for (size_t b = 0; b < done.size(); b++) done[b].get();
+        uint64_t batchBytes = 0;
+        for (size_t b = 0; b < filled; b++) {
+            uint64_t rawSize = min<uint64_t>(AUDIO_BLOCK_FRAMES, wav.frames - (first + b) * AUDIO_BLOCK_FRAMES) * frameBytes;
+            out.write(reinterpret_cast<const char*>(coded[b].data()), coded[b].size());
+            index.push_back(BlockInfo{ rawSize, coded[b].size() });
+            batchBytes += rawSize;
+        }
+        if (!jobAdvance(job, batchBytes)) return false;
+    }
+    writeBlockIndex(out, index, (uint64_t)out.tellp());
+    out.close();
+    return (bool)out;
+}
+
+// a v6 file in memory: its sample format, the embedded header and tail streams and the block
+// table (raw offsets count from the first sample byte)
+struct AudioFile {
+    int channels;
+    int sampleBytes;
+    uint64_t blockFrames;
+    ByteSpan head, tail;
+    uint64_t headSize, tailSize;
+    vector<SeekEntry> blocks;
+
+    uint64_t sampleBytesTotal() const { return blocks.empty() ? 0 : blocks.back().rawOffset + blocks.back().rawSize; }
+    uint64_t rawSize() const { return headSize + sampleBytesTotal() + tailSize; }
+};
+
+bool parseAudioFile(ByteSpan file, AudioFile& a) {
+    MemoryReader in{ file.data, file.data + file.size };
+    char sig[2], channels, sampleBytes;
+    if (!in.read(sig, sizeof(sig)) || sig[0] != (char)HUFF_SIGNATURE || sig[1] != (char)HUFF_FORMAT_AUDIO) return false;
+    if (!in.get(channels) || !in.get(sampleBytes) || !readVarint(in, a.blockFrames)) return false;
+    a.channels = (uint8_t)channels;
+    a.sampleBytes = (uint8_t)sampleBytes;
+    if (a.channels < 1 || a.channels > AUDIO_MAX_CHANNELS || a.sampleBytes < 1 || a.sampleBytes > 3) return false;
+    uint64_t frameBytes = (uint64_t)a.channels * a.sampleBytes;
+    if (a.blockFrames < 1 || a.blockFrames * frameBytes > MAX_BLOCK_SIZE) return false;
+    if (!readEmbeddedStream(in, a.head, a.headSize) || !readEmbeddedStream(in, a.tail, a.tailSize)) return false;
+
+    uint64_t dataStart = (uint64_t)(in.cur - file.data);
+    if (file.size < dataStart + 8) return false;
+    uint64_t indexOffset = loadTrailerOffset(file.data + file.size - 8);
+    if (indexOffset < dataStart || indexOffset > file.size - 8) return false;
+    a.blocks.clear();
+    uint64_t count;
+    return walkBlockIndex(file.data + indexOffset, (size_t)(file.size - 8 - indexOffset), dataStart, indexOffset, count,
+        [&](const SeekEntry& e) {
+            if (e.rawSize == 0 || e.rawSize % frameBytes != 0 || e.rawSize > a.blockFrames * frameBytes) return false;
+            a.blocks.push_back(e);
+            return true;
+        });
+}
+
+// decodes a parsed v6 file into out[0, rawSize), blocks on the pool when there is one
+bool decodeAudioFile(ByteSpan file, const AudioFile& a, uint8_t* out, ThreadPool* pool, JobProgress* job = nullptr) {
+    size_t written;
+    if (!decompressInto(a.head, out, (size_t)a.headSize, written)) return false;
+    uint8_t* samples = out + a.headSize;
+    if (!decompressInto(a.tail, samples + a.sampleBytesTotal(), (size_t)a.tailSize, written)) return false;
+    size_t frameBytes = (size_t)a.channels * a.sampleBytes;
+    atomic<bool> failed(false);
+    auto decodeOne = [&](const SeekEntry& e) {
+        if (failed || jobCancelled(job)) return;
+        if (!decodeAudioBlock(file.data + e.fileOffset, (size_t)e.codedSize, a.channels, a.sampleBytes,
+            samples + e.rawOffset, (size_t)(e.rawSize / frameBytes)))
+            failed = true;
+        jobAdvance(job, e.rawSize);
+    };
+    jobBegin(job, JOB_DECODING, a.sampleBytesTotal());
+    if (!pool) {
+        for (const SeekEntry& e : a.blocks) decodeOne(e);
+        return !failed;
+    }
+    // audio blocks are small: each job takes a run of them
+    const size_t run = 16;
+    vector<future<void>> done;
+    for (size_t first = 0; first < a.blocks.size(); first += run) {
+        done.push_back(pool->submit([&, first] {
+            for (size_t b = first; b < min(first + run, a.blocks.size()); b++) decodeOne(a.blocks[b]);
+        }));
+    }
+    for (size_t i = 0; i < done.size(); i++) done[i].get();
+    return !failed && !jobCancelled(job);
+}
+
+bool summarizeAudio(ByteSpan file, AudioSummary& summary) {
+    AudioFile a;
+    if (!parseAudioFile(file, a)) return false;
+    memset(&summary, 0, sizeof(summary));
+    summary.channels = a.channels;
+    summary.sampleBytes = a.sampleBytes;
+    summary.blockFrames = a.blockFrames;
+    summary.blocks = a.blocks.size();
+    summary.rawSize = a.rawSize();
+    for (const SeekEntry& e : a.blocks) {
+        uint8_t mode = file.data[e.fileOffset];
+        if (mode == AUDIO_BLOCK_STORED) summary.storedBlocks++;
+        else if (mode <= AUDIO_MID_SIDE) summary.blocksByMode[mode]++;
+    }
+    return true;
+}
+
+/*
+ Raw video (format v7, layout in huffman_core.h)
+ Every plane tries the four predictions (keyframes only the two that stay within the frame)
+ and keeps the one whose residuals code smallest under an order-0 table; encodeBlock may
+ then still pick its order-1 model or store them. The encoder predicts from the input, so
+ all frames encode in parallel; a decoded frame is needed before the next one can be
+ restored, so the decoder runs one job per keyframe interval.
+*/
+const size_t Y4M_MAX_LINE = 4096; // longer stream header or FRAME lines: not taken for Y4M
+const uint64_t VIDEO_MAX_DIMENSION = 1 << 16;
+
+inline int medianPrediction(int a, int b, int c) {
+    int low = min(a, b), high = max(a, b);
+    if (c >= high) return low;
+    if (c <= low) return high;
+    return a + b - c;
+}
+
+// sample = residual + prediction (mod 256), row by row; Decode restores cur from res,
+// otherwise res receives the residuals of cur (which is then only read)
+template <int Mode, bool Decode>
+void runVideoPrediction(uint8_t* cur, const uint8_t* prev, uint8_t* res, size_t w, size_t h) {
+    // the signal the median works on: the sample itself, or its change since the previous frame
+    auto signal = [](const uint8_t* row, const uint8_t* prevRow, size_t x) {
+        return Mode == VIDEO_SPATIAL ? (int)row[x] : (int)row[x] - prevRow[x];
+    };
+    for (size_t y = 0; y < h; y++) {
+        uint8_t* row = cur + y * w;
+        uint8_t* r = res + y * w;
+        const uint8_t* up = y ? row - w : row;
+        const uint8_t* prevRow = prev ? prev + y * w : nullptr;
+        const uint8_t* prevUp = prev && y ? prevRow - w : prevRow;
+        for (size_t x = 0; x < w; x++) {
+            int p = 0;
+            if (Mode == VIDEO_TEMPORAL) p = prevRow[x];
+            else if (Mode != VIDEO_RAW) {
+                if (y == 0) p = x ? signal(row, prevRow, x - 1) : 0;
+                else if (x == 0) p = signal(up, prevUp, 0);
+                else p = medianPrediction(signal(row, prevRow, x - 1), signal(up, prevUp, x), signal(up, prevUp, x - 1));
+                if (Mode == VIDEO_TEMPORAL_SPATIAL) p += prevRow[x];
+            }
+            if (Decode) row[x] = (uint8_t)(r[x] + p);
+            else r[x] = (uint8_t)(row[x] - p);
+        }
+    }
+}
+
+template <bool Decode>
+void runVideoPrediction(int mode, uint8_t* cur, const uint8_t* prev, uint8_t* res, size_t w, size_t h) {
+    switch (mode) {
+    case VIDEO_RAW: runVideoPrediction<VIDEO_RAW, Decode>(cur, prev, res, w, h); break;
+    case VIDEO_SPATIAL: runVideoPrediction<VIDEO_SPATIAL, Decode>(cur, prev, res, w, h); break;
+    case VIDEO_TEMPORAL: runVideoPrediction<VIDEO_TEMPORAL, Decode>(cur, prev, res, w, h); break;
+    default: runVideoPrediction<VIDEO_TEMPORAL_SPATIAL, Decode>(cur, prev, res, w, h); break;
+    }
+}
+
+// one frame (prev is null for keyframes); out receives the planes as laid out in the header
+void encodeVideoFrame(const uint8_t* frame, const uint8_t* prev, const Y4mLayout& y4m, vector<uint8_t>& out) {
+    out.clear();
+    VectorWriter writer{ out };
+    vector<uint8_t> res, best, coded;
+    uint64_t freqs[256];
+    uint8_t lens[256];
+    for (int p = 0; p < y4m.planes; p++) {
+        size_t w = y4m.width[p], h = y4m.height[p], n = w * h;
+        res.resize(n);
+        best.resize(n);
+        int bestMode = VIDEO_RAW;
+        uint64_t bestBits = UINT64_MAX;
+        for (int mode = VIDEO_RAW; mode <= (prev ? VIDEO_TEMPORAL_SPATIAL : VIDEO_SPATIAL); mode++) {
+            runVideoPrediction<false>(mode, const_cast<uint8_t*>(frame), prev, res.data(), w, h);
+            memset(freqs, 0, sizeof(freqs));
+            countFrequencies(res.data(), n, freqs, 1); // frames already run one per worker
+            buildLengthLimitedCodes(freqs, MAX_HEADER_CODE_LEN, lens);
+            uint64_t bits = encodedBitCount(freqs, lens);
+            if (bits < bestBits) {
+                bestBits = bits;
+                bestMode = mode;
+                best.swap(res);
+            }
+        }
+        encodeBlock(best.data(), n, coded, MAX_HEADER_CODE_LEN, freqs);
+        writer.put((char)bestMode);
+        writeVarint(writer, coded.size());
+        out.insert(out.end(), coded.begin(), coded.end());
+        frame += n;
+        if (prev) prev += n;
+    }
+}
+
+bool parseY4m(ByteSpan file, Y4mLayout& y4m) {
+    const size_t magic = 10; // "YUV4MPEG2 "
+    if (file.size < magic || memcmp(file.data, "YUV4MPEG2 ", magic) != 0) return false;
+    const uint8_t* lineEnd = find(file.data, file.data + min(file.size, Y4M_MAX_LINE), '\n');
+    if (lineEnd == file.data + min(file.size, Y4M_MAX_LINE)) return false;
+
+    uint64_t width = 0, height = 0;
+    string colorspace = "420jpeg";
+    istringstream params(string(file.data + magic, lineEnd));
+    string token;
+    while (params >> token) {
+        if (token[0] == 'W') width = strtoull(token.c_str() + 1, nullptr, 10);
+        else if (token[0] == 'H') height = strtoull(token.c_str() + 1, nullptr, 10);
+        else if (token[0] == 'C') colorspace = token.substr(1);
+    }
+    if (width < 1 || width > VIDEO_MAX_DIMENSION || height < 1 || height > VIDEO_MAX_DIMENSION) return false;
+    // chroma size in luma samples per chroma sample, horizontally and vertically; only 8-bit layouts
+    uint64_t sx = 1, sy = 1;
+    y4m.planes = 3;
+    if (colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2" || colorspace == "420") sx = sy = 2;
+    else if (colorspace == "422") sx = 2;
+    else if (colorspace == "411") sx = 4;
+    else if (colorspace == "mono") y4m.planes = 1;
+    else if (colorspace == "444alpha") y4m.planes = 4;
+    else if (colorspace != "444") return false;
+    y4m.frameBytes = 0;
+    for (int p = 0; p < y4m.planes; p++) {
+        bool chroma = p == 1 || p == 2;
+        y4m.width[p] = (uint32_t)(chroma ? (width + sx - 1) / sx : width);
+        y4m.height[p] = (uint32_t)(chroma ? (height + sy - 1) / sy : height);
+        y4m.frameBytes += (uint64_t)y4m.width[p] * y4m.height[p];
+    }
+    if (y4m.frameBytes > MAX_BLOCK_SIZE) return false;
+
+    // whole frames only: whatever follows the last one is kept as it is
+    y4m.frameOffsets.clear();
+    uint64_t pos = (uint64_t)(lineEnd - file.data) + 1;
+    while (file.size - pos >= 5 && memcmp(file.data + pos, "FRAME", 5) == 0) {
+        const uint8_t* start = file.data + pos;
+        const uint8_t* limit = start + min<uint64_t>(file.size - pos, Y4M_MAX_LINE);
+        const uint8_t* frameLineEnd = find(start, limit, '\n');
+        if (frameLineEnd == limit) break;
+        uint64_t samples = (uint64_t)(frameLineEnd - file.data) + 1;
+        if (file.size - samples < y4m.frameBytes) break;
+        y4m.frameOffsets.push_back(samples);
+        pos = samples + y4m.frameBytes;
+    }
+    return !y4m.frameOffsets.empty(); // without a whole frame there is nothing to predict
+}
+
+bool isY4mFile(const string& path) {
+    MappedInput mapped;
+    Y4mLayout y4m;
+    return mapped.open(path) && parseY4m(mapped.span(), y4m);
+}
+
+// signature, plane sizes, keyframe interval and the embedded stream of the non-sample bytes
+template <class Sink>
+bool writeVideoPrologue(Sink& out, ByteSpan file, const Y4mLayout& y4m) {
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)HUFF_FORMAT_VIDEO);
+    out.put((char)y4m.planes);
+    for (int p = 0; p < y4m.planes; p++) {
+        writeVarint(out, y4m.width[p]);
+        writeVarint(out, y4m.height[p]);
+    }
+    writeVarint(out, VIDEO_KEYFRAME_INTERVAL);
+    vector<uint8_t> text;
+    uint64_t pos = 0;
+    for (uint64_t offset : y4m.frameOffsets) {
+        text.insert(text.end(), file.data + pos, file.data + offset);
+        pos = offset + y4m.frameBytes;
+    }
+    text.insert(text.end(), file.data + pos, file.data + file.size);
+    return writeEmbeddedStream(out, ByteSpan{ text.data(), text.size() });
+}
+
+// the previous frame a frame predicts from, null for keyframes
+const uint8_t* previousVideoFrame(ByteSpan file, const Y4mLayout& y4m, size_t f) {
+    return f % VIDEO_KEYFRAME_INTERVAL ? file.data + y4m.frameOffsets[f - 1] : nullptr;
+}
+
+bool compressVideo(ByteSpan in, vector<uint8_t>& out, ThreadPool& pool) {
+    Y4mLayout y4m;
+    if (!parseY4m(in, y4m)) return false;
+    out.clear();
+    VectorWriter writer{ out };
+    if (!writeVideoPrologue(writer, in, y4m)) return false;
+
+    size_t frames = y4m.frameOffsets.size();
+    vector<vector<uint8_t>> coded(frames);
+    vector<future<void>> done;
+    for (size_t f = 0; f < frames; f++) {
+        done.push_back(pool.submit([&, f] {
+            encodeVideoFrame(in.data + y4m.frameOffsets[f], previousVideoFrame(in, y4m, f), y4m, coded[f]);
+        }));
+    }
+    for (size_t f = 0; f < done.size(); f++) done[f].get();
+
+    vector<BlockInfo> index(frames);
+    for (size_t f = 0; f < frames; f++) {
+        index[f].rawSize = y4m.frameBytes;
+        index[f].codedSize = coded[f].size();
+        out.insert(out.end(), coded[f].begin(), coded[f].end());
+    }
+    writeBlockIndex(writer, index, out.size());
+    return true;
+}
+
+bool compressFileVideo(const string& inPath, const string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    int threads, JobProgress* job) {
+    // frames predict from the ones before them: the whole input stays mapped
+    MappedInput mapped;
+    vector<uint8_t> loaded;
+    ByteSpan file;
+    if (mapped.open(inPath)) file = mapped.span();
+    else {
+        ifstream in(inPath, ios::binary | ios::ate);
+        if (!in) return false;
+        loaded.resize((size_t)in.tellg());
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(loaded.data()), loaded.size())) return false;
+        file = ByteSpan{ loaded.data(), loaded.size() };
+    }
+    Y4mLayout y4m;
+    if (!parseY4m(file, y4m)) return false;
+    ofstream out(outPath, ios::binary);
+    if (!out) { cerr << "Cannot open output file\n"; return false; }
+    if (!writeVideoPrologue(out, file, y4m)) return false;
+
+    ThreadPool pool(threads);
+    size_t frames = y4m.frameOffsets.size();
+    size_t batch = (size_t)pool.size();
+    vector<vector<uint8_t>> coded(batch);
+    vector<BlockInfo> index;
+    memset(freqs, 0, 256 * sizeof(uint64_t));
+    countFrequencies(file.data, file.size, freqs);
+    origBytes = file.size;
+    jobBegin(job, JOB_ENCODING, frames * y4m.frameBytes);
+
+    for (size_t first = 0; first < frames; first += batch) {
+        size_t filled = min(batch, frames - first);
+        vector<future<void>> done;
+        for (size_t b = 0; b < filled; b++) {
+            done.push_back(pool.submit([&, b] {
+                size_t f = first + b;
+                encodeVideoFrame(file.data + y4m.frameOffsets[f], previousVideoFrame(file, y4m, f), y4m, coded[b]);
+            }));
+        }
+        for (size_t b = 0; b < done.size(); b++) done[b].get();
+        for (size_t b = 0; b < filled; b++) {
+            out.write(reinterpret_cast<const char*>(coded[b].data()), coded[b].size());
+            index.push_back(BlockInfo{ y4m.frameBytes, coded[b].size() });
+        }
+        if (!jobAdvance(job, filled * y4m.frameBytes)) return false;
+    }
+    writeBlockIndex(out, index, (uint64_t)out.tellp());
+    out.close();
+    return (bool)out;
+}
+
+// a v7 file in memory: plane sizes, the embedded non-sample bytes and the frame table
+struct VideoFile {
+    int planes;
+    uint32_t width[VIDEO_MAX_PLANES];
+    uint32_t height[VIDEO_MAX_PLANES];
+    uint64_t frameBytes;
+    uint64_t keyframeInterval;
+    ByteSpan text;
+    uint64_t textSize;
+    vector<SeekEntry> frames;
+
+    uint64_t rawSize() const { return textSize + frames.size() * frameBytes; }
+};
+
+bool parseVideoFile(ByteSpan file, VideoFile& v) {
+    MemoryReader in{ file.data, file.data + file.size };
+    char sig[2], planes;
+    if (!in.read(sig, sizeof(sig)) || sig[0] != (char)HUFF_SIGNATURE || sig[1] != (char)HUFF_FORMAT_VIDEO) return false;
+    if (!in.get(planes) || planes < 1 || planes > VIDEO_MAX_PLANES) return false;
+    v.planes = planes;
+    v.frameBytes = 0;
+    for (int p = 0; p < v.planes; p++) {
+        uint64_t w, h;
+        if (!readVarint(in, w) || !readVarint(in, h)) return false;
+        if (w < 1 || w > VIDEO_MAX_DIMENSION || h < 1 || h > VIDEO_MAX_DIMENSION) return false;
+        v.width[p] = (uint32_t)w;
+        v.height[p] = (uint32_t)h;
+        v.frameBytes += w * h;
+    }
+    if (v.frameBytes > MAX_BLOCK_SIZE || !readVarint(in, v.keyframeInterval) || v.keyframeInterval < 1) return false;
+    if (!readEmbeddedStream(in, v.text, v.textSize)) return false;
+
+    uint64_t dataStart = (uint64_t)(in.cur - file.data);
+    if (file.size < dataStart + 8) return false;
+    uint64_t indexOffset = loadTrailerOffset(file.data + file.size - 8);
+    if (indexOffset < dataStart || indexOffset > file.size - 8) return false;
+    v.frames.clear();
+    uint64_t count;
+    return walkBlockIndex(file.data + indexOffset, (size_t)(file.size - 8 - indexOffset), dataStart, indexOffset, count,
+        [&](const SeekEntry& e) {
+            if (e.rawSize != v.frameBytes) return false;
+            v.frames.push_back(e);
+            return true;
+        });
+}
+
+// one frame into out[0, frameBytes); prev is the decoded frame before it, null for keyframes
+bool decodeVideoFrame(const uint8_t* data, size_t size, const VideoFile& v, const uint8_t* prev, uint8_t* out) {
+    MemoryReader in{ data, data + size };
+    thread_local vector<uint8_t> res;
+    for (int p = 0; p < v.planes; p++) {
+        size_t w = v.width[p], h = v.height[p], n = w * h;
+        char mode;
+        uint64_t codedSize;
+        if (!in.get(mode) || mode < VIDEO_RAW || mode > VIDEO_TEMPORAL_SPATIAL || (!prev && mode >= VIDEO_TEMPORAL)) return false;
+        if (!readVarint(in, codedSize) || codedSize > (uint64_t)(in.end - in.cur)) return false;
+        res.resize(n);
+        if (!decodeBlock(in.cur, (size_t)codedSize, res.data(), n)) return false;
+        in.cur += codedSize;
+        runVideoPrediction<true>(mode, out, prev, res.data(), w, h);
+        out += n;
+        if (prev) prev += n;
+    }
+    return in.cur == in.end;
+}
+
+// decodes a parsed v7 file into out[0, rawSize), one job per keyframe interval when there is a pool
+bool decodeVideoFile(ByteSpan file, const VideoFile& v, uint8_t* out, ThreadPool* pool, JobProgress* job = nullptr) {
+    vector<uint8_t> text((size_t)v.textSize);
+    size_t written;
+    if (!decompressInto(v.text, text.data(), text.size(), written)) return false;
+    // the stream header line, then a FRAME line before every frame; the rest follows the last one
+    vector<uint64_t> frameOut(v.frames.size());
+    size_t pos = 0;
+    uint64_t outPos = 0;
+    for (size_t line = 0; line <= v.frames.size(); line++) {
+        const uint8_t* lineEnd = find(text.data() + pos, text.data() + text.size(), '\n');
+        if (lineEnd == text.data() + text.size()) return false;
+        size_t length = (size_t)(lineEnd - text.data()) + 1 - pos;
+        memcpy(out + outPos, text.data() + pos, length);
+        pos += length;
+        outPos += length;
+        if (line > 0) {
+            frameOut[line - 1] = outPos;
+            outPos += v.frameBytes;
+        }
+    }
+    memcpy(out + outPos, text.data() + pos, text.size() - pos);
+
+    atomic<bool> failed(false);
+    auto decodeRun = [&](size_t first) {
+        size_t last = (size_t)min<uint64_t>(first + v.keyframeInterval, v.frames.size());
+        for (size_t f = first; f < last; f++) {
+            if (failed || jobCancelled(job)) return;
+            const SeekEntry& e = v.frames[f];
+            const uint8_t* prev = f > first ? out + frameOut[f - 1] : nullptr;
+            if (!decodeVideoFrame(file.data + e.fileOffset, (size_t)e.codedSize, v, prev, out + frameOut[f])) {
+                failed = true;
+                return;
+            }
+            jobAdvance(job, e.rawSize);
+        }
+    };
+    jobBegin(job, JOB_DECODING, v.frames.size() * v.frameBytes);
+    vector<future<void>> done;
+    for (size_t first = 0; first < v.frames.size(); first += (size_t)v.keyframeInterval) {
+        if (pool) done.push_back(pool->submit([&, first] { decodeRun(first); }));
+        else decodeRun(first);
+    }
+    for (size_t i = 0; i < done.size(); i++) done[i].get();
+    return !failed && !jobCancelled(job);
+}
+
+bool summarizeVideo(ByteSpan file, VideoSummary& summary) {
+    VideoFile v;
+    if (!parseVideoFile(file, v)) return false;
+    memset(&summary, 0, sizeof(summary));
+    summary.planes = v.planes;
+    memcpy(summary.width, v.width, sizeof(summary.width));
+    memcpy(summary.height, v.height, sizeof(summary.height));
+    summary.frames = v.frames.size();
+    summary.keyframeInterval = v.keyframeInterval;
+    summary.rawSize = v.rawSize();
+    for (const SeekEntry& e : v.frames) {
+        MemoryReader in{ file.data + e.fileOffset, file.data + e.fileOffset + e.codedSize };
+        for (int p = 0; p < v.planes; p++) {
+            char mode;
+            uint64_t codedSize;
+            if (!in.get(mode) || !readVarint(in, codedSize) || codedSize > (uint64_t)(in.end - in.cur)) return false;
+            if (mode >= VIDEO_RAW && mode <= VIDEO_TEMPORAL_SPATIAL) summary.planesByPrediction[(int)mode]++;
+            in.cur += codedSize;
+        }
+    }
+    return true;
+}
+
+/*
+ Raster images (format v8, layout in huffman_core.h)
+ Rows are cut into blocks of about DEFAULT_BLOCK_SIZE that restart the filters (the row above
+ a block's first row is taken as zeros), so blocks encode and decode on the pool like v3
+ blocks. The per-row choice is PNG's minimum sum of absolute differences: one cheap pass per
+ filter, and close to what the entropy coder would pick.
+*/
+const uint64_t IMAGE_MAX_DIMENSION = 1 << 20;
+
+inline int paethPrediction(int a, int b, int c) {
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// byte = residual + prediction (mod 256) along a row of n bytes, bpp bytes per pixel; Decode
+// restores row from res, otherwise res receives the residuals of row (which is then only read)
+template <int Filter, bool Decode>
+void runRowFilter(uint8_t* row, const uint8_t* up, uint8_t* res, size_t n, size_t bpp) {
+    for (size_t i = 0; i < n; i++) {
+        int a = i >= bpp ? row[i - bpp] : 0, b = up[i], c = i >= bpp ? up[i - bpp] : 0;
+        int p = 0;
+        if (Filter == IMAGE_FILTER_SUB) p = a;
+        else if (Filter == IMAGE_FILTER_UP) p = b;
+        else if (Filter == IMAGE_FILTER_AVERAGE) p = (a + b) >> 1;
+        else if (Filter == IMAGE_FILTER_PAETH) p = paethPrediction(a, b, c);
+        if (Decode) row[i] = (uint8_t)(res[i] + p);
+        else res[i] = (uint8_t)(row[i] - p);
+    }
+}
+
+template <bool Decode>
+void runRowFilter(int filter, uint8_t* row, const uint8_t* up, uint8_t* res, size_t n, size_t bpp) {
+    switch (filter) {
+    case IMAGE_FILTER_NONE: runRowFilter<IMAGE_FILTER_NONE, Decode>(row, up, res, n, bpp); break;
+    case IMAGE_FILTER_SUB: runRowFilter<IMAGE_FILTER_SUB, Decode>(row, up, res, n, bpp); break;
+    case IMAGE_FILTER_UP: runRowFilter<IMAGE_FILTER_UP, Decode>(row, up, res, n, bpp); break;
+    case IMAGE_FILTER_AVERAGE: runRowFilter<IMAGE_FILTER_AVERAGE, Decode>(row, up, res, n, bpp); break;
+    default: runRowFilter<IMAGE_FILTER_PAETH, Decode>(row, up, res, n, bpp); break;
+    }
+}
+
+// rowCount rows starting at rows; out receives the block as laid out in the header
+void encodeImageBlock(const uint8_t* rows, size_t rowCount, const ImageLayout& image, vector<uint8_t>& out) {
+    size_t channels = (size_t)image.channels, width = (size_t)image.width, stride = (size_t)image.stride;
+    size_t rowBytes = width * channels, padding = stride - rowBytes;
+    vector<uint8_t> zeros(rowBytes, 0), res(rowBytes), best(rowBytes), coded;
+    vector<vector<uint8_t>> planes(channels + (padding ? 1 : 0));
+    for (size_t c = 0; c < channels; c++) planes[c].resize(rowCount * width);
+    if (padding) planes[channels].resize(rowCount * padding);
+
+    out.assign(rowCount, IMAGE_FILTER_NONE);
+    for (size_t r = 0; r < rowCount; r++) {
+        uint8_t* row = const_cast<uint8_t*>(rows + r * stride);
+        const uint8_t* up = r ? row - stride : zeros.data();
+        uint64_t bestCost = UINT64_MAX;
+        for (int filter = IMAGE_FILTER_NONE; filter <= IMAGE_FILTER_PAETH; filter++) {
+            runRowFilter<false>(filter, row, up, res.data(), rowBytes, channels);
+            uint64_t cost = 0;
+            for (size_t i = 0; i < rowBytes; i++) cost += (uint64_t)abs((int)(int8_t)res[i]);
+            if (cost < bestCost) {
+                bestCost = cost;
+                out[r] = (uint8_t)filter;
+                best.swap(res);
+            }
+        }
+        for (size_t x = 0; x < width; x++)
+            for (size_t c = 0; c < channels; c++) planes[c][r * width + x] = best[x * channels + c];
+        if (padding) memcpy(&planes[channels][r * padding], row + rowBytes, padding);
+    }
+    VectorWriter writer{ out };
+    uint64_t freqs[256];
+    for (const vector<uint8_t>& plane : planes) {
+        encodeBlock(plane.data(), plane.size(), coded, MAX_HEADER_CODE_LEN, freqs);
+        writeVarint(writer, coded.size());
+        out.insert(out.end(), coded.begin(), coded.end());
+    }
+}
+
+inline bool pnmSpace(uint8_t c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// next number of a PNM header, after whitespace and # comments
+bool readPnmNumber(ByteSpan file, uint64_t& pos, uint64_t& value) {
+    while (pos < file.size && (pnmSpace(file.data[pos]) || file.data[pos] == '#')) {
+        if (file.data[pos] == '#') while (pos < file.size && file.data[pos] != '\n') pos++;
+        else pos++;
+    }
+    uint64_t start = pos;
+    value = 0;
+    while (pos < file.size && pos - start < 10 && file.data[pos] >= '0' && file.data[pos] <= '9')
+        value = 10 * value + (file.data[pos++] - '0');
+    return pos > start;
+}
+
+bool parseImage(ByteSpan file, ImageLayout& image) {
+    if (file.size >= 2 && file.data[0] == 'P' && (file.data[1] == '5' || file.data[1] == '6')) {
+        uint64_t pos = 2, maxValue;
+        if (!readPnmNumber(file, pos, image.width) || !readPnmNumber(file, pos, image.height) ||
+            !readPnmNumber(file, pos, maxValue))
+            return false;
+        // one whitespace byte ends the header; samples wider than a byte are not handled
+        if (maxValue < 1 || maxValue > 255 || pos >= file.size || !pnmSpace(file.data[pos])) return false;
+        image.kind = IMAGE_PNM;
+        image.channels = file.data[1] == '5' ? 1 : 3;
+        image.stride = image.width * image.channels;
+        image.dataOffset = pos + 1;
+    }
+    else if (file.size >= 54 && file.data[0] == 'B' && file.data[1] == 'M') {
+        const uint8_t* h = file.data;
+        uint32_t headerSize = loadLE32(h + 14), compression = loadLE32(h + 30);
+        int32_t width = (int32_t)loadLE32(h + 18), height = (int32_t)loadLE32(h + 22);
+        int bits = h[28] | (h[29] << 8);
+        // uncompressed rows only: BI_RGB, or BI_BITFIELDS masks over 32-bit pixels
+        if (headerSize < 40 || !(compression == 0 || (compression == 3 && bits == 32))) return false;
+        if ((bits != 8 && bits != 24 && bits != 32) || width <= 0 || height == 0 || height == INT32_MIN) return false;
+        image.kind = IMAGE_BMP;
+        image.channels = bits / 8;
+        image.width = (uint64_t)width;
+        image.height = height < 0 ? (uint64_t)-(int64_t)height : (uint64_t)height; // negative: top-down rows
+        image.stride = (image.width * bits + 31) / 32 * 4;
+        image.dataOffset = loadLE32(h + 10);
+        if (image.dataOffset < 14 + (uint64_t)headerSize) return false;
+    }
+    else return false;
+    if (image.width < 1 || image.width > IMAGE_MAX_DIMENSION || image.height < 1 || image.height > IMAGE_MAX_DIMENSION)
+        return false;
+    // whole images only: a truncated one stays a byte stream
+    return image.dataOffset <= file.size && image.stride * image.height <= file.size - image.dataOffset;
+}
+
+bool isImageFile(const string& path) {
+    MappedInput mapped;
+    ImageLayout image;
+    return mapped.open(path) && parseImage(mapped.span(), image);
+}
+
+uint64_t imageBlockRows(const ImageLayout& image) {
+    return max<uint64_t>(1, DEFAULT_BLOCK_SIZE / image.stride);
+}
+
+// signature, image geometry, rows per block and the embedded streams around the rows
+template <class Sink>
+bool writeImagePrologue(Sink& out, ByteSpan file, const ImageLayout& image) {
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)HUFF_FORMAT_IMAGE);
+    out.put((char)image.kind);
+    out.put((char)image.channels);
+    writeVarint(out, image.width);
+    writeVarint(out, image.height);
+    writeVarint(out, image.stride);
+    writeVarint(out, imageBlockRows(image));
+    uint64_t dataEnd = image.dataOffset + image.stride * image.height;
+    return writeEmbeddedStream(out, ByteSpan{ file.data, (size_t)image.dataOffset }) &&
+        writeEmbeddedStream(out, ByteSpan{ file.data + dataEnd, (size_t)(file.size - dataEnd) });
+}
+
+bool compressImage(ByteSpan in, vector<uint8_t>& out, ThreadPool& pool) {
+    ImageLayout image;
+    if (!parseImage(in, image)) return false;
+    out.clear();
+    VectorWriter writer{ out };
+    if (!writeImagePrologue(writer, in, image)) return false;
+
+    uint64_t blockRows = imageBlockRows(image);
+    size_t blockCount = (size_t)((image.height + blockRows - 1) / blockRows);
+    vector<vector<uint8_t>> coded(blockCount);
+    vector<future<void>> done;
+    for (size_t b = 0; b < blockCount; b++) {
+        done.push_back(pool.submit([&, b] {
+            size_t rows = (size_t)min<uint64_t>(blockRows, image.height - b * blockRows);
+            encodeImageBlock(in.data + image.dataOffset + b * blockRows * image.stride, rows, image, coded[b]);
+        }));
+    }
+    for (size_t b = 0; b < done.size(); b++) done[b].get();
+
+    vector<BlockInfo> index(blockCount);
+    for (size_t b = 0; b < blockCount; b++) {
+        index[b].rawSize = min<uint64_t>(blockRows, image.height - b * blockRows) * image.stride;
+        index[b].codedSize = coded[b].size();
+        out.insert(out.end(), coded[b].begin(), coded[b].end());
+    }
+    writeBlockIndex(writer, index, out.size());
+    return true;
+}
+
+bool compressFileImage(const string& inPath, const string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    int threads, JobProgress* job) {
+    MappedInput mapped;
+    vector<uint8_t> loaded;
+    ByteSpan file;
+    if (mapped.open(inPath)) file = mapped.span();
+    else {
+        ifstream in(inPath, ios::binary | ios::ate);
+        if (!in) return false;
+        loaded.resize((size_t)in.tellg());
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(loaded.data()), loaded.size())) return false;
+        file = ByteSpan{ loaded.data(), loaded.size() };
+    }
+    ImageLayout image;
+    if (!parseImage(file, image)) return false;
+    ofstream out(outPath, ios::binary);
+    if (!out) { cerr << "Cannot open output file\n"; return false; }
+    if (!writeImagePrologue(out, file, image)) return false;
+
+    ThreadPool pool(threads);
+    uint64_t blockRows = imageBlockRows(image);
+    uint64_t blockCount = (image.height + blockRows - 1) / blockRows;
+    size_t batch = 2 * (size_t)pool.size();
+    vector<vector<uint8_t>> coded(batch);
+    vector<BlockInfo> index;
+    memset(freqs, 0, 256 * sizeof(uint64_t));
+    countFrequencies(file.data, file.size, freqs);
+    origBytes = file.size;
+    jobBegin(job, JOB_ENCODING, image.height * image.stride);
+
+    for (uint64_t first = 0; first < blockCount; first += batch) {
+        size_t filled = (size_t)min<uint64_t>(batch, blockCount - first);
+        vector<future<void>> done;
+        for (size_t b = 0; b < filled; b++) {
+            done.push_back(pool.submit([&, b] {
+                uint64_t start = (first + b) * blockRows;
+                size_t rows = (size_t)min<uint64_t>(blockRows, image.height - start);
+                encodeImageBlock(file.data + image.dataOffset + start * image.stride, rows, image, coded[b]);
+            }));
+        }
+        for (size_t b = 0; b < done.size(); b++) done[b].get();
+        uint64_t batchBytes = 0;
+        for (size_t b = 0; b < filled; b++) {
+            uint64_t rawSize = min<uint64_t>(blockRows, image.height - (first + b) * blockRows) * image.stride;
+            out.write(reinterpret_cast<const char*>(coded[b].data()), coded[b].size());
+            index.push_back(BlockInfo{ rawSize, coded[b].size() });
+            batchBytes += rawSize;
+        }
+        if (!jobAdvance(job, batchBytes)) return false;
+    }
+    writeBlockIndex(out, index, (uint64_t)out.tellp());
+    out.close();
+    return (bool)out;
+}
+
+// a v8 file in memory: the image geometry, the embedded streams and the block table (raw
+// offsets count from the first row)
+struct ImageFile {
+    ImageLayout layout;
+    uint64_t blockRows;
+    ByteSpan head, tail;
+    uint64_t headSize, tailSize;
+    vector<SeekEntry> blocks;
+
+    uint64_t rawSize() const { return headSize + layout.height * layout.stride + tailSize; }
+};
+
+bool parseImageFile(ByteSpan file, ImageFile& f) {
+    MemoryReader in{ file.data, file.data + file.size };
+    char sig[2], kind, channels;
+    if (!in.read(sig, sizeof(sig)) || sig[0] != (char)HUFF_SIGNATURE || sig[1] != (char)HUFF_FORMAT_IMAGE) return false;
+    ImageLayout& image = f.layout;
+    if (!in.get(kind) || !in.get(channels) || !readVarint(in, image.width) || !readVarint(in, image.height) ||
+        !readVarint(in, image.stride) || !readVarint(in, f.blockRows))
+        return false;
+    image.kind = (uint8_t)kind;
+    image.channels = (uint8_t)channels;
+    if (image.kind > IMAGE_PNM || (image.channels != 1 && image.channels != 3 && image.channels != 4)) return false;
+    if (image.width < 1 || image.width > IMAGE_MAX_DIMENSION || image.height < 1 || image.height > IMAGE_MAX_DIMENSION)
+        return false;
+    // BMP pads rows to 4 bytes, PNM not at all
+    uint64_t rowBytes = image.width * image.channels;
+    if (image.stride < rowBytes || image.stride - rowBytes > 3) return false;
+    if (f.blockRows < 1 || f.blockRows > MAX_BLOCK_SIZE / image.stride) return false;
+    if (!readEmbeddedStream(in, f.head, f.headSize) || !readEmbeddedStream(in, f.tail, f.tailSize)) return false;
+    image.dataOffset = f.headSize;
+
+    uint64_t dataStart = (uint64_t)(in.cur - file.data);
+    if (file.size < dataStart + 8) return false;
+    uint64_t indexOffset = loadTrailerOffset(file.data + file.size - 8);
+    if (indexOffset < dataStart || indexOffset > file.size - 8) return false;
+    f.blocks.clear();
+    uint64_t count, rows = 0;
+    bool ok = walkBlockIndex(file.data + indexOffset, (size_t)(file.size - 8 - indexOffset), dataStart, indexOffset, count,
+        [&](const SeekEntry& e) {
+            if (e.rawSize == 0 || e.rawSize % image.stride != 0 || e.rawSize > f.blockRows * image.stride) return false;
+            rows += e.rawSize / image.stride;
+            f.blocks.push_back(e);
+            return true;
+        });
+    return ok && rows == image.height;
+}
+
+// one block of rowCount rows into out
+bool decodeImageBlock(const uint8_t* data, size_t size, const ImageLayout& image, uint8_t* out, size_t rowCount) {
+    size_t channels = (size_t)image.channels, width = (size_t)image.width, stride = (size_t)image.stride;
+    size_t rowBytes = width * channels, padding = stride - rowBytes;
+    if (size < rowCount) return false;
+    const uint8_t* filters = data;
+    for (size_t r = 0; r < rowCount; r++) if (filters[r] > IMAGE_FILTER_PAETH) return false;
+
+    // the planes one after the other: every channel, then the padding
+    thread_local vector<uint8_t> planes, res, zeros;
+    planes.resize(rowCount * stride);
+    MemoryReader in{ data + rowCount, data + size };
+    for (size_t p = 0; p < channels + (padding ? 1 : 0); p++) {
+        size_t n = rowCount * (p < channels ? width : padding);
+        uint64_t codedSize;
+        if (!readVarint(in, codedSize) || codedSize > (uint64_t)(in.end - in.cur)) return false;
+        if (!decodeBlock(in.cur, (size_t)codedSize, planes.data() + p * rowCount * width, n)) return false;
+        in.cur += codedSize;
+    }
+    if (in.cur != in.end) return false;
+
+    res.resize(rowBytes);
+    zeros.assign(rowBytes, 0);
+    for (size_t r = 0; r < rowCount; r++) {
+        for (size_t c = 0; c < channels; c++) {
+            const uint8_t* plane = planes.data() + (c * rowCount + r) * width;
+            for (size_t x = 0; x < width; x++) res[x * channels + c] = plane[x];
+        }
+        uint8_t* row = out + r * stride;
+        runRowFilter<true>(filters[r], row, r ? row - stride : zeros.data(), res.data(), rowBytes, channels);
+        if (padding) memcpy(row + rowBytes, planes.data() + channels * rowCount * width + r * padding, padding);
+    }
+    return true;
+}
+
+// decodes a parsed v8 file into out[0, rawSize), blocks on the pool when there is one
+bool decodeImageFile(ByteSpan file, const ImageFile& f, uint8_t* out, ThreadPool* pool, JobProgress* job = nullptr) {
+    size_t written;
+    if (!decompressInto(f.head, out, (size_t)f.headSize, written)) return false;
+    uint8_t* rows = out + f.headSize;
+    uint64_t rowsSize = f.layout.height * f.layout.stride;
+    if (!decompressInto(f.tail, rows + rowsSize, (size_t)f.tailSize, written)) return false;
+    atomic<bool> failed(false);
+    auto decodeOne = [&](const SeekEntry& e) {
+        if (failed || jobCancelled(job)) return;
+        if (!decodeImageBlock(file.data + e.fileOffset, (size_t)e.codedSize, f.layout, rows + e.rawOffset,
+            (size_t)(e.rawSize / f.layout.stride)))
+            failed = true;
+        jobAdvance(job, e.rawSize);
+    };
+    jobBegin(job, JOB_DECODING, rowsSize);
+    vector<future<void>> done;
+    for (const SeekEntry& e : f.blocks) {
+        if (pool) done.push_back(pool->submit([&] { decodeOne(e); }));
+        else decodeOne(e);
+    }
+    for (size_t i = 0; i < done.size(); i++) done[i].get();
+    return !failed && !jobCancelled(job);
+}
+
+bool summarizeImage(ByteSpan file, ImageSummary& summary) {
+    ImageFile f;
+    if (!parseImageFile(file, f)) return false;
+    memset(&summary, 0, sizeof(summary));
+    summary.kind = f.layout.kind;
+    summary.channels = f.layout.channels;
+    summary.width = f.layout.width;
+    summary.height = f.layout.height;
+    summary.blocks = f.blocks.size();
+    summary.rawSize = f.rawSize();
+    for (const SeekEntry& e : f.blocks) {
+        uint64_t rows = min<uint64_t>(e.rawSize / f.layout.stride, e.codedSize);
+        for (uint64_t r = 0; r < rows; r++) {
+            uint8_t filter = file.data[e.fileOffset + r];
+            if (filter <= IMAGE_FILTER_PAETH) summary.rowsByFilter[filter]++;
+        }
+    }
+    return true;
+}
+
+/*
+ Transformed byte blocks (formats v9 and v10)
+ Both cut the input into independent blocks of one size behind a three-byte prologue and
+ differ only in how a block is coded, so the block loops and the file table are shared.
+*/
+
+template <class Sink>
+void writeByteBlocksPrologue(Sink& out, uint8_t version, size_t blockSize) {
+    out.put((char)HUFF_SIGNATURE);
+    out.put((char)version);
+    writeVarint(out, blockSize);
+}
+
+// encodeOne(data, n, coded) codes one block
+template <class EncodeOne>
+void compressByteBlocks(ByteSpan in, vector<uint8_t>& out, ThreadPool& pool, uint8_t version, size_t blockSize,
+    EncodeOne encodeOne) {
+    size_t blockCount = (in.size + blockSize - 1) / blockSize;
+    vector<vector<uint8_t>> coded(blockCount);
+    vector<future<void>> done;
+    for (size_t b = 0; b < blockCount; b++) {
+        done.push_back(pool.submit([&, b] {
+            size_t start = b * blockSize;
+            encodeOne(in.data + start, min(blockSize, in.size - start), coded[b]);
+        }));
+    }
+    for (size_t b = 0; b < done.size(); b++) done[b].get();
+
+    out.clear();
+    VectorWriter writer{ out };
+    writeByteBlocksPrologue(writer, version, blockSize);
+    vector<BlockInfo> index(blockCount);
+    for (size_t b = 0; b < blockCount; b++) {
+        index[b].rawSize = min(blockSize, in.size - b * blockSize);
+        index[b].codedSize = coded[b].size();
+        out.insert(out.end(), coded[b].begin(), coded[b].end());
+    }
+    writeBlockIndex(writer, index, out.size());
+}
+
+// file version: a batch of blocks per round (two per worker), from the mapped input or the
+// whole file read into memory
+template <class EncodeOne>
+bool compressFileByteBlocks(const string& inPath, const string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    uint8_t version, size_t blockSize, int threads, JobProgress* job, EncodeOne encodeOne) {
+    MappedInput mapped;
+    vector<uint8_t> loaded;
+    ByteSpan file;
+    if (mapped.open(inPath)) file = mapped.span();
+    else {
+        ifstream in(inPath, ios::binary | ios::ate);
+        if (!in) return false;
+        loaded.resize((size_t)in.tellg());
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(loaded.data()), loaded.size())) return false;
+        file = ByteSpan{ loaded.data(), loaded.size() };
+    }
+    ofstream out(outPath, ios::binary);
+    if (!out) { cerr << "Cannot open output file\n"; return false; }
+    writeByteBlocksPrologue(out, version, blockSize);
+
+    ThreadPool pool(threads);
+    uint64_t blockCount = (file.size + blockSize - 1) / blockSize;
+    size_t batch = 2 * (size_t)pool.size();
+    vector<vector<uint8_t>> coded(batch);
+    vector<BlockInfo> index;
+    memset(freqs, 0, 256 * sizeof(uint64_t));
+    countFrequencies(file.data, file.size, freqs);
+    origBytes = file.size;
+    jobBegin(job, JOB_ENCODING, file.size);
+
+    for (uint64_t first = 0; first < blockCount; first += batch) {
+        size_t filled = (size_t)min<uint64_t>(batch, blockCount - first);
+        vector<future<void>> done;
+        for (size_t b = 0; b < filled; b++) {
+            done.push_back(pool.submit([&, b] {
+                size_t start = (size_t)(first + b) * blockSize;
+                encodeOne(file.data + start, min(blockSize, file.size - start), coded[b]);
+            }));
+        }
+        for (size_t b = 0; b < done.size(); b++) done[b].get();
+        uint64_t batchBytes = 0;
+        for (size_t b = 0; b < filled; b++) {
+            uint64_t rawSize = min<uint64_t>(blockSize, file.size - (first + b) * blockSize);
+            out.write(reinterpret_cast<const char*>(coded[b].data()), coded[b].size());
+            index.push_back(BlockInfo{ rawSize, coded[b].size() });
+            batchBytes += rawSize;
+        }
+        if (!jobAdvance(job, batchBytes)) return false;
+    }
+    writeBlockIndex(out, index, (uint64_t)out.tellp());
+    out.close();
+    return (bool)out;
+}
+
+// a v9 or v10 file in memory: its version, block size and block table
+struct ByteBlocksFile {
+    uint8_t version;
+    uint64_t blockSize;
+    vector<SeekEntry> blocks;
+
+    uint64_t rawSize() const { return blocks.empty() ? 0 : blocks.back().rawOffset + blocks.back().rawSize; }
+};
+
+bool parseByteBlocksFile(ByteSpan file, ByteBlocksFile& f) {
+    MemoryReader in{ file.data, file.data + file.size };
+    char sig[2];
+    if (!in.read(sig, sizeof(sig)) || sig[0] != (char)HUFF_SIGNATURE) return false;
+    if (sig[1] != (char)HUFF_FORMAT_BWT && sig[1] != (char)HUFF_FORMAT_LZ) return false;
+    f.version = (uint8_t)sig[1];
+    uint64_t maxBlockSize = f.version == HUFF_FORMAT_BWT ? BWT_MAX_BLOCK_SIZE : MAX_BLOCK_SIZE;
+    if (!readVarint(in, f.blockSize) || f.blockSize < MIN_BLOCK_SIZE || f.blockSize > maxBlockSize) return false;
+    uint64_t dataStart = (uint64_t)(in.cur - file.data);
+    if (file.size < dataStart + 8) return false;
+    uint64_t indexOffset = loadTrailerOffset(file.data + file.size - 8);
+    if (indexOffset < dataStart || indexOffset > file.size - 8) return false;
+    f.blocks.clear();
+    uint64_t count;
+    return walkBlockIndex(file.data + indexOffset, (size_t)(file.size - 8 - indexOffset), dataStart, indexOffset, count,
+        [&](const SeekEntry& e) {
+            if (e.rawSize == 0 || e.rawSize > f.blockSize) return false;
+            f.blocks.push_back(e);
+            return true;
+        });
+}
+
+/*
+ Block sorting (format v9, layout in huffman_core.h)
+ The suffix array comes from induced sorting (SA-IS: Nong, Zhang and Chan), linear in the
+ block size. Every block sorts on its own, so blocks encode and decode on the pool like v3
+ blocks; the transform dominates the encoder, the symbol coder is the v3 block coder.
+*/
+
+// the first (end = false) or one past the last slot of every symbol's bucket
+void saisBuckets(const int32_t* s, int32_t n, int32_t k, vector<int32_t>& bkt, bool end) {
+    bkt.assign((size_t)k, 0);
+    for (int32_t i = 0; i < n; i++) bkt[s[i]]++;
+    int32_t sum = 0;
+    for (int32_t c = 0; c < k; c++) {
+        sum += bkt[c];
+        bkt[c] = end ? sum : sum - bkt[c];
+    }
+}
+
+// places the L-type suffixes from the sorted ones already in sa, then the S-type ones
+void saisInduce(const int32_t* s, const vector<uint8_t>& stype, int32_t* sa, int32_t n, int32_t k, vector<int32_t>& bkt) {
+    saisBuckets(s, n, k, bkt, false);
+    for (int32_t i = 0; i < n; i++) {
+        int32_t j = sa[i] - 1;
+        if (sa[i] > 0 && !stype[j]) sa[bkt[s[j]]++] = j;
+    }
+    saisBuckets(s, n, k, bkt, true);
+    for (int32_t i = n - 1; i >= 0; i--) {
+        int32_t j = sa[i] - 1;
+        if (sa[i] > 0 && stype[j]) sa[--bkt[s[j]]] = j;
+    }
+}
+
+// suffix array of s[0, n) over the symbols [0, k); s ends in a sentinel, symbol 0, found
+// nowhere else. The reduced problem is solved in place in sa.
+void suffixArray(const int32_t* s, int32_t* sa, int32_t n, int32_t k) {
+    if (n == 1) {
+        sa[0] = 0;
+        return;
+    }
+    // S-type: the suffix is smaller than the next one; LMS: an S-type after an L-type
+    vector<uint8_t> stype((size_t)n);
+    stype[n - 1] = 1;
+    for (int32_t i = n - 2; i >= 0; i--) stype[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && stype[i + 1]);
+    auto isLms = [&stype](int32_t i) { return i > 0 && stype[i] && !stype[i - 1]; };
+
+    // sort the LMS substrings by inducing from their bucket ends
+    vector<int32_t> bkt;
+    saisBuckets(s, n, k, bkt, true);
+    fill(sa, sa + n, -1);
+    for (int32_t i = 1; i < n; i++) if (isLms(i)) sa[--bkt[s[i]]] = i;
+    saisInduce(s, stype, sa, n, k, bkt);
+    int32_t n1 = 0;
+    for (int32_t i = 0; i < n; i++) if (isLms(sa[i])) sa[n1++] = sa[i];
+
+    // name them in that order (equal substrings, equal names); LMS positions are at least two
+    // apart, so position / 2 gives every name its own slot in the upper half
+    fill(sa + n1, sa + n, -1);
+    int32_t names = 0, prev = -1;
+    for (int32_t i = 0; i < n1; i++) {
+        int32_t pos = sa[i];
+        bool diff = false;
+        for (int32_t d = 0; d < n; d++) {
+            if (prev < 0 || s[pos + d] != s[prev + d] || stype[pos + d] != stype[prev + d]) {
+                diff = true;
+                break;
+            }
+            if (d > 0 && (isLms(pos + d) || isLms(prev + d))) break;
+        }
+        if (diff) {
+            names++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = names - 1;
+    }
+    for (int32_t i = n - 1, j = n - 1; i >= n1; i--) if (sa[i] >= 0) sa[j--] = sa[i];
+
+    // sort the LMS suffixes: recursively while names repeat
+    int32_t* s1 = sa + n - n1;
+    if (names < n1) suffixArray(s1, sa, n1, names);
+    else for (int32_t i = 0; i < n1; i++) sa[s1[i]] = i;
+
+    // and induce the whole array from them
+    saisBuckets(s, n, k, bkt, true);
+    for (int32_t i = 1, j = 0; i < n; i++) if (isLms(i)) s1[j++] = i;
+    for (int32_t i = 0; i < n1; i++) sa[i] = s1[sa[i]];
+    fill(sa + n1, sa + n, -1);
+    for (int32_t i = n1 - 1; i >= 0; i--) {
+        int32_t j = sa[i];
+        sa[i] = -1;
+        sa[--bkt[s[j]]] = j;
+    }
+    saisInduce(s, stype, sa, n, k, bkt);
+}
+
+// Burrows-Wheeler transform of n > 0 bytes into out[0, n); returns the primary index
+uint32_t bwtForward(const uint8_t* data, size_t n, uint8_t* out) {
+    vector<int32_t> text(n + 1), sa(n + 1);
+    for (size_t i = 0; i < n; i++) text[i] = data[i] + 1;
+    text[n] = 0;
+    suffixArray(text.data(), sa.data(), (int32_t)n + 1, 257);
+    uint32_t primary = 0;
+    for (size_t i = 0, k = 0; i <= n; i++) {
+        if (sa[i] == 0) primary = (uint32_t)i;
+        else out[k++] = data[sa[i] - 1];
+    }
+    return primary;
+}
+
+// the inverse: every row gets the row of the rotation one byte further on and its first byte,
+// packed in 32 bits (rows below 2^24), and the walk from the primary row reads the text
+bool bwtInverse(const uint8_t* last, size_t n, uint32_t primary, uint8_t* out) {
+    if (primary < 1 || primary > n) return false;
+    thread_local vector<uint32_t> next;
+    next.resize(n + 1);
+    uint32_t counts[256] = {}, start[256];
+    for (size_t i = 0; i < n; i++) counts[last[i]]++;
+    for (uint32_t c = 0, sum = 1; c < 256; c++) {
+        start[c] = sum;
+        sum += counts[c];
+    }
+    next[0] = primary << 8; // the sentinel's row
+    for (size_t row = 0, i = 0; row <= n; row++) {
+        if (row == primary) continue;
+        uint8_t c = last[i++];
+        next[start[c]++] = (uint32_t)row << 8 | c;
+    }
+    for (size_t i = 0, row = primary; i < n; i++) {
+        uint32_t e = next[row];
+        out[i] = (uint8_t)e;
+        row = e >> 8;
+    }
+    return true;
+}
+
+// move-to-front, then the zero runs as RUNA/RUNB digits: the symbols of the v9 layout
+void bwtSymbols(const uint8_t* last, size_t n, vector<uint8_t>& out) {
+    uint8_t order[256];
+    for (int i = 0; i < 256; i++) order[i] = (uint8_t)i;
+    out.clear();
+    size_t run = 0;
+    auto flushRun = [&] {
+        while (run) {
+            out.push_back(run & 1 ? BWT_RUNA : BWT_RUNB);
+            run = (run - 1) / 2; // a RUNB digit leaves an odd rest, which rounds down alike
+        }
+    };
+    for (size_t i = 0; i < n; i++) {
+        uint8_t c = last[i];
+        if (order[0] == c) {
+            run++;
+            continue;
+        }
+        flushRun();
+        size_t v = (size_t)(static_cast<const uint8_t*>(memchr(order, c, sizeof(order))) - order);
+        memmove(order + 1, order, v);
+        order[0] = c;
+        if (v < BWT_ESCAPE - 1) out.push_back((uint8_t)(v + 1));
+        else {
+            out.push_back(BWT_ESCAPE);
+            out.push_back((uint8_t)(v - (BWT_ESCAPE - 1)));
+        }
+    }
+    flushRun();
+}
+
+// symbols back into the transformed block; false unless they make exactly n bytes
+bool bwtUnsymbols(const uint8_t* symbols, size_t count, uint8_t* last, size_t n) {
+    uint8_t order[256];
+    for (int i = 0; i < 256; i++) order[i] = (uint8_t)i;
+    size_t k = 0;
+    for (size_t i = 0; i < count;) {
+        if (symbols[i] <= BWT_RUNB) {
+            // a whole run at once: a fill of the front byte
+            uint64_t run = 0, weight = 1;
+            for (; i < count && symbols[i] <= BWT_RUNB; i++, weight <<= 1) {
+                run += (symbols[i] + 1) * weight;
+                if (run > n - k) return false;
+            }
+            memset(last + k, order[0], (size_t)run);
+            k += (size_t)run;
+            continue;
+        }
+        size_t v = symbols[i++] - 1;
+        if (v == BWT_ESCAPE - 1) {
+            if (i == count || symbols[i] > 1) return false;
+            v += symbols[i++];
+        }
+        if (k == n) return false;
+        uint8_t c = order[v];
+        memmove(order + 1, order, v);
+        order[0] = c;
+        last[k++] = c;
+    }
+    return k == n;
+}
+
+// one block: primary index, symbol count and the symbols as a v3 block; a block the transform
+// does not shrink is coded untransformed (primary index 0)
+void encodeBwtBlock(const uint8_t* data, size_t n, vector<uint8_t>& out) {
+    thread_local vector<uint8_t> last, symbols, coded;
+    last.resize(n);
+    uint32_t primary = bwtForward(data, n, last.data());
+    bwtSymbols(last.data(), n, symbols);
+    uint64_t freqs[256];
+    encodeBlock(symbols.data(), symbols.size(), coded, MAX_HEADER_CODE_LEN, freqs);
+    size_t count = symbols.size();
+    if (coded.size() >= n) {
+        primary = 0;
+        count = n;
+        encodeBlock(data, n, coded, MAX_HEADER_CODE_LEN, freqs);
+    }
+    out.clear();
+    VectorWriter writer{ out };
+    writeVarint(writer, primary);
+    writeVarint(writer, count);
+    out.insert(out.end(), coded.begin(), coded.end());
+}
+
+bool decodeBwtBlock(const uint8_t* data, size_t size, uint8_t* out, uint64_t rawSize) {
+    MemoryReader in{ data, data + size };
+    uint64_t primary, count;
+    if (!readVarint(in, primary) || !readVarint(in, count)) return false;
+    size_t n = (size_t)rawSize, rest = (size_t)(in.end - in.cur);
+    if (primary == 0) return count == rawSize && decodeBlock(in.cur, rest, out, rawSize);
+    // a byte takes two symbols at most (an escape and its value)
+    if (primary > rawSize || count > 2 * rawSize) return false;
+    thread_local vector<uint8_t> symbols, last;
+    symbols.resize((size_t)count);
+    last.resize(n);
+    return decodeBlock(in.cur, rest, symbols.data(), count) && bwtUnsymbols(symbols.data(), (size_t)count, last.data(), n) &&
+        bwtInverse(last.data(), n, (uint32_t)primary, out);
+}
+
+size_t bwtBlockSize(size_t blockSize) {
+    return min(max(blockSize, MIN_BLOCK_SIZE), BWT_MAX_BLOCK_SIZE);
+}
+
+void compressBwt(ByteSpan in, vector<uint8_t>& out, ThreadPool& pool, size_t blockSize) {
+    compressByteBlocks(in, out, pool, HUFF_FORMAT_BWT, bwtBlockSize(blockSize), encodeBwtBlock);
+}
+
+bool compressFileBwt(const string& inPath, const string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    size_t blockSize, int threads, JobProgress* job) {
+    return compressFileByteBlocks(inPath, outPath, freqs, origBytes, HUFF_FORMAT_BWT, bwtBlockSize(blockSize), threads, job,
+        encodeBwtBlock);
+}
+
+/*
+ Dictionary matches (format v10, layout in huffman_core.h)
+ Hash chains over 4-byte prefixes: head holds the latest position of every hash and prev links
+ each position to the one before it with the same hash, in a ring of LZ_WINDOW entries. The
+ levels trade chain depth and lazy matching for speed, much like zlib's.
+*/
+struct LzLevel {
+    int chain;   // candidates tried per position
+    size_t good; // a match this long cuts the candidates left to a quarter
+    size_t nice; // a match this long ends the search
+    size_t lazy; // a match shorter than this waits for a longer one at the next position
+};
+
+const LzLevel LZ_LEVELS[LZ_MAX_LEVEL + 1] = {
+    { 0, 0, 0, 0 },
+    { 4, 8, 16, 0 }, { 8, 8, 32, 0 }, { 16, 8, 48, 0 },           // greedy
+    { 16, 8, 32, 8 }, { 32, 8, 64, 16 }, { 128, 8, 128, 32 },     // lazy
+    { 256, 16, 256, 64 }, { 1024, 32, 1024, 256 }, { 4096, 32, 4096, 4096 }
+};
+const int LZ_HASH_BITS = 18; // at most: small blocks get a smaller table
+
+inline uint32_t lzHash(const uint8_t* p, int bits) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - bits);
+}
+
+// length of the common prefix of a and b, at most max
+inline size_t matchLength(const uint8_t* a, const uint8_t* b, size_t max) {
+    size_t len = 0;
+    while (len + 8 <= max && memcmp(a + len, b + len, 8) == 0) len += 8;
+    while (len < max && a[len] == b[len]) len++;
+    return len;
+}
+
+class LzMatchFinder {
+    const uint8_t* data;
+    size_t n;
+    const LzLevel& level;
+    int hashBits;
+    vector<int32_t> head, prev;
+    size_t hashed; // positions below this are in the chains
+
+public:
+    LzMatchFinder(const uint8_t* block, size_t size, const LzLevel& lv)
+        : data(block), n(size), level(lv), hashBits(min(max(bitLength((uint32_t)min<size_t>(size, LZ_WINDOW)), 8), LZ_HASH_BITS)),
+        head((size_t)1 << hashBits, -1), prev(min(size, LZ_WINDOW)), hashed(0) {
+    }
+
+    // the longest earlier match for the bytes at pos (0 if none reaches LZ_MIN_MATCH); positions
+    // are asked in increasing order
+    size_t find(size_t pos, size_t& dist) {
+        for (; hashed < pos && hashed + LZ_MIN_MATCH <= n; hashed++) {
+            uint32_t h = lzHash(data + hashed, hashBits);
+            prev[hashed & (LZ_WINDOW - 1)] = head[h];
+            head[h] = (int32_t)hashed;
+        }
+        size_t limit = n - pos, best = 0;
+        if (limit < LZ_MIN_MATCH) return 0;
+        int32_t cand = head[lzHash(data + pos, hashBits)];
+        for (int tries = level.chain; cand >= 0 && tries > 0; tries--) {
+            size_t d = pos - (size_t)cand;
+            if (d >= LZ_WINDOW) break; // older links are overwritten
+            const uint8_t* c = data + cand;
+            if (c[best] == data[pos + best]) {
+                size_t len = matchLength(c, data + pos, limit);
+                if (len > best) {
+                    if (best < level.good && len >= level.good) tries = max<int>(1, tries / 4);
+                    best = len;
+                    dist = d;
+                    if (len >= level.nice || len == limit) break;
+                }
+            }
+            cand = prev[cand & (LZ_WINDOW - 1)];
+        }
+        return best >= LZ_MIN_MATCH ? best : 0;
+    }
+};
+
+// the sequences of a block and their streams (layout in huffman_core.h)
+struct LzStreams {
+    vector<uint8_t> literals, runs, lengths, distances, extra;
+    size_t sequences;
+
+    void clear() {
+        literals.clear();
+        runs.clear();
+        lengths.clear();
+        distances.clear();
+        extra.clear();
+        sequences = 0;
+    }
+};
+
+// class of v into classes, the bits below its leading one into bits
+inline void putLzValue(vector<uint8_t>& classes, BitWriter& bits, uint32_t v) {
+    int c = bitLength(v);
+    classes.push_back((uint8_t)c);
+    if (c > 1) bits.put(v & ((1u << (c - 1)) - 1), c - 1);
+}
+
+void lzParse(const uint8_t* data, size_t n, const LzLevel& level, LzStreams& s) {
+    LzMatchFinder finder(data, n, level);
+    BitWriter bits(s.extra);
+    size_t pos = 0, litStart = 0;
+    while (pos + LZ_MIN_MATCH <= n) {
+        size_t dist = 0, len = finder.find(pos, dist);
+        if (!len) {
+            pos++;
+            continue;
+        }
+        // lazy matching: a longer match one byte on wins, and the byte goes out as a literal
+        while (len < level.lazy && pos + 1 + LZ_MIN_MATCH <= n) {
+            size_t nextDist = 0, next = finder.find(pos + 1, nextDist);
+            if (next <= len) break;
+            pos++;
+            len = next;
+            dist = nextDist;
+        }
+        s.literals.insert(s.literals.end(), data + litStart, data + pos);
+        putLzValue(s.runs, bits, (uint32_t)(pos - litStart));
+        putLzValue(s.lengths, bits, (uint32_t)(len - LZ_MIN_MATCH));
+        putLzValue(s.distances, bits, (uint32_t)(dist - 1));
+        s.sequences++;
+        pos += len;
+        litStart = pos;
+    }
+    s.literals.insert(s.literals.end(), data + litStart, data + n);
+    bits.finish();
+}
+
+void writeLzStreams(const LzStreams& s, vector<uint8_t>& out) {
+    thread_local vector<uint8_t> coded;
+    out.clear();
+    VectorWriter writer{ out };
+    writeVarint(writer, s.sequences);
+    writeVarint(writer, s.literals.size());
+    uint64_t freqs[256];
+    for (const vector<uint8_t>* stream : { &s.literals, &s.runs, &s.lengths, &s.distances }) {
+        encodeBlock(stream->data(), stream->size(), coded, MAX_HEADER_CODE_LEN, freqs);
+        writeVarint(writer, coded.size());
+        out.insert(out.end(), coded.begin(), coded.end());
+    }
+    writeVarint(writer, s.extra.size());
+    out.insert(out.end(), s.extra.begin(), s.extra.end());
+}
+
+// one block; all literals when the matches would not make it smaller
+void encodeLzBlock(const uint8_t* data, size_t n, int level, vector<uint8_t>& out) {
+    thread_local LzStreams s;
+    s.clear();
+    lzParse(data, n, LZ_LEVELS[level], s);
+    writeLzStreams(s, out);
+    if (out.size() >= n && s.sequences > 0) {
+        s.clear();
+        s.literals.assign(data, data + n);
+        writeLzStreams(s, out);
+    }
+}
+
+bool decodeLzBlock(const uint8_t* data, size_t size, uint8_t* out, uint64_t rawSize) {
+    MemoryReader in{ data, data + size };
+    uint64_t sequences, literalCount;
+    if (!readVarint(in, sequences) || !readVarint(in, literalCount)) return false;
+    // every match copies at least LZ_MIN_MATCH bytes
+    if (literalCount > rawSize || sequences > (rawSize - literalCount) / LZ_MIN_MATCH) return false;
+    thread_local vector<uint8_t> streams[4];
+    uint64_t counts[4] = { literalCount, sequences, sequences, sequences };
+    for (int i = 0; i < 4; i++) {
+        uint64_t codedSize;
+        if (!readVarint(in, codedSize) || codedSize > (uint64_t)(in.end - in.cur)) return false;
+        streams[i].resize((size_t)counts[i]);
+        if (!decodeBlock(in.cur, (size_t)codedSize, streams[i].data(), counts[i])) return false;
+        in.cur += codedSize;
+    }
+    uint64_t extraSize;
+    if (!readVarint(in, extraSize) || extraSize != (uint64_t)(in.end - in.cur)) return false;
+
+    // a class is at most 32, so its bits (31 at most) need one refill
+    BitReader bits(in.cur, (size_t)extraSize);
+    int64_t bitsLeft = 8 * (int64_t)extraSize;
+    bool invalid = false;
+    auto value = [&](uint8_t c) -> uint64_t {
+        if (c <= 1) return c;
+        if (c > 32) {
+            invalid = true;
+            return 0;
+        }
+        if (bits.bitCount < 32) bits.refill();
+        uint64_t v = ((uint64_t)1 << (c - 1)) | (bits.bitBuf >> (65 - c));
+        bits.consume(c - 1);
+        bitsLeft -= c - 1;
+        return v;
+    };
+    const uint8_t* lit = streams[0].data();
+    const uint8_t *runs = streams[1].data(), *lengths = streams[2].data(), *distances = streams[3].data();
+    uint8_t* o = out;
+    uint8_t* end = out + rawSize;
+    for (size_t i = 0; i < (size_t)sequences; i++) {
+        uint64_t run = value(runs[i]);
+        uint64_t len = value(lengths[i]) + LZ_MIN_MATCH;
+        uint64_t dist = value(distances[i]) + 1;
+        if (invalid || run > (uint64_t)(streams[0].data() + literalCount - lit) || run + len > (uint64_t)(end - o)) return false;
+        memcpy(o, lit, (size_t)run);
+        o += run;
+        lit += run;
+        if (dist > (uint64_t)(o - out)) return false;
+        // an overlapping match repeats its first dist bytes: copies double from the same source
+        const uint8_t* src = o - dist;
+        if (dist == 1) {
+            memset(o, *src, (size_t)len);
+            o += len;
+        }
+        else {
+            while (len > 0) {
+                size_t chunk = (size_t)min<uint64_t>(len, (uint64_t)(o - src));
+                memcpy(o, src, chunk);
+                o += chunk;
+                len -= chunk;
+            }
+        }
+    }
+    size_t rest = (size_t)(streams[0].data() + literalCount - lit);
+    if (bitsLeft < 0 || rest != (size_t)(end - o)) return false;
+    memcpy(o, lit, rest);
+    return true;
+}
+
+int lzLevel(int level) {
+    return min(max(level, 1), LZ_MAX_LEVEL);
+}
+
+size_t lzBlockSize(size_t blockSize) {
+    return min(max(blockSize, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE);
+}
+
+void compressLz(ByteSpan in, vector<uint8_t>& out, ThreadPool& pool, int level, size_t blockSize) {
+    level = lzLevel(level);
+    compressByteBlocks(in, out, pool, HUFF_FORMAT_LZ, lzBlockSize(blockSize),
+        [level](const uint8_t* data, size_t n, vector<uint8_t>& coded) { encodeLzBlock(data, n, level, coded); });
+}
+
+bool compressFileLz(const string& inPath, const string& outPath, uint64_t freqs[256], uint64_t& origBytes, int level,
+    size_t blockSize, int threads, JobProgress* job) {
+    level = lzLevel(level);
+    return compressFileByteBlocks(inPath, outPath, freqs, origBytes, HUFF_FORMAT_LZ, lzBlockSize(blockSize), threads, job,
+        [level](const uint8_t* data, size_t n, vector<uint8_t>& coded) { encodeLzBlock(data, n, level, coded); });
+}
+
+// decodes a parsed v9 or v10 file into out[0, rawSize), blocks on the pool when there is one
+bool decodeByteBlocksFile(ByteSpan file, const ByteBlocksFile& f, uint8_t* out, ThreadPool* pool, JobProgress* job = nullptr) {
+    auto decodeOne = f.version == HUFF_FORMAT_BWT ? decodeBwtBlock : decodeLzBlock;
+    atomic<bool> failed(false);
+    auto decodeEntry = [&](const SeekEntry& e) {
+        if (failed || jobCancelled(job)) return;
+        if (!decodeOne(file.data + e.fileOffset, (size_t)e.codedSize, out + e.rawOffset, e.rawSize)) failed = true;
+        jobAdvance(job, e.rawSize);
+    };
+    jobBegin(job, JOB_DECODING, f.rawSize());
+    vector<future<void>> done;
+    for (const SeekEntry& e : f.blocks) {
+        if (pool) done.push_back(pool->submit([&] { decodeEntry(e); }));
+        else decodeEntry(e);
+    }
+    for (size_t i = 0; i < done.size(); i++) done[i].get();
+    return !failed && !jobCancelled(job);
+}
+
+bool summarizeBwt(ByteSpan file, BwtSummary& summary) {
+    ByteBlocksFile f;
+    if (!parseByteBlocksFile(file, f) || f.version != HUFF_FORMAT_BWT) return false;
+    memset(&summary, 0, sizeof(summary));
+    summary.blockSize = f.blockSize;
+    summary.blocks = f.blocks.size();
+    summary.rawSize = f.rawSize();
+    for (const SeekEntry& e : f.blocks) {
+        MemoryReader in{ file.data + e.fileOffset, file.data + e.fileOffset + e.codedSize };
+        uint64_t primary, count;
+        if (!readVarint(in, primary) || !readVarint(in, count)) continue;
+        if (primary == 0) summary.untransformed++;
+        else summary.symbols += count;
+    }
+    return true;
+}
+
+bool summarizeLz(ByteSpan file, LzSummary& summary) {
+    ByteBlocksFile f;
+    if (!parseByteBlocksFile(file, f) || f.version != HUFF_FORMAT_LZ) return false;
+    memset(&summary, 0, sizeof(summary));
+    summary.blockSize = f.blockSize;
+    summary.blocks = f.blocks.size();
+    summary.rawSize = f.rawSize();
+    for (const SeekEntry& e : f.blocks) {
+        MemoryReader in{ file.data + e.fileOffset, file.data + e.fileOffset + e.codedSize };
+        uint64_t sequences, literals;
+        if (!readVarint(in, sequences) || !readVarint(in, literals)) continue;
+        summary.matches += sequences;
+        summary.literals += literals;
+    }
+    return true;
+}
+
+// bytes left in a header source (UINT64_MAX when a stream cannot seek)
+uint64_t bytesLeft(const MemoryReader& in) {
+    return (uint64_t)(in.end - in.cur);
+}
+
+uint64_t bytesLeft(istream& in) {
+    streampos pos = in.tellg();
+    if (pos < 0) return UINT64_MAX;
+    in.seekg(0, ios::end);
+    streampos end = in.tellg();
+    in.seekg(pos);
+    return end < pos ? UINT64_MAX : (uint64_t)(end - pos);
+}
+
+// an empty block container: a zero block count and the 8-byte index offset, no block at all
+const uint64_t EMPTY_BLOCK_INDEX_SIZE = 1 + 8;
+
+template <class Source>
+bool parseHuffHeader(Source& in, HuffHeader& h) {
+    memset(&h, 0, sizeof(h));
+    uint8_t sig[2];
+    if (!in.read(reinterpret_cast<char*>(sig), sizeof(sig))) return false;
+
+    if (sig[1] >= HUFF_FORMAT_V2) {
+        if (sig[0] != HUFF_SIGNATURE) return false;
+        if (sig[1] == HUFF_FORMAT_BLOCKS) {
+            uint64_t blockSize;
+            if (!readVarint(in, blockSize)) return false;
+            h.version = HUFF_FORMAT_BLOCKS;
+            h.totalBits = UINT64_MAX;
+            // the header is the first block's; an empty container holds 0 symbols
+            if (bytesLeft(in) == EMPTY_BLOCK_INDEX_SIZE) return true;
+            return readStreamHeader(in, h.flags, h.symbolCount, h.lens);
+        }
+        if (sig[1] == HUFF_FORMAT_ADAPTIVE) {
+            // no table and no size: both come with the stream
+            h.version = HUFF_FORMAT_ADAPTIVE;
+            h.totalBits = UINT64_MAX;
+            return true;
+        }
+        if (sig[1] == HUFF_FORMAT_AUDIO) {
+            // the sizes are in the block index at the end of the file
+            char channels, sampleBytes;
+            if (!in.get(channels) || !in.get(sampleBytes)) return false;
+            h.version = HUFF_FORMAT_AUDIO;
+            h.totalBits = UINT64_MAX;
+            h.channels = (uint8_t)channels;
+            h.sampleBytes = (uint8_t)sampleBytes;
+            return true;
+        }
+        if (sig[1] == HUFF_FORMAT_VIDEO) {
+            // plane sizes and frames are read by parseVideoFile
+            h.version = HUFF_FORMAT_VIDEO;
+            h.totalBits = UINT64_MAX;
+            return true;
+        }
+        if (sig[1] == HUFF_FORMAT_IMAGE) {
+            char kind, channels;
+            if (!in.get(kind) || !in.get(channels)) return false;
+            h.version = HUFF_FORMAT_IMAGE;
+            h.totalBits = UINT64_MAX;
+            h.imageKind = (uint8_t)kind;
+            h.channels = (uint8_t)channels;
+            return true;
+        }
+        if (sig[1] == HUFF_FORMAT_BWT || sig[1] == HUFF_FORMAT_LZ) {
+            uint64_t blockSize;
+            if (!readVarint(in, blockSize)) return false;
+            h.version = sig[1];
+            h.totalBits = UINT64_MAX;
+            return true;
+        }
+        if (sig[1] == HUFF_FORMAT_DICT) {
+            // the code lengths are the dictionary's; frames of unknown dictionaries do not parse
+            uint8_t id[4];
+            if (!in.read(reinterpret_cast<char*>(id), sizeof(id)) || !readVarint(in, h.symbolCount)) return false;
+            h.version = HUFF_FORMAT_DICT;
+            h.totalBits = UINT64_MAX;
+            h.dictId = loadLE32(id);
+            const DictionaryEntry* entry = findDictionary(h.dictId);
+            if (!entry) return false;
+            memcpy(h.lens, entry->dict.lens, sizeof(h.lens));
+            return true;
+        }
+        if (sig[1] != HUFF_FORMAT_V2) return false;
+        h.version = HUFF_FORMAT_V2;
+        h.totalBits = UINT64_MAX;
+        return readStreamHeader(in, h.flags, h.symbolCount, h.lens);
+    }
+
+    h.version = 1;
+    uint16_t uniq = (uint16_t)(sig[0] | (sig[1] << 8));
+    /*Reading header information:
+    * including number of unique symbols, their frequencies, and total bits
+    * This information is used to reconstruct the Huffman tree for decoding
+    */
+    for (int i = 0; i < uniq; i++) {
+        uint8_t s; uint64_t f;
+        if (!in.read(reinterpret_cast<char*>(&s), sizeof(s))) return false;
+        if (!in.read(reinterpret_cast<char*>(&f), sizeof(f))) return false;
+        h.freqs[s] = f;
+    }
+    h.symbolCount = UINT64_MAX;
+    return (bool)in.read(reinterpret_cast<char*>(&h.totalBits), sizeof(h.totalBits));
+}
+
+bool readHuffHeader(istream& in, HuffHeader& h) {
+    return parseHuffHeader(in, h);
+}
+
+// the tree the header describes: rebuilt from frequencies (v1) or from code lengths (v2)
+bool treeFromHeader(const HuffHeader& h, HuffmanTree& tree) {
+    if (h.version >= HUFF_FORMAT_V2) return buildTreeFromLengths(h.lens, tree);
+    uint64_t freqs[256];
+    memcpy(freqs, h.freqs, sizeof(freqs));
+    unsigned char bytesList[256];
+    int uniqueCount = 0;
+    for (int i = 0; i < 256; i++) if (freqs[i]) bytesList[uniqueCount++] = (unsigned char)i;
+    return buildHuffmanTree(bytesList, freqs, uniqueCount, tree);
+}
+
+bool decodeHuffStream(istream& in, ostream& out, bool referenceDecoder, JobProgress* job) {
+    // block containers decode block by block (there is no single tree to walk)
+    streampos start = in.tellg();
+    uint8_t sig[2];
+    if (!in.read(reinterpret_cast<char*>(sig), sizeof(sig))) return false;
+    if (sig[0] == HUFF_SIGNATURE && sig[1] == HUFF_FORMAT_BLOCKS) return decodeBlockContainer(in, out, job);
+    if (sig[0] == HUFF_SIGNATURE && sig[1] == HUFF_FORMAT_ADAPTIVE) {
+        streampos dataStart = in.tellg();
+        in.seekg(0, ios::end);
+        uint64_t availBits = 8 * (uint64_t)(in.tellg() - dataStart);
+        in.seekg(dataStart);
+        return decodeAdaptiveStream(in, out, availBits, job);
+    }
+    if (sig[0] == HUFF_SIGNATURE && (sig[1] == HUFF_FORMAT_AUDIO || sig[1] == HUFF_FORMAT_VIDEO || sig[1] == HUFF_FORMAT_IMAGE ||
+        sig[1] == HUFF_FORMAT_BWT || sig[1] == HUFF_FORMAT_LZ)) {
+        // the block index is at the end: the file is decoded from memory
+        in.seekg(0, ios::end);
+        vector<uint8_t> file((size_t)(in.tellg() - start)), raw;
+        in.seekg(start);
+        if (!in.read(reinterpret_cast<char*>(file.data()), file.size())) return false;
+        ByteSpan span{ file.data(), file.size() };
+        if (sig[1] == HUFF_FORMAT_VIDEO) {
+            VideoFile video;
+            if (!parseVideoFile(span, video)) return false;
+            raw.resize((size_t)video.rawSize());
+            if (!decodeVideoFile(span, video, raw.data(), nullptr, job)) return false;
+        }
+        else if (sig[1] == HUFF_FORMAT_IMAGE) {
+            ImageFile image;
+            if (!parseImageFile(span, image)) return false;
+            raw.resize((size_t)image.rawSize());
+            if (!decodeImageFile(span, image, raw.data(), nullptr, job)) return false;
+        }
+        else if (sig[1] == HUFF_FORMAT_BWT || sig[1] == HUFF_FORMAT_LZ) {
+            ByteBlocksFile blocks;
+            if (!parseByteBlocksFile(span, blocks)) return false;
+            raw.resize((size_t)blocks.rawSize());
+            if (!decodeByteBlocksFile(span, blocks, raw.data(), nullptr, job)) return false;
+        }
+        else {
+            AudioFile audio;
+            if (!parseAudioFile(span, audio)) return false;
+            raw.resize((size_t)audio.rawSize());
+            if (!decodeAudioFile(span, audio, raw.data(), nullptr, job)) return false;
+        }
+        out.write(reinterpret_cast<const char*>(raw.data()), raw.size());
+        return (bool)out;
+    }
+    in.seekg(start);
+
+    HuffHeader h;
+    if (!readHuffHeader(in, h)) return false;
+    if (h.symbolCount == 0) return true;
+    uint64_t rawSize = h.symbolCount;
+    if (h.version == 1) {
+        rawSize = 0;
+        for (int i = 0; i < 256; i++) rawSize += h.freqs[i];
+    }
+    jobBegin(job, JOB_DECODING, rawSize);
+    if (h.version >= HUFF_FORMAT_V2 && (h.flags & HUFF_FLAG_STORED)) return copyStored(in, out, h.symbolCount, job);
+
+    // v2 decodes straight from the code lengths, only v1 and the reference path need a tree
+    HuffmanTree tree;
+    if (h.version == 1 || referenceDecoder) {
+        if (!treeFromHeader(h, tree)) return false;
+    }
+
+    if (!referenceDecoder) {
+        DecodeTable table;
+        bool haveTable;
+        if (h.version >= HUFF_FORMAT_V2) haveTable = buildDecodeTableFromLengths(h.lens, table);
+        else {
+            unsigned char syms[256];
+            HuffCode codes[256];
+            int count = 0;
+            collectLeafCodes(tree, tree.root, syms, codes, count);
+            haveTable = buildDecodeTable(syms, codes, count, table);
+        }
+        if (haveTable) {
+            // the decode stops where a truncated file's data ends, and then fails
+            streampos dataStart = in.tellg();
+            in.seekg(0, ios::end);
+            uint64_t availBits = 8 * (uint64_t)(in.tellg() - dataStart);
+            in.seekg(dataStart);
+            return decodeWithTable(in, out, table, min(h.totalBits, availBits), rawSize, job);
+        }
+    }
+    // decoding bits into original symbols using the Huffman tree
+    if (tree.empty() && !treeFromHeader(h, tree)) return false;
+    return decodeTreeWalk(in, out, tree, h.totalBits, rawSize, job);
+}
+
+// v2 and v3 files decoded from the mapping into a preallocated output; the output must be
+// mappable (see mappableOutput)
+bool decodeMappedFile(ByteSpan file, const string& outPath, JobProgress* job = nullptr) {
+    if (file.data[1] == HUFF_FORMAT_BLOCKS) return decompressSpanParallel(file, outPath, 0, job);
+    if (file.data[1] == HUFF_FORMAT_ADAPTIVE) {
+        // the decoded size is unknown up front: a buffered file instead of a mapped one
+        ofstream out(outPath, ios::binary);
+        if (!out) return false;
+        vector<char> buf(DECODE_OUT_BUFFER);
+        size_t pending = 0;
+        jobBegin(job, JOB_DECODING, 0);
+        bool ok = decodeAdaptive(file.data + 2, file.size - 2, [&](uint8_t s) {
+            buf[pending++] = (char)s;
+            if (pending < buf.size()) return true;
+            out.write(buf.data(), pending);
+            pending = 0;
+            return jobAdvance(job, buf.size()) && (bool)out;
+        });
+        out.write(buf.data(), pending);
+        out.close();
+        return ok && (bool)out;
+    }
+    if (file.data[1] == HUFF_FORMAT_AUDIO) {
+        AudioFile audio;
+        MappedOutput out;
+        if (!parseAudioFile(file, audio) || !out.create(outPath, audio.rawSize())) return false;
+        ThreadPool pool;
+        bool ok = decodeAudioFile(file, audio, out.data(), &pool, job);
+        return out.finish(ok ? audio.rawSize() : 0) && ok;
+    }
+    if (file.data[1] == HUFF_FORMAT_VIDEO) {
+        VideoFile video;
+        MappedOutput out;
+        if (!parseVideoFile(file, video) || !out.create(outPath, video.rawSize())) return false;
+        ThreadPool pool;
+        bool ok = decodeVideoFile(file, video, out.data(), &pool, job);
+        return out.finish(ok ? video.rawSize() : 0) && ok;
+    }
+    if (file.data[1] == HUFF_FORMAT_IMAGE) {
+        ImageFile image;
+        MappedOutput out;
+        if (!parseImageFile(file, image) || !out.create(outPath, image.rawSize())) return false;
+        ThreadPool pool;
+        bool ok = decodeImageFile(file, image, out.data(), &pool, job);
+        return out.finish(ok ? image.rawSize() : 0) && ok;
+    }
+    if (file.data[1] == HUFF_FORMAT_BWT || file.data[1] == HUFF_FORMAT_LZ) {
+        ByteBlocksFile blocks;
+        MappedOutput out;
+        if (!parseByteBlocksFile(file, blocks) || !out.create(outPath, blocks.rawSize())) return false;
+        ThreadPool pool;
+        bool ok = decodeByteBlocksFile(file, blocks, out.data(), &pool, job);
+        return out.finish(ok ? blocks.rawSize() : 0) && ok;
+    }
+    MemoryReader in{ file.data, file.data + file.size };
+    HuffHeader h;
+    if (!parseHuffHeader(in, h)) return false;
+    bool stored = (h.flags & HUFF_FLAG_STORED) != 0;
+    DecodeTable table;
+    if (h.symbolCount > 0 && !stored && !buildDecodeTableFromLengths(h.lens, table)) return false;
+
+    // every symbol takes at least one bit (a byte when stored): a larger count is a corrupt
+    // or truncated file
+    size_t payload = (size_t)(in.end - in.cur);
+    if (h.symbolCount > (stored ? 1 : 8) * (uint64_t)payload) return false;
+    uint64_t capacity = h.symbolCount;
+    MappedOutput out;
+    if (!out.create(outPath, capacity)) return false;
+    int64_t n = 0;
+    bool cancelled = false;
+    jobBegin(job, JOB_DECODING, capacity);
+    if (capacity > 0) {
+        BitReader reader(in.cur, payload);
+        uint64_t bitsLeft = 8 * (uint64_t)payload;
+        // in JOB_CHUNK pieces so a job can be polled; one run otherwise
+        size_t chunk = job ? JOB_CHUNK : (size_t)capacity;
+        while ((uint64_t)n < capacity) {
+            size_t want = (size_t)min<uint64_t>(chunk, capacity - (uint64_t)n);
+            int64_t got = (int64_t)want;
+            if (stored) memcpy(out.data() + n, in.cur + n, want);
+            else got = decodeTableRun(reader, table, bitsLeft, out.data() + n, want);
+            if (got < 0) {
+                n = -1;
+                break;
+            }
+            n += got;
+            if (!jobAdvance(job, (uint64_t)got)) {
+                cancelled = true;
+                break;
+            }
+            if ((size_t)got < want) break; // bits ran out
+        }
+    }
+    bool ok = (uint64_t)n == h.symbolCount && !cancelled;
+    return out.finish(ok ? (uint64_t)n : 0) && ok;
+}
+
+// referenceDecoder = true keeps the original bit-by-bit tree walk (used to cross-check the table decoder)
+bool readCompressedAndDecode(const string& inPath, const string& outPath, bool referenceDecoder, JobProgress* job) {
+    if (!referenceDecoder) {
+        // v2/v3 files that can be mapped decode from memory (v1 starts with a symbol count,
+        // whose high byte is never 2 or more)
+        MappedInput mapped;
+        if (mappableOutput(outPath) && mapped.open(inPath)) {
+            ByteSpan file = mapped.span();
+            if (file.size >= 2 && file.data[0] == HUFF_SIGNATURE && file.data[1] >= HUFF_FORMAT_V2)
+                return decodeMappedFile(file, outPath, job);
+        }
+        // block containers decode in parallel, straight through the seek table
+        ifstream probe;
+        vector<SeekEntry> table;
+        if (openBlockContainer(inPath, probe, table)) return decompressFileParallel(inPath, outPath, 0, job);
+    }
+    ifstream in(inPath, ios::binary);
+    if (!in) return false;
+    ofstream out(outPath, ios::binary);
+    if (!out) return false;
+    bool ok = decodeHuffStream(in, out, referenceDecoder, job);
+    out.close();
+    return ok;
+}
+
+// decodes a .huff file with both decoders and checks the outputs are byte-identical
+bool decodersAgree(const string& inPath) {
+    ifstream inTree(inPath, ios::binary), inTable(inPath, ios::binary);
+    if (!inTree || !inTable) return false;
+    ostringstream outTree(ios::binary), outTable(ios::binary);
+    if (!decodeHuffStream(inTree, outTree, true)) return false;
+    if (!decodeHuffStream(inTable, outTable, false)) return false;
+    return outTree.str() == outTable.str();
+}
+
+/*
+ In-memory buffer API
+ For callers that embed the codec (RPC payloads, caches) and never touch the filesystem.
+ compress writes a v2 stream; decompress reads any format. The *Into variants work in a
+ caller-provided buffer whose exact size can be queried first, and allocate nothing.
+*/
+
+// header-writer sink over a caller buffer (the counterpart of MemoryReader)
+struct BufferWriter {
+    uint8_t* cur;
+    uint8_t* end;
+    bool overflow;
+
+    void put(char c) {
+        if (cur == end) overflow = true;
+        else *cur++ = (uint8_t)c;
+    }
+    void write(const char* p, size_t n) {
+        if ((size_t)(end - cur) < n) { overflow = true; return; }
+        if (n) memcpy(cur, p, n); // an empty input span may have no data pointer
+        cur += n;
+    }
+};
+
+// code lengths for a buffer and the exact size of its v2 encoding (stored if that is no larger)
+bool planBuffer(ByteSpan in, int maxCodeLen, uint8_t lens[256], HuffCode codes[256], bool& stored, size_t& size) {
+    uint64_t freqs[256] = { 0 };
+    countFrequencies(in.data, in.size, freqs, 1);
+    buildLengthLimitedCodes(freqs, min(max(maxCodeLen, 1), MAX_HEADER_CODE_LEN), lens);
+    if (!assignCanonicalCodes(lens, codes)) return false;
+    uint64_t coded = codedStreamSize(in.size, freqs, lens), raw = storedStreamSize(in.size);
+    stored = coded >= raw;
+    size = 2 + (size_t)(stored ? raw : coded);
+    return true;
+}
+
+size_t encodeBufferInto(ByteSpan in, const uint8_t lens[256], const HuffCode codes[256], bool stored,
+    uint8_t* out, size_t capacity) {
+    BufferWriter header{ out, out + capacity, false };
+    header.put((char)HUFF_SIGNATURE);
+    header.put((char)HUFF_FORMAT_V2);
+    if (stored) {
+        writeStoredHeader(header, in.size);
+        header.write(reinterpret_cast<const char*>(in.data), in.size);
+        return header.overflow ? 0 : (size_t)(header.cur - out);
+    }
+    writeStreamHeader(header, in.size, lens);
+    if (header.overflow) return 0;
+    size_t used = (size_t)(header.cur - out);
+    BitWriter writer(header.cur, capacity - used);
+    encodeSymbols(in.data, in.size, codes, writer);
+    size_t bytes = writer.finish();
+    return writer.overflowed() ? 0 : used + bytes;
+}
+
+// worst case: a stored stream
+size_t compressBound(size_t n) {
+    return n + BUFFER_HEADER_BOUND;
+}
+
+size_t compressedSize(ByteSpan in, int maxCodeLen) {
+    uint8_t lens[256];
+    HuffCode codes[256];
+    bool stored;
+    size_t size;
+    return planBuffer(in, maxCodeLen, lens, codes, stored, size) ? size : 0;
+}
+
+size_t compressInto(ByteSpan in, uint8_t* out, size_t capacity, int maxCodeLen) {
+    uint8_t lens[256];
+    HuffCode codes[256];
+    bool stored;
+    size_t size;
+    if (!planBuffer(in, maxCodeLen, lens, codes, stored, size) || size > capacity) return 0;
+    return encodeBufferInto(in, lens, codes, stored, out, size);
+}
+
+bool compress(ByteSpan in, vector<uint8_t>& out, int maxCodeLen) {
+    uint8_t lens[256];
+    HuffCode codes[256];
+    bool stored;
+    size_t size;
+    if (!planBuffer(in, maxCodeLen, lens, codes, stored, size)) return false;
+    out.resize(size);
+    return encodeBufferInto(in, lens, codes, stored, out.data(), size) == size;
+}
+
+// v1 data from memory: table decode, or the tree walk for trees too deep for the table
+bool decodeV1Into(MemoryReader& in, const HuffHeader& h, uint8_t* out, uint64_t rawSize) {
+    HuffmanTree tree;
+    if (!treeFromHeader(h, tree)) return false;
+    size_t payload = (size_t)(in.end - in.cur);
+    uint64_t bitsLeft = min(h.totalBits, 8 * (uint64_t)payload);
+    unsigned char syms[256];
+    HuffCode codes[256];
+    int count = 0;
+    collectLeafCodes(tree, tree.root, syms, codes, count);
+    DecodeTable table;
+    if (buildDecodeTable(syms, codes, count, table)) {
+        BitReader reader(in.cur, payload);
+        return decodeTableRun(reader, table, bitsLeft, out, (size_t)rawSize) == (int64_t)rawSize;
+    }
+    uint16_t node = tree.root;
+    uint64_t n = 0;
+    for (uint64_t bit = 0; bit < bitsLeft && n < rawSize; bit++) {
+        bool one = (in.cur[bit >> 3] >> (7 - (bit & 7))) & 1;
+        node = one ? tree[node].right : tree[node].left;
+        if (node == NO_NODE) return false;
+        if (tree.isLeaf(node)) {
+            out[n++] = tree[node].data;
+            node = tree.root;
+        }
+    }
+    return n == rawSize;
+}
+
+bool decompressedSize(ByteSpan in, uint64_t& size) {
+    MemoryReader reader{ in.data, in.data + in.size };
+    HuffHeader h;
+    if (!parseHuffHeader(reader, h)) return false;
+    if (h.version == HUFF_FORMAT_ADAPTIVE) {
+        size = 0;
+        return decodeAdaptive(in.data + 2, in.size - 2, [&size](uint8_t) { size++; return true; });
+    }
+    if (h.version == HUFF_FORMAT_AUDIO) {
+        AudioFile audio;
+        if (!parseAudioFile(in, audio)) return false;
+        size = audio.rawSize();
+        return true;
+    }
+    if (h.version == HUFF_FORMAT_VIDEO) {
+        VideoFile video;
+        if (!parseVideoFile(in, video)) return false;
+        size = video.rawSize();
+        return true;
+    }
+    if (h.version == HUFF_FORMAT_IMAGE) {
+        ImageFile image;
+        if (!parseImageFile(in, image)) return false;
+        size = image.rawSize();
+        return true;
+    }
+    if (h.version == HUFF_FORMAT_BWT || h.version == HUFF_FORMAT_LZ) {
+        ByteBlocksFile blocks;
+        if (!parseByteBlocksFile(in, blocks)) return false;
+        size = blocks.rawSize();
+        return true;
+    }
+    if (h.version == HUFF_FORMAT_BLOCKS) {
+        uint64_t dataStart, indexOffset, count;
+        if (!locateBlockIndex(in, dataStart, indexOffset)) return false;
+        size = 0;
+        return walkBlockIndex(in.data + indexOffset, (size_t)(in.size - 8 - indexOffset), dataStart, indexOffset, count,
+            [&size](const SeekEntry& e) { size += e.rawSize; return true; });
+    }
+    // every symbol takes at least one bit (a byte when stored), which bounds a corrupt count
+    uint64_t payload = (uint64_t)(reader.end - reader.cur);
+    if (h.version >= HUFF_FORMAT_V2) {
+        size = h.symbolCount;
+        if (h.flags & HUFF_FLAG_STORED) return size <= payload;
+    }
+    else {
+        size = 0;
+        for (int i = 0; i < 256; i++) size += h.freqs[i];
+    }
+    return size <= 8 * payload;
+}
+
+bool decompressInto(ByteSpan in, uint8_t* out, size_t capacity, size_t& written) {
+    written = 0;
+    if (in.size >= 2 && in.data[0] == HUFF_SIGNATURE && in.data[1] == HUFF_FORMAT_ADAPTIVE) {
+        // one pass, stopping if the output outgrows capacity
+        size_t n = 0;
+        bool ok = decodeAdaptive(in.data + 2, in.size - 2, [&](uint8_t s) {
+            if (n == capacity) return false;
+            out[n++] = s;
+            return true;
+        });
+        if (ok) written = n;
+        return ok;
+    }
+    uint64_t rawSize;
+    if (!decompressedSize(in, rawSize) || rawSize > capacity) return false;
+    MemoryReader reader{ in.data, in.data + in.size };
+    HuffHeader h;
+    if (!parseHuffHeader(reader, h)) return false;
+
+    bool ok;
+    if (h.version == HUFF_FORMAT_AUDIO) {
+        AudioFile audio;
+        ok = parseAudioFile(in, audio) && decodeAudioFile(in, audio, out, nullptr);
+    }
+    else if (h.version == HUFF_FORMAT_VIDEO) {
+        VideoFile video;
+        ok = parseVideoFile(in, video) && decodeVideoFile(in, video, out, nullptr);
+    }
+    else if (h.version == HUFF_FORMAT_IMAGE) {
+        ImageFile image;
+        ok = parseImageFile(in, image) && decodeImageFile(in, image, out, nullptr);
+    }
+    else if (h.version == HUFF_FORMAT_BWT || h.version == HUFF_FORMAT_LZ) {
+        ByteBlocksFile blocks;
+        ok = parseByteBlocksFile(in, blocks) && decodeByteBlocksFile(in, blocks, out, nullptr);
+    }
+    else if (h.version == HUFF_FORMAT_BLOCKS) {
+        uint64_t dataStart, indexOffset, count;
+        locateBlockIndex(in, dataStart, indexOffset);
+        ok = walkBlockIndex(in.data + indexOffset, (size_t)(in.size - 8 - indexOffset), dataStart, indexOffset, count,
+            [&](const SeekEntry& e) {
+                return decodeBlock(in.data + e.fileOffset, (size_t)e.codedSize, out + e.rawOffset, e.rawSize);
+            });
+    }
+    else if (h.version == HUFF_FORMAT_V2 && (h.flags & HUFF_FLAG_STORED)) {
+        if (rawSize) memcpy(out, reader.cur, (size_t)rawSize); // decompressedSize checked the payload
+        ok = true;
+    }
+    else if (h.version == HUFF_FORMAT_V2 || h.version == HUFF_FORMAT_DICT) {
+        ok = rawSize == 0;
+        // dictionary frames use the registered table, nothing is built per frame
+        DecodeTable own;
+        const DecodeTable* table = h.version == HUFF_FORMAT_DICT ? &findDictionary(h.dictId)->table : &own;
+        if (!ok && (table != &own || buildDecodeTableFromLengths(h.lens, own))) {
+            size_t payload = (size_t)(reader.end - reader.cur);
+            BitReader bits(reader.cur, payload);
+            uint64_t bitsLeft = 8 * (uint64_t)payload;
+            ok = decodeTableRun(bits, *table, bitsLeft, out, (size_t)rawSize) == (int64_t)rawSize;
+        }
+    }
+    else ok = rawSize == 0 || decodeV1Into(reader, h, out, rawSize);
+    if (ok) written = (size_t)rawSize;
+    return ok;
+}
+
+bool decompress(ByteSpan in, vector<uint8_t>& out) {
+    if (in.size >= 2 && in.data[0] == HUFF_SIGNATURE && in.data[1] == HUFF_FORMAT_ADAPTIVE) {
+        out.clear();
+        if (decodeAdaptive(in.data + 2, in.size - 2, [&out](uint8_t s) { out.push_back(s); return true; })) return true;
+        out.clear();
+        return false;
+    }
+    uint64_t rawSize;
+    if (!decompressedSize(in, rawSize) || rawSize > SIZE_MAX) return false;
+    out.resize((size_t)rawSize);
+    size_t written;
+    if (!decompressInto(in, out.data(), out.size(), written)) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+bool compressWithDictionary(ByteSpan in, const HuffDictionary& dict, vector<uint8_t>& out) {
+    const DictionaryEntry* entry = addDictionary(dict);
+    if (!entry) return false;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < in.size; i++) bits += dict.lens[in.data[i]];
+    CountingWriter header{ 2 + 4 };
+    writeVarint(header, in.size);
+    size_t size = header.n + (size_t)((bits + 7) / 8);
+    if (size >= 2 + storedStreamSize(in.size)) {
+        out.resize(2 + (size_t)storedStreamSize(in.size));
+        return encodeBufferInto(in, dict.lens, entry->codes, true, out.data(), out.size()) == out.size();
+    }
+
+    out.resize(size);
+    BufferWriter frame{ out.data(), out.data() + size, false };
+    uint8_t id[4];
+    storeLE32(id, dict.id);
+    frame.put((char)HUFF_SIGNATURE);
+    frame.put((char)HUFF_FORMAT_DICT);
+    frame.write(reinterpret_cast<const char*>(id), sizeof(id));
+    writeVarint(frame, in.size);
+    BitWriter writer(frame.cur, size - header.n);
+    encodeSymbols(in.data, in.size, entry->codes, writer);
+    return writer.finish() == size - header.n && !writer.overflowed();
+}
@@ -0,0 +1,838 @@
+﻿// huffman_core.h - Huffman compression core (no GUI dependencies)
+// Shared by the SFML application (huffman.cpp) and the command-line tool (huffman_cli.cpp).
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <queue>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+/*
+ A tree over byte symbols has at most 256 leaves and 255 internal nodes (the dummy sibling
+ of a one-symbol tree included), so all nodes live in one fixed array and children are
+ 16-bit indices into it. clear() resets the arena for the next tree: building, rebuilding
+ and dropping trees never touch the heap.
+*/
+const int MAX_TREE_NODES = 511;
+const uint16_t NO_NODE = 0xFFFF;
+
+struct FlatNode {
+    uint64_t freq;// using uint64 instead of int because frequencies can be much larger than 2 billion (max int range)
+    uint16_t left;  // NO_NODE for leaves
+    uint16_t right;
+    unsigned char data;
+};
+
+class HuffmanTree {
+    FlatNode nodes[MAX_TREE_NODES];
+    int used;
+
+public:
+    uint16_t root;
+
+    HuffmanTree() : used(0), root(NO_NODE) {}
+
+    void clear() {
+        used = 0;
+        root = NO_NODE;
+    }
+    bool empty() const { return root == NO_NODE; }
+    int size() const { return used; }
+
+    const FlatNode& operator[](uint16_t i) const { return nodes[i]; }
+    FlatNode& operator[](uint16_t i) { return nodes[i]; }
+
+    bool isLeaf(uint16_t i) const
+    {
+        return nodes[i].left == NO_NODE && nodes[i].right == NO_NODE;
+    }
+
+    // NO_NODE once the arena is full
+    uint16_t addLeaf(unsigned char data, uint64_t freq) {
+        if (used == MAX_TREE_NODES) return NO_NODE;
+        nodes[used] = FlatNode{ freq, NO_NODE, NO_NODE, data };
+        return (uint16_t)used++;
+    }
+
+    uint16_t addInternal(uint16_t l, uint16_t r) {
+        uint16_t i = addLeaf(0, nodes[l].freq + nodes[r].freq); // data = 0 for internal nodes
+        if (i != NO_NODE) {
+            nodes[i].left = l;
+            nodes[i].right = r;
+        }
+        return i;
+    }
+};
+
+
+const int MAX_HEADER_CODE_LEN = 15; // v2 stores one length per nibble
+
+struct HuffCode {
+    uint64_t bits; // code right-aligned, first bit sent is the most significant one
+    uint8_t len;
+};
+
+
+// how much the length cap costs compared to the unbounded Huffman tree
+struct LengthLimitReport {
+    int maxLen;           // cap that was applied
+    int unboundedMaxLen;  // longest code of the unbounded tree
+    uint64_t limitedBits;
+    uint64_t unboundedBits;
+
+    double overheadPercent() const {
+        return unboundedBits ? 100.0 * ((double)limitedBits - (double)unboundedBits) / (double)unboundedBits : 0.0;
+    }
+};
+
+
+// a read-only byte range (memory-mapped file, buffer)
+struct ByteSpan {
+    const uint8_t* data;
+    size_t size;
+};
+
+
+/*
+ Bit packing
+ Codes collect in a 64-bit accumulator and leave it as whole 32-bit words, so the encode
+ loop touches memory once per word instead of once per bit, and the output buffer goes to
+ the file in large writes.
+*/
+const size_t ENCODE_OUT_BUFFER = 1 << 20;
+
+class BitWriter {
+    std::ostream* out; // stream mode: the buffer is written to out whenever it fills up
+    std::vector<uint8_t>* grow; // memory and stream mode: the vector behind buf, grown as needed
+    uint8_t* buf;      // fixed mode (grow == null): the caller's buffer, never reallocated
+    size_t capacity;
+    size_t pos;
+    uint64_t acc;  // pending bits sit in the low `count` bits
+    int count;
+    bool overflow; // fixed mode ran out of room; later bytes are dropped
+
+    bool reserveBytes(size_t n) {
+        if (pos + n <= capacity) return true;
+        if (out && pos > 0) {
+            out->write(reinterpret_cast<const char*>(buf), pos);
+            pos = 0;
+            if (n <= capacity) return true;
+        }
+        if (!grow) {
+            overflow = true;
+            return false;
+        }
+        grow->resize(std::max<size_t>(capacity * 2, pos + n));
+        buf = grow->data();
+        capacity = grow->size();
+        return true;
+    }
+
+public:
+    // memory mode appends to buffer; with an output stream the buffer only stages writes
+    BitWriter(std::vector<uint8_t>& buffer, std::ostream* output = nullptr)
+        : out(output), grow(&buffer), buf(nullptr), capacity(0), pos(output ? 0 : buffer.size()), acc(0), count(0),
+        overflow(false) {
+        if (out && buffer.size() < ENCODE_OUT_BUFFER) buffer.resize(ENCODE_OUT_BUFFER);
+        buf = buffer.data();
+        capacity = buffer.size();
+    }
+
+    // fixed mode: writes into dst[0, size) and never allocates
+    BitWriter(uint8_t* dst, size_t size)
+        : out(nullptr), grow(nullptr), buf(dst), capacity(size), pos(0), acc(0), count(0), overflow(false) {
+    }
+
+    bool overflowed() const { return overflow; }
+
+    // stream mode: hands the bytes completed so far to the stream; pending bits stay
+    void flush() {
+        if (!out) return;
+        if (pos > 0) out->write(reinterpret_cast<const char*>(buf), pos);
+        pos = 0;
+        out->flush();
+    }
+
+    // len <= 32
+    void put(uint64_t bits, int len) {
+        acc = (acc << len) | bits;
+        count += len;
+        if (count >= 32) {
+            count -= 32;
+            uint32_t word = (uint32_t)(acc >> count);
+            if (!reserveBytes(4)) return;
+            buf[pos] = (uint8_t)(word >> 24);
+            buf[pos + 1] = (uint8_t)(word >> 16);
+            buf[pos + 2] = (uint8_t)(word >> 8);
+            buf[pos + 3] = (uint8_t)word;
+            pos += 4;
+        }
+    }
+
+    // any length up to 64 bits
+    void putLong(uint64_t bits, int len) {
+        if (len > 32) {
+            put(bits >> 32, len - 32);
+            len = 32;
+        }
+        put(bits & 0xFFFFFFFFULL, len);
+    }
+
+    // pads the last byte with zero bits; in memory mode the vector ends up holding exactly the output
+    size_t finish() {
+        while (count >= 8) {
+            count -= 8;
+            if (reserveBytes(1)) buf[pos++] = (uint8_t)(acc >> count);
+        }
+        if (count > 0) {
+            if (reserveBytes(1)) buf[pos++] = (uint8_t)(acc << (8 - count));
+            count = 0;
+        }
+        if (out) {
+            out->write(reinterpret_cast<const char*>(buf), pos);
+            pos = 0;
+        }
+        else if (grow) grow->resize(pos);
+        return pos;
+    }
+};
+
+
+/*
+ .huff format v2 (canonical codes, compact header)
+   1. signature 'H' + version byte 2. A v1 file starts with its 16-bit unique symbol count,
+      whose second byte is never above 1, so the two formats cannot be confused.
+   2. flags (1 byte)
+   3. number of encoded symbols (varint)
+   4. code-length table, present symbols in ascending order, lengths packed two per byte:
+        sparse layout: count - 1 (1 byte), the symbols (1 byte each), their lengths
+        bitmap layout (HUFF_FLAG_BITMAP_TABLE): 256-bit presence bitmap (32 bytes), the lengths
+   5. bit-packed canonical codes (MSB-first)
+      with HUFF_FLAG_FOUR_STREAMS (block containers only): the symbols are split into four
+      consecutive quarters, each coded as its own byte-padded bitstream, preceded by a jump
+      table holding the byte sizes of the first three (4 bytes each, little-endian)
+      with HUFF_FLAG_STORED there is no code-length table and no bitstream: the symbols follow
+      as raw bytes. Encoders store data whose coded size (header included) would not be smaller,
+      so the output never grows by more than the stream header.
+ Code lengths come from the length-limited builder, so they always fit in a nibble.
+*/
+const uint8_t HUFF_SIGNATURE = 'H';
+const uint8_t HUFF_FORMAT_V2 = 2;
+const uint8_t HUFF_FLAG_BITMAP_TABLE = 0x01;
+const uint8_t HUFF_FLAG_FOUR_STREAMS = 0x02;
+const uint8_t HUFF_FLAG_STORED = 0x08;
+const int SPARSE_TABLE_MAX_SYMBOLS = 30; // above this the 32-byte bitmap is smaller than the symbol list
+
+
+/*
+ Block container (format v3)
+ The input is cut into independent blocks, each with its own code table, so blocks can be
+ compressed and decoded on separate threads.
+   1. signature 'H' + version byte 3
+   2. nominal block size (varint)
+   3. the blocks, back to back: stream header (flags, symbol count, code lengths) + bits
+   4. block index: block count (varint), then raw size and coded size of every block (varints)
+   5. file offset of the block index (8 bytes, little-endian)
+ A block whose stream header has HUFF_FLAG_CONTEXT uses an order-1 model: every byte is coded
+ with the table of the context group its preceding byte belongs to (context 0 at the start of
+ the block and of each of its four streams). The header's table is group 0's; it is followed by
+   - group count - 1 (1 byte)
+   - the group of each of the 256 contexts, two per byte (high nibble first)
+   - for groups 1.., a table flags byte (HUFF_FLAG_BITMAP_TABLE or 0) and a length table
+ Encoders pick it per block, only when it comes out smaller than the order-0 block.
+ A block whose stream header has HUFF_FLAG_RUNS has no length table; it holds runs of repeated
+ bytes as tokens and is followed by
+   - the escape byte (1 byte) and the token count (varint)
+   - the token string, coded as a nested block (never itself a runs block)
+ Every escape byte in the tokens starts a run: the run byte, then the run length - 1 (varint).
+ All other token bytes are literals. Encoders pick it when the block has long runs and it
+ comes out smaller than the block coded directly.
+*/
+const uint8_t HUFF_FORMAT_BLOCKS = 3;
+const uint8_t HUFF_FLAG_CONTEXT = 0x04;
+const uint8_t HUFF_FLAG_RUNS = 0x10;
+const int MAX_CONTEXT_GROUPS = 16;
+const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+const size_t MIN_BLOCK_SIZE = 64 << 10;
+const size_t MAX_BLOCK_SIZE = 64 << 20;
+const size_t FOUR_STREAM_MIN_SYMBOLS = 256; // smaller blocks are not worth a jump table
+
+
+/*
+ Shared dictionaries (format v4)
+ A code table trained once on a sample corpus of one module (text, audio, video) and kept by
+ both sides, so small payloads need not carry their own table.
+ Dictionary file (.hdict):
+   1. signature 'H' + 'D'
+   2. module (1 byte, DictionaryModule)
+   3. dictionary ID (4 bytes, little-endian): FNV-1a hash of the module byte and the lengths
+   4. code-length table, bitmap layout; every byte value has a code
+ Dictionary frame:
+   1. signature 'H' + version byte 4
+   2. dictionary ID (4 bytes, little-endian)
+   3. number of encoded symbols (varint)
+   4. bit-packed canonical codes of the dictionary (MSB-first)
+ Input the dictionary would expand is written as a stored v2 stream instead.
+*/
+const uint8_t HUFF_FORMAT_DICT = 4;
+const uint8_t HUFF_DICTIONARY_FILE = 'D';
+const int MIN_DICT_CODE_LEN = 8; // 256 codes need at least 8 bits
+
+enum DictionaryModule {
+    DICT_ANY,
+    DICT_TEXT,
+    DICT_AUDIO,
+    DICT_VIDEO
+};
+
+struct HuffDictionary {
+    uint32_t id;
+    uint8_t module;
+    uint8_t lens[256];
+};
+
+
+/*
+ Adaptive Huffman (format v5)
+ One pass and no table: encoder and decoder start from the same one-leaf tree and update it
+ after every symbol (FGK), so output starts before the input length is known.
+   1. signature 'H' + version byte 5
+   2. the codes (MSB-first); a byte's first occurrence is sent as the code of the NYT ("not
+      yet transmitted") leaf followed by the byte itself in 8 bits
+   3. end marker: the NYT code followed by a byte that already has a leaf; zero padding
+ An empty input has no payload at all.
+*/
+const uint8_t HUFF_FORMAT_ADAPTIVE = 5;
+const size_t ADAPTIVE_CHUNK = 64 << 10; // the streaming encoder flushes its output after every chunk
+
+
+/*
+ PCM audio (format v6)
+ WAV files with integer PCM samples are coded as samples rather than bytes: channels are
+ split apart, each block predicts every sample from the ones before it and only the
+ prediction residuals are Huffman-coded.
+   1. signature 'H' + version byte 6
+   2. channels (1 byte), bytes per sample (1 byte: 1 = unsigned 8-bit, 2 or 3 = signed little-endian)
+   3. frames per block (varint)
+   4. the bytes before the first sample (RIFF header, fmt and other chunks), then the bytes
+      after the last whole frame (partial frame, trailing chunks): each as its length
+      (varint) and an embedded v2 stream
+   5. the blocks, back to back
+   6. block index and its offset, as in v3 (raw sizes in bytes of interleaved samples)
+ Block:
+   - mode (1 byte): AUDIO_BLOCK_STORED (the raw sample bytes follow) or the stereo mode
+     (AudioStereoMode; always AUDIO_LEFT_RIGHT unless the file has two channels)
+   - then per coded channel:
+       flags (1 byte): HUFF_FLAG_BITMAP_TABLE, AUDIO_SINGLE_CLASS
+       predictor (1 byte): fixed polynomial of order 0-4, or AUDIO_LPC | order (1-32)
+       LPC only: coefficient shift (1 byte), coefficients (2 bytes each, signed, little-endian)
+       code lengths of the residual classes (length table), or the one class (AUDIO_SINGLE_CLASS)
+       per sample: the class code, then class - 1 raw bits (MSB-first); byte-padded
+ Residuals are zigzag-mapped (0, -1, 1, -2 -> 0, 1, 2, 3); class c holds [2^(c-1), 2^c), so the
+ alphabet stays small whatever the sample width. Within a block the first `order` samples are
+ predicted by the sample before them (the first by 0), so blocks decode independently.
+*/
+const uint8_t HUFF_FORMAT_AUDIO = 6;
+const size_t AUDIO_BLOCK_FRAMES = 4096;
+const int AUDIO_MAX_CHANNELS = 8;
+const uint8_t AUDIO_BLOCK_STORED = 0x80;
+const uint8_t AUDIO_SINGLE_CLASS = 0x02;
+const uint8_t AUDIO_LPC = 0x80;
+const int AUDIO_MAX_ORDER = 32;
+
+enum AudioStereoMode {
+    AUDIO_LEFT_RIGHT,
+    AUDIO_LEFT_SIDE,  // left, left - right
+    AUDIO_SIDE_RIGHT, // left - right, right
+    AUDIO_MID_SIDE    // (left + right) >> 1, left - right
+};
+
+// where the samples of a WAV file are
+struct WavLayout {
+    uint64_t dataOffset; // first sample byte
+    uint64_t frames;     // whole frames in the data chunk, as far as the file goes
+    int channels;
+    int sampleBytes;
+};
+
+// what info reports about a v6 file
+struct AudioSummary {
+    int channels;
+    int sampleBytes;
+    uint64_t blockFrames;
+    uint64_t blocks;
+    uint64_t blocksByMode[4]; // AudioStereoMode
+    uint64_t storedBlocks;
+    uint64_t rawSize;
+};
+
+
+/*
+ Raw video (format v7)
+ YUV4MPEG2 (.y4m) files with 8-bit samples are coded plane by plane: every plane of a frame
+ is predicted from the same plane of the previous frame and/or from its own decoded
+ neighbours, and the residual bytes are coded as a v3 block, so luma and each chroma plane
+ get their own tables.
+   1. signature 'H' + version byte 7
+   2. plane count (1 byte), then the width and height of every plane (varints)
+   3. keyframe interval (varint): frames k * interval only predict within themselves, so
+      the run from one keyframe to the next decodes independently of the others
+   4. everything that is not a sample (the stream header line, every FRAME line and the
+      bytes after the last whole frame) as its length (varint) and an embedded v2 stream
+   5. the frames, back to back; per plane: prediction (1 byte, VideoPrediction), coded size
+      (varint), the residuals as a v3 block (stream header and bits)
+   6. frame index and its offset, as in v3 (raw sizes are the frames' sample bytes)
+ Residual = (sample - prediction) mod 256, row by row. The median predictor is the one of
+ JPEG-LS on the left, up and up-left neighbours; the first row predicts from the left (the
+ first sample from 0), the first column from above.
+*/
+const uint8_t HUFF_FORMAT_VIDEO = 7;
+const uint64_t VIDEO_KEYFRAME_INTERVAL = 30;
+const int VIDEO_MAX_PLANES = 4;
+
+enum VideoPrediction {
+    VIDEO_RAW,             // no prediction
+    VIDEO_SPATIAL,         // median of the neighbours in the same plane
+    VIDEO_TEMPORAL,        // the same sample in the previous frame
+    VIDEO_TEMPORAL_SPATIAL // the previous frame's sample plus the median of the neighbours' changes
+};
+
+// where the frames of a Y4M file are
+struct Y4mLayout {
+    int planes;
+    uint32_t width[VIDEO_MAX_PLANES];
+    uint32_t height[VIDEO_MAX_PLANES];
+    uint64_t frameBytes;                // samples of one frame, all planes
+    std::vector<uint64_t> frameOffsets; // first sample byte of every whole frame
+};
+
+// what info reports about a v7 file
+struct VideoSummary {
+    int planes;
+    uint32_t width[VIDEO_MAX_PLANES];
+    uint32_t height[VIDEO_MAX_PLANES];
+    uint64_t frames;
+    uint64_t keyframeInterval;
+    uint64_t planesByPrediction[4]; // VideoPrediction
+    uint64_t rawSize;
+};
+
+
+/*
+ Raster images (format v8)
+ Uncompressed BMP (8, 24 and 32-bit) and binary PGM/PPM (P5/P6, up to 8 bits per sample)
+ files are coded row by row: every row is filtered like in PNG, with the filter chosen per
+ row, and the filtered bytes are split by color channel so each channel gets its own table.
+   1. signature 'H' + version byte 8
+   2. source (1 byte, ImageKind), channels (1 byte: 1, 3 or 4), then width, height and row
+      stride (varints; BMP rows are padded to 4 bytes, so the stride can exceed width * channels)
+   3. rows per block (varint)
+   4. the bytes before the first row (file header, palette) and after the last one: each as
+      its length (varint) and an embedded v2 stream
+   5. the blocks, back to back; per block:
+      - the filter of every row (1 byte each, ImageFilter)
+      - per channel, then for the row padding if the stride has any: coded size (varint) and
+        the bytes as a v3 block (stream header and bits)
+   6. block index and its offset, as in v3 (raw sizes are whole rows, padding included)
+ Filters predict every byte from the same channel of the pixel to its left (a), the one above
+ (b) and the one above-left (c), taken as 0 outside the block: sub a, up b, average (a + b) / 2,
+ Paeth the one of a, b, c closest to a + b - c. Residual = (byte - prediction) mod 256. The
+ encoder takes the filter whose residuals have the smallest sum of magnitudes (as signed bytes).
+*/
+const uint8_t HUFF_FORMAT_IMAGE = 8;
+
+enum ImageKind {
+    IMAGE_BMP,
+    IMAGE_PNM // PGM for one channel, PPM for three
+};
+
+enum ImageFilter {
+    IMAGE_FILTER_NONE,
+    IMAGE_FILTER_SUB,
+    IMAGE_FILTER_UP,
+    IMAGE_FILTER_AVERAGE,
+    IMAGE_FILTER_PAETH
+};
+
+// where the rows of an image file are
+struct ImageLayout {
+    int kind;            // ImageKind
+    int channels;
+    uint64_t width;
+    uint64_t height;
+    uint64_t stride;     // bytes from one row to the next
+    uint64_t dataOffset; // first byte of the first row
+};
+
+// what info reports about a v8 file
+struct ImageSummary {
+    int kind;
+    int channels;
+    uint64_t width;
+    uint64_t height;
+    uint64_t blocks;
+    uint64_t rowsByFilter[5]; // ImageFilter
+    uint64_t rawSize;
+};
+
+
+/*
+ Block sorting (format v9)
+ bzip2's pipeline in front of the v3 block coder, for text: the Burrows-Wheeler transform
+ groups the bytes of a block by the context that follows them, move-to-front turns the groups
+ into small numbers, mostly zeros, and the zeros are counted in runs. Blocks are independent.
+   1. signature 'H' + version byte 9
+   2. block size (varint; every block but the last holds this many bytes)
+   3. the blocks, back to back; per block:
+      - primary index (varint): the row of the block among its sorted rotations, or 0 if the
+        block is not transformed (when the transform would not make it smaller)
+      - symbol count (varint), then the symbols as a v3 block (stream header and bits)
+   4. block index and its offset, as in v3
+ The transform sorts the suffixes of the block followed by a sentinel that sorts first and
+ keeps the byte before each one; the sentinel's own row (the primary index) is left out, so n
+ bytes transform into n. After move-to-front (0: the byte just seen) the symbols are
+   BWT_RUNA, BWT_RUNB  digits of a run of zeros of length r in bijective base 2, least
+                       significant first (RUNA adds 1, RUNB 2 times the digit's weight)
+   2-254               move-to-front values 1-253
+   BWT_ESCAPE          values 254 and 255: the next symbol is the value minus 254
+ Untransformed blocks are the bytes themselves, with the symbol count equal to the block size.
+*/
+const uint8_t HUFF_FORMAT_BWT = 9;
+const size_t BWT_BLOCK_SIZE = 900 << 10;   // bzip2's largest block
+const size_t BWT_MAX_BLOCK_SIZE = 8 << 20; // rows of the inverse transform fit 24 bits
+const uint8_t BWT_RUNA = 0;
+const uint8_t BWT_RUNB = 1;
+const uint8_t BWT_ESCAPE = 255;
+
+// what info reports about a v9 file
+struct BwtSummary {
+    uint64_t blockSize;
+    uint64_t blocks;
+    uint64_t untransformed; // blocks
+    uint64_t symbols;       // of the transformed blocks
+    uint64_t rawSize;
+};
+
+
+/*
+ Dictionary matches (format v10)
+ LZ77 in front of the v3 block coder, for logs, JSON and other inputs full of repeated strings.
+ A block is cut into sequences, each a run of literal bytes followed by a match: length bytes
+ copied from distance bytes back in the same block (less than LZ_WINDOW back; a match may
+ overlap its own output). Bytes after the last match are literals too. Blocks are independent.
+   1. signature 'H' + version byte 10
+   2. block size (varint; every block but the last holds this many bytes)
+   3. the blocks, back to back; per block:
+      - sequence count and literal count (varints)
+      - four streams, each as its coded size (varint) and a v3 block: the literal bytes, then
+        per sequence the class of its literal run length, of its match length minus
+        LZ_MIN_MATCH, and of its distance minus 1
+      - extra bits: byte count (varint), then per sequence the bits of the run length, the
+        match length and the distance, in that order (MSB first, zero-padded)
+   4. block index and its offset, as in v3
+ A value's class is its bit length (0 for 0); classes above 1 are followed by the class - 1
+ bits below the leading one, as the audio residuals are. So literals, lengths and distances
+ each get their own table. A block the matches do not shrink is all literals.
+*/
+const uint8_t HUFF_FORMAT_LZ = 10;
+const size_t LZ_MIN_MATCH = 4;
+const size_t LZ_WINDOW = 1 << 20;
+const int LZ_DEFAULT_LEVEL = 6; // levels 1 (fastest, greedy) to 9 (deepest search)
+const int LZ_MAX_LEVEL = 9;
+
+// what info reports about a v10 file
+struct LzSummary {
+    uint64_t blockSize;
+    uint64_t blocks;
+    uint64_t matches;
+    uint64_t literals;
+    uint64_t rawSize;
+};
+
+// fixed set of worker threads fed from one job queue
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+
+public:
+    // threads <= 0: one worker per hardware thread
+    ThreadPool(int threads = 0) : stopping(false) {
+        if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+        for (int i = 0; i < threads; i++) workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    }
+
+    int size() const { return (int)workers.size(); }
+
+    template <class Job>
+    std::future<void> submit(Job job) {
+        std::shared_ptr<std::packaged_task<void()>> task = std::make_shared<std::packaged_task<void()>>(job);
+        std::future<void> done = task->get_future();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            jobs.push([task] { (*task)(); });
+        }
+        wake.notify_one();
+        return done;
+    }
+};
+
+struct BlockInfo {
+    uint64_t rawSize;
+    uint64_t codedSize;
+};
+
+
+// seek table of a v3 file: where every block starts in the original data and in the file
+// (each block starts with its own stream header, i.e. the code table in effect for it)
+struct SeekEntry {
+    uint64_t rawOffset;
+    uint64_t fileOffset;
+    uint64_t rawSize;
+    uint64_t codedSize;
+};
+
+
+// parsed .huff header: v1 carries symbol frequencies, v2 only canonical code lengths
+// (for a v3 container: the code lengths of its first block, for v4: the dictionary's)
+struct HuffHeader {
+    int version;
+    uint8_t flags;
+    uint64_t freqs[256]; // v1
+    uint8_t lens[256];   // v2
+    uint64_t symbolCount; // v2 (v1 decodes until totalBits)
+    uint64_t totalBits;   // v1
+    uint32_t dictId;      // v4 (lens are the dictionary's)
+    uint8_t channels;     // v6, v8
+    uint8_t imageKind;    // v8
+    uint8_t sampleBytes;  // v6
+};
+
+
+/*
+ Progress and cancellation of long jobs
+ The worker thread stores, the UI thread loads: plain atomics, no locks. Every phase restarts
+ the byte counter (total is 0 when unknown, e.g. for pipes). Jobs poll cancel between chunks
+ of at most JOB_CHUNK bytes (or one block), so a cancelled job returns false within a few
+ milliseconds; its output is incomplete and left to the caller to delete.
+*/
+enum JobPhase {
+    JOB_STARTING,
+    JOB_COUNTING, // frequency pass
+    JOB_ENCODING,
+    JOB_DECODING,
+    JOB_TESTING,  // efficiency measurements (done/total count tests, not bytes)
+    JOB_DONE
+};
+
+const size_t JOB_CHUNK = 4 << 20;
+
+struct JobProgress {
+    std::atomic<int> phase;
+    std::atomic<uint64_t> done;
+    std::atomic<uint64_t> total;
+    std::atomic<bool> cancel;
+
+    JobProgress() : phase(JOB_STARTING), done(0), total(0), cancel(false) {}
+
+    void begin(JobPhase p, uint64_t totalBytes) {
+        done.store(0, std::memory_order_relaxed);
+        total.store(totalBytes, std::memory_order_relaxed);
+        phase.store(p, std::memory_order_release);
+    }
+    // counts processed bytes; false once the job is cancelled
+    bool advance(uint64_t bytes) {
+        done.fetch_add(bytes, std::memory_order_relaxed);
+        return !cancel.load(std::memory_order_relaxed);
+    }
+    bool cancelled() const { return cancel.load(std::memory_order_relaxed); }
+};
+
+// the core takes an optional job: null means no reporting and no cancellation
+inline void jobBegin(JobProgress* job, JobPhase phase, uint64_t totalBytes) {
+    if (job) job->begin(phase, totalBytes);
+}
+inline bool jobAdvance(JobProgress* job, uint64_t bytes) {
+    return !job || job->advance(bytes);
+}
+inline bool jobCancelled(const JobProgress* job) {
+    return job && job->cancelled();
+}
+
+
+/*
+ Core API
+ Frequencies are 256-entry histograms; maxCodeLen is clamped to MAX_HEADER_CODE_LEN by the
+ v2/v3 writers. All functions report failure through their return value.
+*/
+
+// threads <= 0: one per hardware thread (inputs below 8 MB are counted on the calling thread)
+void countFrequencies(const uint8_t* data, size_t n, uint64_t freqs[256], int threads = 0);
+bool buildHuffmanTree(unsigned char bytes[], uint64_t freqs[], int uniqueCount, HuffmanTree& tree);
+bool storeCodesTable(const HuffmanTree& tree, uint16_t node, HuffCode codes[256], uint64_t bits = 0, int depth = 0);
+void computeCodeLengths(const HuffmanTree& tree, uint16_t node, const uint64_t freqs[256], uint8_t lens[256], int depth = 0);
+
+// canonical, length-limited codes (package-merge); returns the longest assigned length
+int buildLengthLimitedCodes(const uint64_t freqs[256], int maxLen, uint8_t lens[256]);
+uint64_t encodedBitCount(const uint64_t freqs[256], const uint8_t lens[256]);
+LengthLimitReport compareLengthLimit(const HuffmanTree& tree, const uint64_t freqs[256], int maxLen);
+bool assignCanonicalCodes(const uint8_t lens[256], HuffCode codes[256]);
+bool buildTreeFromLengths(const uint8_t lens[256], HuffmanTree& tree);
+
+void encodeSymbols(const unsigned char* data, size_t n, const HuffCode codes[256], BitWriter& writer);
+
+// v1 files (the original format): symbol/frequency table, then the codes of the frequency-built
+// tree (storeCodesTable) for the symbols marked in bytesPresent
+void writeCompressedText(ByteSpan text, const std::string& outPath, const HuffCode codes[256],
+    unsigned char bytesPresent[256], uint64_t freqs[256]);
+
+// single-stream v2 files
+bool writeCompressedTextV2(ByteSpan text, const std::string& outPath, uint64_t freqs[256],
+    int maxCodeLen = MAX_HEADER_CODE_LEN, JobProgress* job = nullptr);
+bool compressFileStreaming(const std::string& inPath, const std::string& outPath, uint64_t freqs[256],
+    uint64_t& origBytes, int maxCodeLen = MAX_HEADER_CODE_LEN, JobProgress* job = nullptr);
+
+// adaptive v5 streams: input of any length (pipes included) is read and written in
+// ADAPTIVE_CHUNK pieces, so nothing waits for the end of the input
+bool compressStreamAdaptive(std::istream& in, std::ostream& out, JobProgress* job = nullptr);
+bool compressAdaptive(ByteSpan in, std::vector<uint8_t>& out);
+
+// PCM audio v6: false (and nothing written) if the input is not a PCM WAV file. The file
+// version handles a batch of blocks per round like compressFileBlocks; freqs/origBytes
+// receive the byte histogram and size of the input for the caller.
+bool parseWav(ByteSpan file, WavLayout& wav);
+bool isPcmWavFile(const std::string& path);
+bool compressAudio(ByteSpan in, std::vector<uint8_t>& out, ThreadPool& pool);
+bool compressFileAudio(const std::string& inPath, const std::string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    int threads = 0, JobProgress* job = nullptr);
+bool summarizeAudio(ByteSpan file, AudioSummary& summary);
+
+// raw video v7: false (and nothing written) unless the input is an 8-bit Y4M file with at
+// least one whole frame; otherwise like the audio functions, with one frame per job
+bool parseY4m(ByteSpan file, Y4mLayout& y4m);
+bool isY4mFile(const std::string& path);
+bool compressVideo(ByteSpan in, std::vector<uint8_t>& out, ThreadPool& pool);
+bool compressFileVideo(const std::string& inPath, const std::string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    int threads = 0, JobProgress* job = nullptr);
+bool summarizeVideo(ByteSpan file, VideoSummary& summary);
+
+// raster images v8: false (and nothing written) if the input is not an uncompressed BMP or a
+// binary PGM/PPM file; otherwise like the audio functions
+bool parseImage(ByteSpan file, ImageLayout& image);
+bool isImageFile(const std::string& path);
+bool compressImage(ByteSpan in, std::vector<uint8_t>& out, ThreadPool& pool);
+bool compressFileImage(const std::string& inPath, const std::string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    int threads = 0, JobProgress* job = nullptr);
+bool summarizeImage(ByteSpan file, ImageSummary& summary);
+
+// block sorting v9 for text: any input; blocks are sorted on the pool. The file version
+// handles a batch of blocks per round like compressFileBlocks. blockSize is clamped to
+// [MIN_BLOCK_SIZE, BWT_MAX_BLOCK_SIZE].
+void compressBwt(ByteSpan in, std::vector<uint8_t>& out, ThreadPool& pool, size_t blockSize = BWT_BLOCK_SIZE);
+bool compressFileBwt(const std::string& inPath, const std::string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    size_t blockSize = BWT_BLOCK_SIZE, int threads = 0, JobProgress* job = nullptr);
+bool summarizeBwt(ByteSpan file, BwtSummary& summary);
+
+// dictionary matches v10: like block sorting, at a speed level from 1 to LZ_MAX_LEVEL
+// (clamped); blockSize is clamped to [MIN_BLOCK_SIZE, MAX_BLOCK_SIZE]
+void compressLz(ByteSpan in, std::vector<uint8_t>& out, ThreadPool& pool, int level = LZ_DEFAULT_LEVEL,
+    size_t blockSize = DEFAULT_BLOCK_SIZE);
+bool compressFileLz(const std::string& inPath, const std::string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    int level = LZ_DEFAULT_LEVEL, size_t blockSize = DEFAULT_BLOCK_SIZE, int threads = 0, JobProgress* job = nullptr);
+bool summarizeLz(ByteSpan file, LzSummary& summary);
+
+// v3 block containers
+void encodeBlock(const uint8_t* data, size_t n, std::vector<uint8_t>& out, int maxCodeLen, uint64_t freqs[256],
+    bool fourStreams = true);
+bool decodeBlock(const uint8_t* data, size_t size, uint8_t* out, uint64_t rawSize);
+void compressBlocks(const uint8_t* data, size_t n, std::vector<uint8_t>& out, ThreadPool& pool,
+    size_t blockSize = DEFAULT_BLOCK_SIZE, int maxCodeLen = MAX_HEADER_CODE_LEN, bool fourStreams = true);
+bool compressFileBlocks(const std::string& inPath, const std::string& outPath, uint64_t freqs[256], uint64_t& origBytes,
+    size_t blockSize = DEFAULT_BLOCK_SIZE, int threads = 0, int maxCodeLen = MAX_HEADER_CODE_LEN,
+    bool fourStreams = true, JobProgress* job = nullptr);
+// the same container from a stream (a pipe): head holds bytes already taken from in, the
+// index offset is counted rather than asked of out, so out need not seek
+bool compressStreamBlocks(std::istream& in, std::ostream& out, ByteSpan head = ByteSpan{ nullptr, 0 },
+    size_t blockSize = DEFAULT_BLOCK_SIZE, int threads = 0, int maxCodeLen = MAX_HEADER_CODE_LEN);
+bool openBlockContainer(const std::string& inPath, std::ifstream& in, std::vector<SeekEntry>& table);
+bool decompressFileParallel(const std::string& inPath, const std::string& outPath, int threads = 0,
+    JobProgress* job = nullptr);
+bool decompressRange(const std::string& inPath, uint64_t offset, uint64_t length, std::vector<uint8_t>& out);
+// any format, whole file in memory; v3 is written one block at a time
+bool decompressToStream(ByteSpan in, std::ostream& out);
+
+// any format (v1, v2, v3, v4 frames whose dictionary is registered, v5-v10)
+bool readHuffHeader(std::istream& in, HuffHeader& h);
+bool treeFromHeader(const HuffHeader& h, HuffmanTree& tree);
+bool decodeHuffStream(std::istream& in, std::ostream& out, bool referenceDecoder, JobProgress* job = nullptr);
+bool readCompressedAndDecode(const std::string& inPath, const std::string& outPath, bool referenceDecoder = false,
+    JobProgress* job = nullptr);
+bool decodersAgree(const std::string& inPath);
+
+// buffer API: compress produces a v2 stream, decompress accepts v1-v10. Nothing touches
+// the filesystem; the *Into variants write into the caller's buffer and never allocate.
+// Size queries are exact, compressBound is a cheap upper limit (incompressible data is stored).
+const size_t BUFFER_HEADER_BOUND = 2 + 1 + 10; // signature, flags, count of a stored stream
+
+size_t compressBound(size_t n);
+size_t compressedSize(ByteSpan in, int maxCodeLen = MAX_HEADER_CODE_LEN);
+// bytes written, 0 if out is smaller than compressedSize(in)
+size_t compressInto(ByteSpan in, uint8_t* out, size_t capacity, int maxCodeLen = MAX_HEADER_CODE_LEN);
+bool compress(ByteSpan in, std::vector<uint8_t>& out, int maxCodeLen = MAX_HEADER_CODE_LEN);
+// adaptive streams do not record their size: this decodes them
+bool decompressedSize(ByteSpan in, uint64_t& size);
+// false on corrupt or truncated input, or if capacity is below decompressedSize(in)
+bool decompressInto(ByteSpan in, uint8_t* out, size_t capacity, size_t& written);
+bool decompress(ByteSpan in, std::vector<uint8_t>& out);
+
+// dictionaries: training, .hdict files, and a process-wide registry that keeps the code and
+// decode tables of every registered dictionary, so frames neither carry nor build a table.
+// loadDictionary registers what it reads; decoders find frames' dictionaries by ID.
+const char* dictionaryModuleName(uint8_t module);
+bool parseDictionaryModule(const std::string& name, uint8_t& module);
+void trainDictionary(const std::vector<ByteSpan>& samples, uint8_t module, int maxCodeLen, HuffDictionary& dict);
+bool saveDictionary(const std::string& path, const HuffDictionary& dict);
+bool loadDictionary(const std::string& path, HuffDictionary& dict);
+bool registerDictionary(const HuffDictionary& dict);
+bool haveDictionary(uint32_t id);
+// a v4 frame, or a stored v2 stream when the dictionary would expand the input
+bool compressWithDictionary(ByteSpan in, const HuffDictionary& dict, std::vector<uint8_t>& out);
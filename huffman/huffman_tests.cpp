@@ -0,0 +1,645 @@
+﻿// huffman_tests.cpp - regression tests for the Huffman core (run by ctest)
+// Build: C++17, links huffman_core (see CMakeLists.txt).
+//
+//   huffman_tests <sample directory>
+//
+// The sample directory holds output.huff and random.txt (the sources' huffman/ directory).
+// Every check prints what failed; the exit code is the number of failed checks.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <cmath>
+#include <cstring>
+
+#include "huffman_core.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (ok) return;
+    cerr << "FAILED: " << what << "\n";
+    failures++;
+}
+
+static vector<uint8_t> textData(size_t n) {
+    static const char* words[] = { "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "a ", "lazy ", "dog\n" };
+    mt19937 rng(1);
+    vector<uint8_t> data;
+    while (data.size() < n) for (const char* c = words[rng() % 9]; *c; c++) data.push_back((uint8_t)*c);
+    data.resize(n);
+    return data;
+}
+
+static vector<uint8_t> randomData(size_t n) {
+    mt19937 rng(2);
+    vector<uint8_t> data(n);
+    for (uint8_t& b : data) b = (uint8_t)rng();
+    return data;
+}
+
+// independent bytes with a skewed distribution: compressible, but with nothing for order-1 to find
+static vector<uint8_t> skewedData(size_t n) {
+    mt19937 rng(5);
+    geometric_distribution<int> dist(0.15);
+    vector<uint8_t> data(n);
+    for (uint8_t& b : data) b = (uint8_t)min(dist(rng), 255);
+    return data;
+}
+
+static string tempPath(const string& name) {
+    return (filesystem::temp_directory_path() / ("huffman_tests_" + name)).string();
+}
+
+static void writeFile(const string& path, const vector<uint8_t>& data) {
+    ofstream out(path, ios::binary);
+    out.write(reinterpret_cast<const char*>(data.data()), (streamsize)data.size());
+}
+
+static bool readFile(const string& path, vector<uint8_t>& data) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
+
+static bool streamDecode(const vector<uint8_t>& file, string& decoded) {
+    istringstream in(string(file.begin(), file.end()));
+    ostringstream out;
+    bool ok = decodeHuffStream(in, out, false);
+    decoded = out.str();
+    return ok;
+}
+
+// v2 streams record their symbol count: a cut file must not decode to its prefix
+static void testTruncatedStreams() {
+    const vector<uint8_t> inputs[] = { textData(100000), randomData(100000) };
+    for (const vector<uint8_t>& data : inputs) {
+        vector<uint8_t> file, back;
+        check(compress(ByteSpan{ data.data(), data.size() }, file), "compress");
+        string decoded;
+        check(streamDecode(file, decoded) && decoded == string(data.begin(), data.end()), "stream round trip");
+        vector<uint8_t> cut(file.begin(), file.begin() + file.size() / 2);
+        check(!streamDecode(cut, decoded), "truncated v2 stream rejected by decodeHuffStream");
+        check(!decompress(ByteSpan{ cut.data(), cut.size() }, back), "truncated v2 stream rejected by decompress");
+        // the file path decodes from a mapping
+        string cutPath = tempPath("cut.huff"), outPath = tempPath("cut.out");
+        writeFile(cutPath, cut);
+        check(!readCompressedAndDecode(cutPath, outPath), "truncated v2 file rejected by readCompressedAndDecode");
+        filesystem::remove(cutPath);
+        filesystem::remove(outPath);
+    }
+}
+
+// empty input: a v2 stream from compress, an empty block container from compressBlocks
+static void testEmptyInput() {
+    vector<uint8_t> file, back(1);
+    check(compress(ByteSpan{ nullptr, 0 }, file), "compress empty input");
+    check(decompress(ByteSpan{ file.data(), file.size() }, back) && back.empty(), "empty v2 round trip");
+
+    ThreadPool pool(1);
+    compressBlocks(nullptr, 0, file, pool);
+    uint64_t size = 1;
+    check(decompressedSize(ByteSpan{ file.data(), file.size() }, size) && size == 0, "empty container size");
+    back.assign(1, 0);
+    check(decompress(ByteSpan{ file.data(), file.size() }, back) && back.empty(), "empty container round trip");
+}
+
+// decodes a file with the table decoder and with the tree walk
+static bool decodeBothWays(const string& path, string& table, string& tree) {
+    ifstream inTable(path, ios::binary), inTree(path, ios::binary);
+    ostringstream outTable(ios::binary), outTree(ios::binary);
+    bool ok = inTable && inTree && decodeHuffStream(inTable, outTable, false) && decodeHuffStream(inTree, outTree, true);
+    table = outTable.str();
+    tree = outTree.str();
+    return ok;
+}
+
+// the table decoder against the reference tree walk: the v1 sample, and v2 and v3 files of its text
+static void testDecodersAgree(const string& samples) {
+    string samplePath = samples + "/output.huff";
+    vector<uint8_t> text;
+    check(readFile(samples + "/random.txt", text), "read random.txt");
+    string table, tree;
+    check(decodeBothWays(samplePath, table, tree), "decode output.huff both ways");
+    check(table == tree, "decoders agree on output.huff");
+    // the sample was compressed on Windows: random.txt with CRLF line ends
+    string lf;
+    for (char c : table) if (c != '\r') lf += c;
+    check(lf == string(text.begin(), text.end()), "output.huff decodes to random.txt");
+    check(decodersAgree(samplePath), "decodersAgree(output.huff)");
+
+    vector<uint8_t> v2, v3;
+    check(compress(ByteSpan{ text.data(), text.size() }, v2), "compress sample text");
+    ThreadPool pool(2);
+    compressBlocks(text.data(), text.size(), v3, pool, MIN_BLOCK_SIZE / 16);
+    const vector<uint8_t>* files[] = { &v2, &v3 };
+    for (const vector<uint8_t>* file : files) {
+        string path = tempPath("agree.huff");
+        writeFile(path, *file);
+        check(decodeBothWays(path, table, tree) && table == tree && table == string(text.begin(), text.end()),
+            "decoders agree on a v" + to_string((*file)[1]) + " file");
+        filesystem::remove(path);
+    }
+}
+
+// lengths within maxLen that satisfy Kraft (canonical codes can be assigned)
+static void checkLengths(const uint64_t freqs[256], int maxLen, const string& what) {
+    uint8_t lens[256];
+    int used = buildLengthLimitedCodes(freqs, maxLen, lens);
+    int longest = 0;
+    uint64_t kraft = 0; // in units of 2^-maxLen
+    for (int i = 0; i < 256; i++) {
+        longest = max<int>(longest, lens[i]);
+        if (lens[i]) kraft += (uint64_t)1 << (maxLen - min<int>(lens[i], maxLen));
+        check((freqs[i] > 0) == (lens[i] > 0), what + ": a length for every symbol that occurs");
+    }
+    check(used <= maxLen && longest <= maxLen, what + ": no length above " + to_string(maxLen));
+    check(kraft <= ((uint64_t)1 << maxLen), what + ": Kraft inequality");
+    HuffCode codes[256];
+    check(assignCanonicalCodes(lens, codes), what + ": canonical codes");
+}
+
+// v2 round trip at maxCodeLen; the header's code lengths stay within the limit
+static void checkLimitedRoundTrip(const vector<uint8_t>& data, int maxLen, const string& what) {
+    vector<uint8_t> file, back;
+    check(compress(ByteSpan{ data.data(), data.size() }, file, maxLen), what + ": compress");
+    check(decompress(ByteSpan{ file.data(), file.size() }, back) && back == data, what + ": round trip");
+    istringstream in(string(file.begin(), file.end()));
+    HuffHeader h;
+    check(readHuffHeader(in, h), what + ": header");
+    for (int i = 0; i < 256; i++) check(h.lens[i] <= maxLen, what + ": header length within the limit");
+}
+
+// package-merge on Fibonacci frequencies, whose unlimited Huffman code is as deep as possible
+static void testLengthLimits() {
+    uint64_t fib[256] = { 0 };
+    fib[0] = fib[1] = 1;
+    for (int i = 2; i < 40; i++) fib[i] = fib[i - 1] + fib[i - 2];
+    vector<uint8_t> fibData; // symbols 0..22 with Fibonacci counts: a 22-bit deep unlimited code
+    for (int i = 0; i < 23; i++) fibData.insert(fibData.end(), (size_t)fib[i], (uint8_t)i);
+    shuffle(fibData.begin(), fibData.end(), mt19937(3));
+
+    uint64_t single[256] = { 0 };
+    single['a'] = 1000;
+    vector<uint8_t> singleData(1000, 'a');
+    uint64_t all[256];
+    for (int i = 0; i < 256; i++) all[i] = i < 40 ? fib[i] : 1;
+    vector<uint8_t> allData;
+    for (int i = 0; i < 256; i++) allData.insert(allData.end(), i < 24 ? (size_t)fib[i] : 1, (uint8_t)i);
+    shuffle(allData.begin(), allData.end(), mt19937(4));
+
+    for (int maxLen : { 11, 12, 15 }) {
+        string limit = " at max length " + to_string(maxLen);
+        checkLengths(fib, maxLen, "Fibonacci frequencies" + limit);
+        checkLengths(single, maxLen, "one symbol" + limit);
+        checkLengths(all, maxLen, "256 symbols" + limit);
+        checkLimitedRoundTrip(fibData, maxLen, "Fibonacci data" + limit);
+        checkLimitedRoundTrip(singleData, maxLen, "one-symbol data" + limit);
+        checkLimitedRoundTrip(allData, maxLen, "256-symbol data" + limit);
+    }
+}
+
+// the v1 writer reproduces the sample from its decoded text
+static void testV1Writer(const string& samples) {
+    vector<uint8_t> sample, raw;
+    check(readFile(samples + "/output.huff", sample), "read output.huff");
+    check(decompress(ByteSpan{ sample.data(), sample.size() }, raw), "decode output.huff");
+
+    uint64_t freqs[256] = { 0 };
+    countFrequencies(raw.data(), raw.size(), freqs, 1);
+    unsigned char bytesList[256], bytesPresent[256] = { 0 };
+    int uniqueCount = 0;
+    for (int i = 0; i < 256; i++) {
+        if (!freqs[i]) continue;
+        bytesList[uniqueCount++] = (unsigned char)i;
+        bytesPresent[i] = 1;
+    }
+    HuffmanTree tree;
+    HuffCode codes[256] = {};
+    check(buildHuffmanTree(bytesList, freqs, uniqueCount, tree) && storeCodesTable(tree, tree.root, codes),
+        "v1 tree of the sample text");
+    string path = tempPath("v1.huff");
+    writeCompressedText(ByteSpan{ raw.data(), raw.size() }, path, codes, bytesPresent, freqs);
+    vector<uint8_t> written;
+    check(readFile(path, written) && written == sample, "v1 writer reproduces output.huff byte for byte");
+    filesystem::remove(path);
+}
+
+// parallel decode and decompressRange over a container of several blocks
+static void testRandomAccess() {
+    const size_t blockSize = MIN_BLOCK_SIZE;
+    vector<uint8_t> data = textData(5 * blockSize + 1234), file;
+    ThreadPool pool(4);
+    compressBlocks(data.data(), data.size(), file, pool, blockSize);
+    string path = tempPath("range.huff"), outPath = tempPath("range.out");
+    writeFile(path, file);
+
+    vector<uint8_t> whole;
+    check(decompressFileParallel(path, outPath, 4) && readFile(outPath, whole) && whole == data, "parallel decode");
+    filesystem::remove(outPath);
+
+    const uint64_t n = data.size(), b = blockSize;
+    struct Range { uint64_t offset, length; };
+    const Range ranges[] = {
+        { 0, 0 }, { 0, 1 }, { 0, n }, { b - 10, 20 }, { b - 1, b + 2 }, { b, b }, { 2 * b + 5, 3 * b },
+        { n - 100, 100 }, { n - 1, 1 }, { n / 2, 0 }, // within the data, up to EOF exactly
+        { n - 10, 100 }, { n, 0 }, { n, 5 },           // clipped at EOF
+    };
+    for (const Range& r : ranges) {
+        vector<uint8_t> part;
+        string what = "range " + to_string(r.offset) + "+" + to_string(r.length);
+        uint64_t end = min(n, r.offset + r.length);
+        check(decompressRange(path, r.offset, r.length, part), what + " decodes");
+        check(part == vector<uint8_t>(data.begin() + (size_t)r.offset, data.begin() + (size_t)end), what + " matches the full decode");
+    }
+    vector<uint8_t> part;
+    check(!decompressRange(path, n + 1, 5, part), "range starting past EOF rejected");
+    check(decompressRange(path, n + 1, 0, part) && part.empty(), "empty range past EOF");
+    filesystem::remove(path);
+}
+
+// the flags byte encodeBlock chose for data; the block must decode back to data
+static uint8_t blockFlags(const vector<uint8_t>& data, const string& what, bool fourStreams = true) {
+    vector<uint8_t> coded, back(data.size() + 1);
+    uint64_t freqs[256];
+    encodeBlock(data.data(), data.size(), coded, MAX_HEADER_CODE_LEN, freqs, fourStreams);
+    check(decodeBlock(coded.data(), coded.size(), back.data(), data.size()) &&
+        equal(data.begin(), data.end(), back.begin()), what + ": block round trip");
+    return coded.empty() ? 0 : coded[0];
+}
+
+// blocks of FOUR_STREAM_MIN_SYMBOLS or more are split into four interleaved streams
+static void testFourStreams() {
+    for (size_t n : { (size_t)100000, (size_t)100001, (size_t)100003, FOUR_STREAM_MIN_SYMBOLS, FOUR_STREAM_MIN_SYMBOLS + 1 }) {
+        string what = "skewed block of " + to_string(n);
+        check((blockFlags(skewedData(n), what) & HUFF_FLAG_FOUR_STREAMS) != 0, what + " uses four streams");
+        check((blockFlags(skewedData(n), what, false) & HUFF_FLAG_FOUR_STREAMS) == 0, what + " keeps one stream when asked");
+    }
+    string what = "skewed block of " + to_string(FOUR_STREAM_MIN_SYMBOLS - 1);
+    check((blockFlags(skewedData(FOUR_STREAM_MIN_SYMBOLS - 1), what) & HUFF_FLAG_FOUR_STREAMS) == 0, what + " keeps one stream");
+}
+
+// text, where each byte says a lot about the next, picks the order-1 model; bytes drawn
+// independently do not
+static void testContextBlocks() {
+    for (size_t n : { (size_t)4096, (size_t)100000, DEFAULT_BLOCK_SIZE }) {
+        string what = "text block of " + to_string(n);
+        check((blockFlags(textData(n), what) & HUFF_FLAG_CONTEXT) != 0, what + " uses the context model");
+    }
+    check((blockFlags(skewedData(100000), "skewed block") & HUFF_FLAG_CONTEXT) == 0, "skewed block keeps order-0 codes");
+
+    vector<uint8_t> text = textData(3 * DEFAULT_BLOCK_SIZE + 777), packed, back;
+    ThreadPool pool(2);
+    compressBlocks(text.data(), text.size(), packed, pool);
+    check(decompress(ByteSpan{ packed.data(), packed.size() }, back) && back == text, "context container round trip");
+}
+
+// incompressible data is stored, in v2 streams and in blocks, and never grows past the header
+static void testStoredData() {
+    for (size_t n : { (size_t)1, (size_t)300, (size_t)100000 }) {
+        string what = "random stream of " + to_string(n);
+        vector<uint8_t> data = randomData(n), packed, back;
+        check(compress(ByteSpan{ data.data(), data.size() }, packed) && packed.size() >= 3 &&
+            (packed[2] & HUFF_FLAG_STORED) != 0, what + " is stored");
+        check(packed.size() <= compressBound(n), what + " stays within compressBound");
+        check(decompress(ByteSpan{ packed.data(), packed.size() }, back) && back == data, what + ": round trip");
+    }
+    check((blockFlags(randomData(100000), "random block") & HUFF_FLAG_STORED) != 0, "random block is stored");
+    check((blockFlags(textData(100000), "text block") & HUFF_FLAG_STORED) == 0, "text block is coded");
+
+    vector<uint8_t> data = randomData(2 * DEFAULT_BLOCK_SIZE + 5), packed, back;
+    ThreadPool pool(2);
+    compressBlocks(data.data(), data.size(), packed, pool);
+    check(packed.size() < data.size() + 64, "stored container adds only headers");
+    check(decompress(ByteSpan{ packed.data(), packed.size() }, back) && back == data, "stored container round trip");
+}
+
+// the inputs every format is checked with
+static vector<pair<string, vector<uint8_t>>> formatInputs() {
+    return { { "empty", {} }, { "one byte", { 'x' } }, { "all-same", vector<uint8_t>(100000, 'a') },
+        { "random", randomData(100000) }, { "text", textData(300000) } };
+}
+
+// round trips every input through pack and decompress (text must come out as format version),
+// and checks that decompress rejects each output cut in half or missing its last byte (unless
+// the cut is what pack makes of empty input: a v5 signature alone is a valid empty stream)
+template <class Pack>
+static void checkFormat(const string& name, uint8_t version, Pack pack) {
+    vector<uint8_t> empty;
+    pack(ByteSpan{ nullptr, 0 }, empty);
+    for (const auto& input : formatInputs()) {
+        string what = name + " " + input.first;
+        vector<uint8_t> packed, back;
+        if (!pack(ByteSpan{ input.second.data(), input.second.size() }, packed)) {
+            check(false, what + ": compress");
+            continue;
+        }
+        if (input.first == "text") check(packed.size() >= 2 && packed[1] == version, what + " is format " + to_string(version));
+        check(decompress(ByteSpan{ packed.data(), packed.size() }, back) && back == input.second, what + ": round trip");
+        for (size_t cut : { packed.size() / 2, packed.size() - 1 }) {
+            if (cut >= packed.size() || equal(empty.begin(), empty.end(), packed.begin(), packed.begin() + cut)) continue;
+            check(!decompress(ByteSpan{ packed.data(), cut }, back),
+                what + ": cut to " + to_string(cut) + " of " + to_string(packed.size()) + " bytes rejected");
+        }
+    }
+}
+
+// v4 frames code with a trained table that is not in the file; decoding needs it registered
+static void testDictionaryFrames() {
+    vector<uint8_t> sample = textData(50000);
+    HuffDictionary dict;
+    trainDictionary({ ByteSpan{ sample.data(), sample.size() } }, DICT_TEXT, MAX_HEADER_CODE_LEN, dict);
+    check(registerDictionary(dict) && haveDictionary(dict.id), "register a trained dictionary");
+    checkFormat("dictionary", HUFF_FORMAT_DICT,
+        [&dict](ByteSpan in, vector<uint8_t>& out) { return compressWithDictionary(in, dict, out); });
+
+    // the same frame naming a dictionary nobody registered
+    vector<uint8_t> text = textData(1000), frame, back;
+    check(compressWithDictionary(ByteSpan{ text.data(), text.size() }, dict, frame) && frame.size() > 6 &&
+        frame[1] == HUFF_FORMAT_DICT, "dictionary frame");
+    uint32_t missing = dict.id;
+    while (haveDictionary(missing)) missing++;
+    for (int i = 0; i < 4; i++) frame[2 + i] = (uint8_t)(missing >> (8 * i));
+    uint64_t size;
+    check(!decompressedSize(ByteSpan{ frame.data(), frame.size() }, size) &&
+        !decompress(ByteSpan{ frame.data(), frame.size() }, back), "frame with a missing dictionary rejected");
+}
+
+// v5 streams, built in memory and through the chunked stream encoder, which must agree
+static void testAdaptiveStreams() {
+    checkFormat("adaptive", HUFF_FORMAT_ADAPTIVE, [](ByteSpan in, vector<uint8_t>& out) { return compressAdaptive(in, out); });
+    checkFormat("streamed adaptive", HUFF_FORMAT_ADAPTIVE, [](ByteSpan in, vector<uint8_t>& out) {
+        istringstream source(string(reinterpret_cast<const char*>(in.data), in.size));
+        ostringstream sink;
+        if (!compressStreamAdaptive(source, sink)) return false;
+        string file = sink.str();
+        out.assign(file.begin(), file.end());
+        vector<uint8_t> direct;
+        return compressAdaptive(in, direct) && direct == out;
+    });
+}
+
+static void putLE(vector<uint8_t>& out, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static void putText(vector<uint8_t>& out, const string& text) {
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+// codes file the way the CLI does: a media format when it parses as one, otherwise the block
+// container; the format must be version, the round trip exact, and the file-path detection agree
+static void checkMedia(const vector<uint8_t>& file, uint8_t version, const string& what) {
+    vector<uint8_t> packed, back;
+    ThreadPool pool(2);
+    ByteSpan span{ file.data(), file.size() };
+    if (!compressAudio(span, packed, pool) && !compressVideo(span, packed, pool) && !compressImage(span, packed, pool))
+        compressBlocks(file.data(), file.size(), packed, pool);
+    check(packed.size() >= 2 && packed[1] == version, what + " is format " + to_string(version));
+    check(decompress(ByteSpan{ packed.data(), packed.size() }, back) && back == file, what + ": round trip");
+    string path = tempPath("media.in");
+    writeFile(path, file);
+    bool detected = isPcmWavFile(path) || isY4mFile(path) || isImageFile(path);
+    check(detected == (version != HUFF_FORMAT_BLOCKS), what + ": file detection");
+    filesystem::remove(path);
+}
+
+// PCM WAV: a tone with a little noise, bits 8 (unsigned) or 16/24 (signed)
+static vector<uint8_t> wavFile(int bits, int channels, uint32_t frames, int tag = 1) {
+    int sampleBytes = bits / 8;
+    uint32_t dataSize = frames * channels * sampleBytes;
+    vector<uint8_t> file;
+    putText(file, "RIFF");
+    putLE(file, 36 + dataSize, 4);
+    putText(file, "WAVEfmt ");
+    putLE(file, 16, 4);
+    putLE(file, tag, 2);
+    putLE(file, channels, 2);
+    putLE(file, 44100, 4);
+    putLE(file, 44100 * channels * sampleBytes, 4);
+    putLE(file, channels * sampleBytes, 2);
+    putLE(file, bits, 2);
+    putText(file, "data");
+    putLE(file, dataSize, 4);
+    mt19937 rng(7);
+    double peak = (double)(1 << (bits - 2));
+    for (uint32_t f = 0; f < frames; f++) {
+        for (int c = 0; c < channels; c++) {
+            int32_t sample = (int32_t)(peak * sin(f * (0.01 + 0.003 * c))) + (int32_t)(rng() % 5) - 2;
+            if (bits == 8) sample += 128;
+            putLE(file, (uint32_t)sample, sampleBytes);
+        }
+    }
+    return file;
+}
+
+// v6 for 8, 16 and 24-bit PCM; anything the WAV parser refuses stays a byte container
+static void testAudioFiles() {
+    for (int bits : { 8, 16, 24 }) {
+        for (int channels : { 1, 2 }) {
+            string what = to_string(bits) + "-bit " + to_string(channels) + "-channel WAV";
+            checkMedia(wavFile(bits, channels, 10000), HUFF_FORMAT_AUDIO, what);
+        }
+    }
+    checkMedia(wavFile(16, 2, 10001), HUFF_FORMAT_AUDIO, "WAV with an odd frame count");
+
+    checkMedia(wavFile(16, 2, 5000, 3), HUFF_FORMAT_BLOCKS, "float WAV");
+    checkMedia(wavFile(16, 0, 5000), HUFF_FORMAT_BLOCKS, "WAV with no channels");
+    vector<uint8_t> noFormat = wavFile(16, 1, 5000);
+    memcpy(noFormat.data() + 12, "junk", 4);
+    checkMedia(noFormat, HUFF_FORMAT_BLOCKS, "WAV without a fmt chunk");
+    vector<uint8_t> cut = wavFile(16, 1, 5000);
+    cut.resize(30);
+    checkMedia(cut, HUFF_FORMAT_BLOCKS, "WAV cut inside its fmt chunk");
+}
+
+// Y4M: a gradient drifting one sample per frame, chroma subsampled by 2 for 4:2:0
+static vector<uint8_t> y4mFile(const string& params, uint32_t width, uint32_t height, bool subsampled, int frames) {
+    vector<uint8_t> file;
+    putText(file, "YUV4MPEG2 W" + to_string(width) + " H" + to_string(height) + " F25:1 Ip A1:1" + params + "\n");
+    uint32_t cw = subsampled ? (width + 1) / 2 : width, ch = subsampled ? (height + 1) / 2 : height;
+    for (int f = 0; f < frames; f++) {
+        putText(file, "FRAME\n");
+        for (uint32_t y = 0; y < height; y++)
+            for (uint32_t x = 0; x < width; x++) file.push_back((uint8_t)(x * 3 + y * 2 + f));
+        for (int plane = 1; plane <= 2; plane++)
+            for (uint32_t y = 0; y < ch; y++)
+                for (uint32_t x = 0; x < cw; x++) file.push_back((uint8_t)(128 + plane * (x - y) + f / 2));
+    }
+    return file;
+}
+
+// v7 for 4:2:0 and 4:4:4 (odd sizes included); a header the parser refuses stays a byte container
+static void testVideoFiles() {
+    checkMedia(y4mFile(" C420jpeg", 64, 48, true, 5), HUFF_FORMAT_VIDEO, "4:2:0 Y4M");
+    checkMedia(y4mFile("", 33, 17, true, 4), HUFF_FORMAT_VIDEO, "odd-sized Y4M (4:2:0 by default)");
+    checkMedia(y4mFile(" C444", 64, 48, false, 5), HUFF_FORMAT_VIDEO, "4:4:4 Y4M");
+    vector<uint8_t> tail = y4mFile(" C444", 16, 16, false, 3);
+    tail.resize(tail.size() - 100);
+    checkMedia(tail, HUFF_FORMAT_VIDEO, "Y4M ending in a partial frame");
+
+    checkMedia(y4mFile(" C420p10", 64, 48, true, 3), HUFF_FORMAT_BLOCKS, "10-bit Y4M");
+    vector<uint8_t> noWidth = y4mFile(" C420jpeg", 64, 48, true, 3);
+    noWidth[10] = 'X'; // "W64" becomes "X64"
+    checkMedia(noWidth, HUFF_FORMAT_BLOCKS, "Y4M without a width");
+    vector<uint8_t> cut = y4mFile(" C444", 64, 48, false, 1);
+    cut.resize(cut.size() - 1);
+    checkMedia(cut, HUFF_FORMAT_BLOCKS, "Y4M without a whole frame");
+}
+
+// smooth pixels for the image tests: every channel a different slope
+static uint8_t pixel(uint32_t x, uint32_t y, int c) {
+    return (uint8_t)(x * (c + 1) + y * (3 - c) + ((x ^ y) & 3));
+}
+
+// uncompressed BMP (8-bit with a grey palette, 24 or 32-bit); a negative height stores rows top-down
+static vector<uint8_t> bmpFile(int bits, int32_t width, int32_t height, uint32_t compression = 0) {
+    uint32_t palette = bits == 8 ? 256 * 4 : 0, stride = ((uint32_t)width * bits + 31) / 32 * 4;
+    uint32_t rows = (uint32_t)(height < 0 ? -height : height), offset = 54 + palette;
+    vector<uint8_t> file;
+    putText(file, "BM");
+    putLE(file, offset + stride * rows, 4);
+    putLE(file, 0, 4);
+    putLE(file, offset, 4);
+    putLE(file, 40, 4);
+    putLE(file, (uint32_t)width, 4);
+    putLE(file, (uint32_t)height, 4);
+    putLE(file, 1, 2);
+    putLE(file, bits, 2);
+    putLE(file, compression, 4);
+    putLE(file, stride * rows, 4);
+    for (int i = 0; i < 4; i++) putLE(file, 0, 4);
+    for (uint32_t i = 0; i < palette / 4; i++) putLE(file, i * 0x010101, 4);
+    for (uint32_t y = 0; y < rows; y++) {
+        size_t rowStart = file.size();
+        for (uint32_t x = 0; x < (uint32_t)width; x++)
+            for (int c = 0; c < bits / 8; c++) file.push_back(pixel(x, y, c));
+        file.resize(rowStart + stride, 0);
+    }
+    return file;
+}
+
+// binary PGM (P5) or PPM (P6) with the given maximum sample value
+static vector<uint8_t> pnmFile(char kind, uint32_t width, uint32_t height, int maxValue = 255) {
+    int channels = kind == '5' ? 1 : 3;
+    vector<uint8_t> file;
+    putText(file, string("P") + kind + "\n# test image\n" + to_string(width) + " " + to_string(height) + "\n" +
+        to_string(maxValue) + "\n");
+    for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++)
+            for (int c = 0; c < channels; c++) file.push_back(pixel(x, y, c));
+    return file;
+}
+
+// v8 for BMP (padded rows, both row orders) and PGM/PPM; headers the parser refuses stay a byte container
+static void testImageFiles() {
+    for (int bits : { 8, 24, 32 }) {
+        checkMedia(bmpFile(bits, 61, 40), HUFF_FORMAT_IMAGE, to_string(bits) + "-bit BMP");
+        checkMedia(bmpFile(bits, 61, -40), HUFF_FORMAT_IMAGE, to_string(bits) + "-bit top-down BMP");
+    }
+    checkMedia(pnmFile('5', 61, 40), HUFF_FORMAT_IMAGE, "PGM");
+    checkMedia(pnmFile('6', 61, 40), HUFF_FORMAT_IMAGE, "PPM");
+    checkMedia(pnmFile('6', 61, 40, 100), HUFF_FORMAT_IMAGE, "PPM with a low maximum value");
+
+    checkMedia(bmpFile(8, 61, 40, 1), HUFF_FORMAT_BLOCKS, "RLE-compressed BMP");
+    checkMedia(bmpFile(16, 61, 40), HUFF_FORMAT_BLOCKS, "16-bit BMP");
+    checkMedia(bmpFile(24, 0, 40), HUFF_FORMAT_BLOCKS, "BMP without a width");
+    checkMedia(pnmFile('6', 61, 40, 65535), HUFF_FORMAT_BLOCKS, "16-bit PPM");
+    vector<uint8_t> cut = pnmFile('5', 61, 40);
+    cut.pop_back();
+    checkMedia(cut, HUFF_FORMAT_BLOCKS, "PGM missing its last sample");
+    vector<uint8_t> noSize = pnmFile('6', 61, 40);
+    noSize.resize(16); // the header ends before the maximum value
+    checkMedia(noSize, HUFF_FORMAT_BLOCKS, "PPM cut inside its header");
+}
+
+// v9 in small blocks (several per input) and in one block the size of the default
+static void testBwtFiles() {
+    ThreadPool pool(2);
+    checkFormat("BWT", HUFF_FORMAT_BWT, [&pool](ByteSpan in, vector<uint8_t>& out) {
+        compressBwt(in, out, pool, MIN_BLOCK_SIZE);
+        return true;
+    });
+    checkFormat("one-block BWT", HUFF_FORMAT_BWT, [&pool](ByteSpan in, vector<uint8_t>& out) {
+        compressBwt(in, out, pool);
+        return true;
+    });
+}
+
+// v10 at the fastest, default and deepest levels, in small blocks so the inputs span several
+static void testLzFiles() {
+    ThreadPool pool(2);
+    for (int level : { 1, LZ_DEFAULT_LEVEL, LZ_MAX_LEVEL }) {
+        checkFormat("LZ level " + to_string(level), HUFF_FORMAT_LZ, [&pool, level](ByteSpan in, vector<uint8_t>& out) {
+            compressLz(in, out, pool, level, MIN_BLOCK_SIZE);
+            return true;
+        });
+    }
+}
+
+// binary-looking data: long runs of zero or 0xFF between short stretches of random bytes
+static vector<uint8_t> runData(size_t n) {
+    mt19937 rng(11);
+    vector<uint8_t> data;
+    while (data.size() < n) {
+        data.insert(data.end(), 200 + rng() % 3000, (uint8_t)(rng() % 2 ? 0xFF : 0));
+        for (int i = 0, len = (int)(rng() % 64); i < len; i++) data.push_back((uint8_t)rng());
+    }
+    data.resize(n);
+    return data;
+}
+
+// long runs turn a block into run tokens; containers holding them round trip and reject cuts
+static void testRunBlocks() {
+    check((blockFlags(runData(200000), "run-heavy block") & HUFF_FLAG_RUNS) != 0, "run-heavy block is coded as runs");
+    check((blockFlags(vector<uint8_t>(100000, 'a'), "all-same block") & HUFF_FLAG_RUNS) != 0, "all-same block is coded as runs");
+    check((blockFlags(textData(100000), "text block") & HUFF_FLAG_RUNS) == 0, "text block has no runs");
+
+    ThreadPool pool(2);
+    auto pack = [&pool](ByteSpan in, vector<uint8_t>& out) {
+        compressBlocks(in.data, in.size, out, pool, MIN_BLOCK_SIZE);
+        return true;
+    };
+    checkFormat("container", HUFF_FORMAT_BLOCKS, pack);
+    vector<uint8_t> data = runData(5 * MIN_BLOCK_SIZE + 99), packed, back;
+    pack(ByteSpan{ data.data(), data.size() }, packed);
+    check(decompress(ByteSpan{ packed.data(), packed.size() }, back) && back == data, "run-heavy container round trip");
+    check(!decompress(ByteSpan{ packed.data(), packed.size() - 1 }, back), "run-heavy container cut by a byte rejected");
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        cerr << "usage: huffman_tests <sample directory>\n";
+        return 2;
+    }
+    string samples = argv[1];
+    testDecodersAgree(samples);
+    testLengthLimits();
+    testV1Writer(samples);
+    testRandomAccess();
+    testFourStreams();
+    testContextBlocks();
+    testStoredData();
+    testDictionaryFrames();
+    testAdaptiveStreams();
+    testAudioFiles();
+    testVideoFiles();
+    testImageFiles();
+    testBwtFiles();
+    testLzFiles();
+    testRunBlocks();
+    testTruncatedStreams();
+    testEmptyInput();
+    if (failures == 0) cout << "all tests passed\n";
+    return failures;
+}